@@ -25,14 +25,23 @@
 * Analyzes and acts upon system information.
 */
 // {{{ includes
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <set>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
@@ -50,7 +59,12 @@
 #include <sys/swap.h>
 #endif
 #ifdef LINUX
+#include <poll.h>
+#include <sys/statvfs.h>
 #include <sys/sysinfo.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
 #endif
 #include <sys/utsname.h>
 #include <sys/wait.h>
@@ -58,6 +72,8 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
 using namespace std;
 #include <File>
 #include <SignalHandling>
@@ -76,19 +92,69 @@ using namespace common;
 /*! \def mUSAGE(A)
 * \brief Prints the usage statement.
 */
-#define mUSAGE(A) cout << endl << "Usage:  "<< A << " [options]"  << endl << endl << " -c SERVER, --central=SERVER" << endl << "     Provides the DNS name for the central host server." << endl << endl << " -d, --daemon" << endl << "     Turns the process into a daemon." << endl << endl << " -h, --help" << endl << "     Displays this usage screen." << endl << endl << " -s SERVER, --server=SERVER" << endl << "     Provides the DNS name for the local server." << endl << endl << " -v, --version" << endl << "     Displays the current version of this software." << endl << endl
+#define mUSAGE(A) cout << endl << "Usage:  "<< A << " [options]"  << endl << endl << " -c SERVERS, --central=SERVERS" << endl << "     Provides the comma separated DNS names, each with an optional :PORT, of the central host servers in order of preference." << endl << endl << " -d, --daemon" << endl << "     Turns the process into a daemon." << endl << endl << " -e, --events" << endl << "     Watches process events for immediate daemon liveness changes (Linux only)." << endl << endl << " -h, --help" << endl << "     Displays this usage screen." << endl << endl << " -s SERVER, --server=SERVER" << endl << "     Provides the DNS name for the local server." << endl << endl << " -v, --version" << endl << "     Displays the current version of this software." << endl << endl
 /*! \def mVER_USAGE(A,B)
 * \brief Prints the version number.
 */
 #define mVER_USAGE(A,B) cout << endl << A << " Version: " << B << endl << endl
+/*! \def BACKOFF_BASE
+* \brief Supplies the milliseconds of the first reconnect delay, which doubles with each failed attempt.
+*/
+#define BACKOFF_BASE 250
+/*! \def BACKOFF_MAX
+* \brief Supplies the maximum milliseconds between reconnect attempts.
+*/
+#define BACKOFF_MAX 60000
+/*! \def BACKOFF_STABLE
+* \brief Supplies the seconds a connection must last before the reconnect delay starts over.
+*/
+#define BACKOFF_STABLE 60
+/*! \def CONNECT_TIMEOUT
+* \brief Supplies the seconds allowed for connecting to and handshaking with a central server.
+*/
+#define CONNECT_TIMEOUT 5
+/*! \def ENDPOINT_FAILBACK
+* \brief Supplies the seconds spent on a less preferred central server before a healthy preferred one is tried again.
+*/
+#define ENDPOINT_FAILBACK 900
+/*! \def FRAME_MARKER
+* \brief Supplies the byte that starts a protocol 2 binary frame.
+*/
+#define FRAME_MARKER '\x02'
+/*! \def FRAME_PROCESS
+* \brief Identifies a binary frame holding a batch of process values.
+*/
+#define FRAME_PROCESS 2
+/*! \def FRAME_SYSTEM
+* \brief Identifies a binary frame holding system values.
+*/
+#define FRAME_SYSTEM 1
+/*! \def KEYFRAME_INTERVAL
+* \brief Supplies the number of seconds between complete protocol 3 frames.
+*/
+#define KEYFRAME_INTERVAL 300
 /*! \def LOG
 * \brief Supplies the log path.
 */
 #define LOG "/var/log/centralmon.log"
+/*! \def PROTOCOL
+* \brief Supplies the highest protocol version offered to the server.
+*/
+#define PROTOCOL 4
 /*! \def PORT
 * \brief Supplies the status communication port.
 */
 #define PORT "4636"
+/*! \def SNAPSHOT_AGE
+* \brief Supplies the number of seconds a process snapshot is reused.
+*/
+#define SNAPSHOT_AGE 5
+#ifdef LINUX
+/*! \def STATVFS_TIMEOUT
+* \brief Supplies the number of seconds to wait on statvfs() before treating a mount as hung.
+*/
+#define STATVFS_TIMEOUT 5
+#endif
 #ifdef SOLARIS
 /*! \def MAX_SWAP_ENTRIES
 * \brief Supplies the maximum swap locations.
@@ -150,6 +216,42 @@ struct process
   stringstream ssAlarms;
   stringstream ssPrevAlarms;
 };
+struct endpoint
+{
+  unsigned int unFailures;
+  time_t CRetry;
+  string strHost;
+  string strPort;
+  SSL_SESSION *ptSession;
+};
+#ifdef LINUX
+struct cpusample
+{
+  unsigned long long ullStartTime;
+  unsigned long long ullTicks;
+};
+struct filesystem
+{
+  bool bHung;
+  string strMount;
+  string strType;
+};
+struct fsusage
+{
+  bool bDone;
+  int nReturn;
+  struct statvfs tStat;
+  condition_variable readyCondition;
+  mutex readyMutex;
+};
+struct watch
+{
+  int nMinProcesses;
+  int nMaxProcesses;
+  int nProcesses;
+  int nState;
+};
+#endif
 #ifdef SOLARIS
 struct swapdata
 {
@@ -161,10 +263,92 @@ struct swapdata
 // {{{ global variables
 extern char **environ;
 static bool gbDaemon = false; //!< Global daemon variable.
+static bool gbEvents = false; //!< Contains whether process events are watched.
+static map<string, process *> gProcessList; //!< Contains the process snapshot indexed by command name.
 static string gstrTimezonePrefix = "c"; //!< Contains the local timezone.
+#ifdef LINUX
+static int gfdMountInfo = -1; //!< Contains the mount table descriptor.
+static int gfdProcEvents = -1; //!< Contains the process events connector descriptor.
+static map<pid_t, string> gPidList; //!< Contains the command name of each watched process indexed by process ID.
+static map<string, watch> gWatchList; //!< Contains the live counts of the scheduled daemons indexed by command name.
+static list<filesystem *> gFilesystemList; //!< Contains the local filesystems.
+static map<string, cpusample> gCpuList; //!< Contains the previous CPU sample indexed by process ID.
+static string gstrCpuProcessUsage; //!< Contains the top CPU consumers from the last sample.
+static unsigned int gunCpuUsage = 0; //!< Contains the CPU usage from the last sample.
+static unsigned long long gullCpuBusy = 0; //!< Contains the busy jiffies from the previous sample.
+static unsigned long long gullCpuTotal = 0; //!< Contains the total jiffies from the previous sample.
+#endif
+static time_t gCBootTime = 0; //!< Contains the system boot time.
+static time_t gCSnapshot = 0; //!< Contains the time of the last process snapshot.
+static minstd_rand gRandom; //!< Jitters the reconnect delays.
 static Utility *gpUtility = NULL; //!< Contains the Utility class.
 // }}}
 // {{{ prototypes
+/*! \fn void appendFields(string &strPayload, const vector<string> &fieldList, vector<string> &lastList, const bool bDelta, const bool bKeyframe)
+* \brief Appends encoded fields, leading with a mask of only the changed fields in delta mode.
+* \param strPayload Contains the frame payload.
+* \param fieldList Contains the encoded fields.
+* \param lastList Contains the fields last sent, which are updated.
+* \param bDelta Contains whether to send only the changed fields.
+* \param bKeyframe Contains whether to send every field regardless.
+*/
+void appendFields(string &strPayload, const vector<string> &fieldList, vector<string> &lastList, const bool bDelta, const bool bKeyframe);
+/*! \fn void appendFrame(string &strBuffer, const string &strPayload)
+* \brief Appends a protocol 2 binary frame.
+* \param strBuffer Contains the output buffer.
+* \param strPayload Contains the frame payload.
+*/
+void appendFrame(string &strBuffer, const string &strPayload);
+/*! \fn void appendString(string &strBuffer, const string &strValue)
+* \brief Appends a varint length prefixed string.
+* \param strBuffer Contains the output buffer.
+* \param strValue Contains the string.
+*/
+void appendString(string &strBuffer, const string &strValue);
+/*! \fn void appendVarint(string &strBuffer, unsigned long long ullValue)
+* \brief Appends a base 128 varint.
+* \param strBuffer Contains the output buffer.
+* \param ullValue Contains the value.
+*/
+void appendVarint(string &strBuffer, unsigned long long ullValue);
+/*! \fn unsigned int backoff(const unsigned int unAttempt)
+* \brief Determines a jittered exponential reconnect delay.
+*
+* The delay is drawn from the upper half of the exponential step so that
+* clients disconnected together do not reconnect together.
+* \param unAttempt Contains the number of consecutive failed attempts.
+* \return Returns the delay in milliseconds.
+*/
+unsigned int backoff(const unsigned int unAttempt);
+/*! \fn int endpointConnect(SSL_CTX *ctx, endpoint *ptEndpoint, SSL *&ssl, string &strError)
+* \brief Connects to a central server within CONNECT_TIMEOUT seconds.
+* \param ctx Contains the SSL context.
+* \param ptEndpoint Contains the central server.
+* \param ssl Returns the SSL connection.
+* \param strError Returns the error.
+* \return Returns the socket or -1 on failure.
+*/
+int endpointConnect(SSL_CTX *ctx, endpoint *ptEndpoint, SSL *&ssl, string &strError);
+/*! \fn endpoint *endpointFind(vector<endpoint *> &endpointList, const string &strEntry)
+* \brief Finds a central server by HOST[:PORT], adding it when it is not yet known.
+* \param endpointList Contains the central servers.
+* \param strEntry Contains the HOST[:PORT] or [HOST]:PORT.
+* \return Returns the central server.
+*/
+endpoint *endpointFind(vector<endpoint *> &endpointList, const string &strEntry);
+#ifdef LINUX
+/*! \fn bool filesystemUsage(filesystem *ptFilesystem, unsigned int &unPercent)
+* \brief Retrieves the percentage used of a local filesystem.
+*
+* The statvfs() call runs on a helper thread so that a hung mount cannot
+* stall the client loop.  A mount that does not answer within
+* STATVFS_TIMEOUT seconds is skipped until the mount table changes.
+* \param ptFilesystem Contains the filesystem.
+* \param unPercent Contains the returned percentage.
+* \return Returns a boolean true/false value.
+*/
+bool filesystemUsage(filesystem *ptFilesystem, unsigned int &unPercent);
+#endif
 /*! \fn string getErrorMessage(const int nError)
 * \brief Retrieves the exec error message.
 * \param nError Contains the error number.
@@ -176,11 +360,96 @@ string getErrorMessage(const int nError);
 * \param strMessage Contains the message.
 */
 void log(const string strMessage);
+#ifdef LINUX
+/*! \fn void mountTable()
+* \brief Reloads the local filesystems when /proc/self/mountinfo changes.
+*/
+void mountTable();
+#endif
+#ifdef LINUX
+/*! \fn bool procEventsInit()
+* \brief Subscribes to the kernel process events connector.
+*
+* Requires CAP_NET_ADMIN; on failure the client keeps relying on the
+* scheduled /proc walks alone.
+* \return Returns a boolean true/false value.
+*/
+bool procEventsInit();
+/*! \fn void procEventsRead(list<string> &changeList)
+* \brief Drains pending fork, exec, comm and exit events into the live daemon counts.
+* \param changeList Returns the daemons whose counts crossed zero or their bounds.
+*/
+void procEventsRead(list<string> &changeList);
+/*! \fn void procEventsSeed(list<string> &changeList)
+* \brief Recounts the watched daemons from /proc.
+*
+* Used when the watch list changes and when the connector overflows and
+* events may have been lost.
+* \param changeList Returns the daemons whose counts crossed zero or their bounds.
+*/
+void procEventsSeed(list<string> &changeList);
+/*! \fn int procEventsState(const watch &tWatch)
+* \brief Classifies a live daemon count against its bounds.
+* \param tWatch Contains the watched daemon.
+* \return Returns 0 within bounds, 1 when none are running, 2 below the minimum or 3 above the maximum.
+*/
+int procEventsState(const watch &tWatch);
+/*! \fn void procEventsUpdate(const string strDaemon, const pid_t nPid, const bool bAdd, list<string> &changeList)
+* \brief Adds or removes a process from the live count of a watched daemon.
+* \param strDaemon Contains the command name.
+* \param nPid Contains the process ID.
+* \param bAdd Contains whether the process started or ended.
+* \param changeList Returns the daemon when its count crossed zero or its bounds.
+*/
+void procEventsUpdate(const string strDaemon, const pid_t nPid, const bool bAdd, list<string> &changeList);
+/*! \fn bool procName(const pid_t nPid, string &strDaemon)
+* \brief Retrieves the command name of a process.
+* \param nPid Contains the process ID.
+* \param strDaemon Returns the command name.
+* \return Returns a boolean true/false value.
+*/
+bool procName(const pid_t nPid, string &strDaemon);
+#endif
+/*! \fn void procSnapshot(const time_t CMaxAge)
+* \brief Walks /proc once and indexes the running processes by command name.
+*
+* On Linux the same walk samples the per-process and overall CPU jiffies and
+* derives CPU usage from the deltas against the previous walk.
+* \param CMaxAge Contains the number of seconds an existing snapshot is reused.
+*/
+void procSnapshot(const time_t CMaxAge);
+/*! \fn void procSnapshotFree()
+* \brief Releases the process snapshot.
+*/
+void procSnapshotFree();
+/*! \fn string &startTime(const time_t CStartTime, string &strStartTime)
+* \brief Formats a process start time.
+* \param CStartTime Contains the start time.
+* \param strStartTime Returns the formatted start time, which is empty when unknown.
+* \return Returns the formatted start time.
+*/
+string &startTime(const time_t CStartTime, string &strStartTime);
 /*! \fn void sighandle(const int nSignal)
 * \brief Establishes signal handling for the application.
 * \param nSignal Contains the caught signal.
 */
 void sighandle(const int nSignal);
+/*! \fn int sslNewSession(SSL *ssl, SSL_SESSION *ptSession)
+* \brief Keeps the latest session issued by a central server for the next connection to it.
+* \param ssl Contains the SSL connection.
+* \param ptSession Contains the session.
+* \return Returns 1 when the session is kept, or 0 when the connection has no central server.
+*/
+int sslNewSession(SSL *ssl, SSL_SESSION *ptSession);
+/*! \fn SSL *sslResume(SSL_CTX *ctx, const int fdSocket, endpoint *ptEndpoint, string &strError)
+* \brief Establishes a TLS connection, offering the cached session so the server can skip the full handshake.
+* \param ctx Contains the SSL context.
+* \param fdSocket Contains the connected socket.
+* \param ptEndpoint Contains the central server whose session is offered.
+* \param strError Returns the error.
+* \return Returns the SSL connection or NULL on failure.
+*/
+SSL *sslResume(SSL_CTX *ctx, const int fdSocket, endpoint *ptEndpoint, string &strError);
 // }}}
 // {{{ main()
 /*! \fn int main(int argc, char *argv[])
@@ -221,6 +490,10 @@ int main(int argc, char *argv[])
     {
       gbDaemon = true;
     }
+    else if (strArg == "-e" || strArg == "--events")
+    {
+      gbEvents = true;
+    }
     else if (strArg == "-h" || strArg == "--help")
     {
       mUSAGE(argv[0]);
@@ -255,9 +528,30 @@ int main(int argc, char *argv[])
   // {{{ normal run
   if (!strCentral.empty() && !strServer.empty())
   {
-    bool bReady = true;
+    bool bClustered = false, bReady = true;
     ifstream inFile;
+    unsigned int unAttempt = 0;
+    string strEntry;
+    stringstream ssCentral;
     SSL_CTX *ctx = NULL;
+    vector<endpoint *> endpointList, redirectList;
+    // {{{ central servers
+    ssCentral.str(strCentral);
+    while (getline(ssCentral, strEntry, ','))
+    {
+      manip.trim(strEntry, strEntry);
+      if (!strEntry.empty())
+      {
+        endpointFind(endpointList, strEntry);
+      }
+    }
+    if (endpointList.empty())
+    {
+      bReady = false;
+      cerr << "Please provide at least one central server." << endl;
+    }
+    gRandom.seed(random_device()() ^ hash<string>()(strServer));
+    // }}}
     if (gbDaemon)
     {
       gpUtility->daemonize();
@@ -301,62 +595,95 @@ int main(int argc, char *argv[])
       bReady = false;
       cerr << "Utility::sslInitClient() error:  " << strError << endl;
     }
+    else
+    {
+      // Sessions are kept per central server by sslNewSession() rather than the internal cache since only the latest one is ever offered.
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb(ctx, sslNewSession);
+    }
+    #ifdef LINUX
+    if (gbEvents && !procEventsInit())
+    {
+      log((string)"Failed to subscribe to process events, relying on scheduled collections.  " + (string)strerror(errno));
+    }
+    #endif
     while (bReady)
     {
       bool bConnected = false;
-      struct addrinfo hints;
-      struct addrinfo *result;
-      int fdSocket, nReturn;
+      int fdSocket = -1, nReturn;
+      size_t unEndpoint = 0;
+      time_t CConnected;
       SSL *ssl = NULL;
-      memset(&hints, 0, sizeof(struct addrinfo));
-      hints.ai_family = AF_UNSPEC;
-      hints.ai_socktype = SOCK_STREAM;
-      hints.ai_flags = 0;
-      hints.ai_protocol = 0;
-      if ((nReturn = getaddrinfo(strCentral.c_str(), PORT, &hints, &result)) == 0)
+      vector<endpoint *> orderList;
+      // {{{ connect to the most preferred central server, trying redirect targets and then healthy ones first
+      time(&CConnected);
+      orderList.swap(redirectList);
+      for (int nPass = 0; nPass < 2; nPass++)
       {
-        struct addrinfo *rp;
-        for (rp = result; !bConnected && rp != NULL; rp = rp->ai_next)
+        for (size_t i = 0; i < endpointList.size(); i++)
         {
-          if ((fdSocket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol)) >= 0)
+          if ((nPass == 0) == (endpointList[i]->CRetry <= CConnected) && find(orderList.begin(), orderList.end(), endpointList[i]) == orderList.end())
           {
-            if (connect(fdSocket, rp->ai_addr, rp->ai_addrlen) == 0)
-            {
-              if ((ssl = gpUtility->sslConnect(ctx, fdSocket, strError)) != NULL)
-              {
-                bConnected = true;
-              }
-              else
-              {
-                close(fdSocket);
-              }
-            }
-            else
-            {
-              close(fdSocket);
-            }
+            orderList.push_back(endpointList[i]);
+          }
+        }
+      }
+      for (size_t i = 0; !bConnected && i < orderList.size(); i++)
+      {
+        endpoint *ptEndpoint = orderList[i];
+        if ((fdSocket = endpointConnect(ctx, ptEndpoint, ssl, strError)) >= 0)
+        {
+          bConnected = true;
+          unEndpoint = find(endpointList.begin(), endpointList.end(), ptEndpoint) - endpointList.begin();
+          if (ptEndpoint->unFailures > 0)
+          {
+            log((string)"Connected to central server " + ptEndpoint->strHost + (string)":" + ptEndpoint->strPort + (string)".");
+          }
+          ptEndpoint->unFailures = 0;
+          ptEndpoint->CRetry = 0;
+        }
+        else
+        {
+          if (ptEndpoint->unFailures++ == 0)
+          {
+            log((string)"Failed to connect to central server " + ptEndpoint->strHost + (string)":" + ptEndpoint->strPort + (string)".  " + strError);
           }
+          ptEndpoint->CRetry = CConnected + (backoff(ptEndpoint->unFailures) / 1000) + 1;
         }
-        freeaddrinfo(result);
       }
+      time(&CConnected);
+      // }}}
       if (bConnected)
       {
         bool bExit = false;
+        int nProtocol = 1;
         size_t unPosition;
-        string strBuffer[2];
-        time_t CTimeout[2];
+        map<string, unsigned long long> nameList;
+        unsigned int unSchedule = 0;
+        list<string> requestList;
+        map<string, vector<string> > lastProcessList;
+        string strBuffer[2], strSchedule;
+        time_t CKeyframe[2] = {0, 0}, CSchedule = 0, CTime, CTimeout[2];
+        vector<string> lastSystemList;
         strBuffer[1] = (string)"server " + strServer + "\n";
+        strBuffer[1] += "protocol;4\n";
         time(&(CTimeout[0]));
         while (!bExit)
         {
-          pollfd fds[1];
+          pollfd fds[2];
           fds[0].fd = fdSocket;
           fds[0].events = POLLIN;
           if (!strBuffer[1].empty())
           {
             fds[0].events |= POLLOUT;
           }
-          if ((nReturn = poll(fds, 1, 2000)) > 0)
+          fds[1].fd = -1;
+          fds[1].events = POLLIN;
+          fds[1].revents = 0;
+          #ifdef LINUX
+          fds[1].fd = gfdProcEvents;
+          #endif
+          if ((nReturn = poll(fds, 2, 2000)) > 0)
           {
             if (fds[0].revents & POLLIN)
             {
@@ -364,504 +691,8 @@ int main(int argc, char *argv[])
               {
                 while ((unPosition = strBuffer[0].find("\n")) != string::npos)
                 {
-                  string strAction;
-                  stringstream ssLine;
-                  ssLine.str(strBuffer[0].substr(0, unPosition));
+                  requestList.push_back(strBuffer[0].substr(0, unPosition));
                   strBuffer[0].erase(0, (unPosition + 1));
-                  ssLine >> strAction;
-                  if (file.directoryExist("/proc"))
-                  {
-                    FILE *pfinPipe = NULL;
-                    struct utsname server;
-                    // {{{ process
-                    if (strAction == "process")
-                    {
-                      string strProcess;
-                      ssLine >> strProcess;
-                      if (!strProcess.empty())
-                      {
-                        list<string> procList;
-                        stringstream ssDetails;
-                        process tProcess;
-                        // {{{ gather process data
-                        tProcess.nProcesses = 0;
-                        tProcess.ulImage = 0;
-                        tProcess.ulRealMinImage = 0;
-                        tProcess.ulRealMaxImage = 0;
-                        tProcess.ulResident = 0;
-                        tProcess.ulRealMinResident = 0;
-                        tProcess.ulRealMaxResident = 0;
-                        tProcess.CStartTime = 0;
-                        file.directoryList("/proc", procList);
-                        for (list<string>::iterator i = procList.begin(); i != procList.end(); i++)
-                        {
-                          if ((*i)[0] != '.' && manip.isNumeric(*i) && file.directoryExist((string)"/proc/" + (*i)))
-                          {
-                            // {{{ linux
-                            #ifdef LINUX
-                            struct stat tStat;
-                            struct passwd *ptPasswd = NULL;
-                            if (stat(((string)"/proc/" + (*i)).c_str(), &tStat) == 0 && file.fileExist((string)"/proc/" + (*i) + (string)"/stat") && (ptPasswd = getpwuid(tStat.st_uid)) != NULL)
-                            {
-                              string strOwner = ptPasswd->pw_name;
-                              ifstream inStat(((string)"/proc/" + (*i) + (string)"/stat").c_str());
-                              if (inStat.good())
-                              {
-                                string strTemp, strDaemon;
-                                long lPageSize = sysconf(_SC_PAGE_SIZE) / 1024;
-                                unsigned long ulImage = 0, ulResident = 0;
-                                inStat >> strTemp >> strDaemon;
-                                for (unsigned int i = 0; i < 20; i++)
-                                {
-                                  inStat >> strTemp;
-                                }
-                                inStat >> ulImage >> ulResident;
-                                ulImage /= 1024;
-                                ulResident *= lPageSize;
-                                if (!strDaemon.empty() && strDaemon[0] == '(')
-                                {
-                                  strDaemon.erase(0, 1);
-                                }
-                                if (!strDaemon.empty() && strDaemon[strDaemon.size() - 1] == ')')
-                                {
-                                  strDaemon.erase(strDaemon.size() - 1, 1);
-                                }
-                                if (strProcess == strDaemon)
-                                {
-                                  if (tProcess.owner.find(strOwner) == tProcess.owner.end())
-                                  {
-                                    tProcess.owner[strOwner] = 0;
-                                  }
-                                  tProcess.owner[strOwner]++;
-                                  tProcess.nProcesses++;
-                                  tProcess.ulImage += ulImage;
-                                  if (tProcess.ulRealMinImage == 0 || ulImage < tProcess.ulRealMinImage)
-                                  {
-                                    tProcess.ulRealMinImage = ulImage;
-                                  }
-                                  if (tProcess.ulRealMaxImage == 0 || ulImage > tProcess.ulRealMaxImage)
-                                  {
-                                    tProcess.ulRealMaxImage = ulImage;
-                                  }
-                                  tProcess.ulResident += ulResident;
-                                  if (tProcess.ulRealMinResident == 0 || ulResident < tProcess.ulRealMinResident)
-                                  {
-                                    tProcess.ulRealMinResident = ulResident;
-                                  }
-                                  if (tProcess.ulRealMaxResident == 0 || ulResident > tProcess.ulRealMaxResident)
-                                  {
-                                    tProcess.ulRealMaxResident = ulResident;
-                                  }
-                                  if ((pfinPipe = popen(((string)"ps --pid=" + (*i) + (string)" --format=lstart --no-headers").c_str(), "r")) != NULL)
-                                  {
-                                    char szTemp[4][10] = {"\0", "\0", "\0", "\0"};
-                                    if (fscanf(pfinPipe, "%*s %s %s %s %s", szTemp[0], szTemp[1], szTemp[2], szTemp[3]) != EOF)
-                                    {
-                                      time_t CTime;
-                                      struct tm tTime;
-                                      tTime.tm_mon = (((string)szTemp[0] == "Jan")?0:((string)szTemp[0] == "Feb")?1:((string)szTemp[0] == "Mar")?2:((string)szTemp[0] == "Apr")?3:((string)szTemp[0] == "May")?4:((string)szTemp[0] == "Jun")?5:((string)szTemp[0] == "Jul")?6:((string)szTemp[0] == "Aug")?7:((string)szTemp[0] == "Sep")?8:((string)szTemp[0] == "Oct")?9:((string)szTemp[0] == "Nov")?10:((string)szTemp[0] == "Dec")?11:0);
-                                      tTime.tm_mday = atoi(szTemp[1]);
-                                      tTime.tm_year = atoi(szTemp[3]) - 1900;
-                                      tTime.tm_hour = atoi((((string)szTemp[2]).substr(0, 2)).c_str());
-                                      tTime.tm_min = atoi((((string)szTemp[2]).substr(3, 2)).c_str());
-                                      tTime.tm_sec = atoi((((string)szTemp[2]).substr(6, 2)).c_str());
-                                      tTime.tm_isdst = -1;
-                                      CTime = mktime(&tTime);
-                                      if (CTime > 0 && (tProcess.CStartTime == 0 || CTime < tProcess.CStartTime))
-                                      {
-                                        tProcess.CStartTime = CTime;
-                                      }
-                                    }
-                                  }
-                                  pclose(pfinPipe);
-                                }
-                              }
-                              inStat.close();
-                            }
-                            #endif
-                            // }}}
-                            // {{{ solaris
-                            #ifdef SOLARIS
-                            if (file.fileExist((string)"/proc/" + (*i) + (string)"/psinfo"))
-                            {
-                              ifstream inProc(((string)"/proc/" + (*i) + (string)"/psinfo").c_str(), ios::in|ios::binary);
-                              psinfo tPsInfo;
-                              if (inProc.good() && inProc.read((char *)&tPsInfo, sizeof(psinfo)).good())
-                              {
-                                if (strProcess == (string)tPsInfo.pr_fname)
-                                {
-                                  string strOwner = getpwuid(tPsInfo.pr_uid)->pw_name;
-                                  if (tProcess.owner.find(strOwner) == tProcess.owner.end())
-                                  {
-                                    tProcess.owner[strOwner] = 0;
-                                  }
-                                  tProcess.owner[strOwner]++;
-                                  tProcess.nProcesses++;
-                                  tProcess.ulImage += tPsInfo.pr_size;
-                                  if (tProcess.ulRealMinImage == 0 || tPsInfo.pr_size < tProcess.ulRealMinImage)
-                                  {
-                                    tProcess.ulRealMinImage = tPsInfo.pr_size;
-                                  }
-                                  if (tProcess.ulRealMaxImage == 0 || tPsInfo.pr_size > tProcess.ulRealMaxImage)
-                                  {
-                                    tProcess.ulRealMaxImage = tPsInfo.pr_size;
-                                  }
-                                  tProcess.ulResident += tPsInfo.pr_rssize;
-                                  if (tProcess.ulRealMinResident == 0 || tPsInfo.pr_rssize < tProcess.ulRealMinResident)
-                                  {
-                                    tProcess.ulRealMinResident = tPsInfo.pr_rssize;
-                                  }
-                                  if (tProcess.ulRealMaxResident == 0 || tPsInfo.pr_rssize > tProcess.ulRealMaxResident)
-                                  {
-                                    tProcess.ulRealMaxResident = tPsInfo.pr_rssize;
-                                  }
-                                  if (tProcess.CStartTime == 0 || tPsInfo.pr_start.tv_sec < tProcess.CStartTime)
-                                  {
-                                    tProcess.CStartTime = tPsInfo.pr_start.tv_sec;
-                                  }
-                                }
-                              }
-                              inProc.close();
-                            }
-                            #endif
-                            // }}}
-                          }
-                        }
-                        // }}}
-                        procList.clear();
-                        ssDetails << "process;";
-                        ssDetails << strProcess << ';';
-                        if (tProcess.CStartTime > 0)
-                        {
-                          struct tm *ptTime = localtime(&(tProcess.CStartTime));
-                          ssDetails << setw(4) << setfill('0') << (ptTime->tm_year + 1900) << '-';
-                          ssDetails << setw(2) << setfill('0') << (ptTime->tm_mon + 1) << '-';
-                          ssDetails << setw(2) << setfill('0') << ptTime->tm_mday << ' ';
-                          ssDetails << setw(2) << setfill('0') << ptTime->tm_hour << ':';
-                          ssDetails << setw(2) << setfill('0') << ptTime->tm_min << ' ';
-                          ssDetails << gstrTimezonePrefix << ((ptTime->tm_isdst)?'d':'s') << "t;";
-                        }
-                        else
-                        {
-                          ssDetails << ";";
-                        }
-                        for (map<string, unsigned int>::iterator i = tProcess.owner.begin(); i != tProcess.owner.end(); i++)
-                        {
-                          if (i != tProcess.owner.begin())
-                          {
-                            ssDetails << ',';
-                          }
-                          ssDetails << i->first << '=' << i->second;
-                        }
-                        ssDetails << ';';
-                        ssDetails << tProcess.nProcesses << ';';
-                        ssDetails << tProcess.ulImage << ';';
-                        ssDetails << tProcess.ulRealMinImage << ';';
-                        ssDetails << tProcess.ulRealMaxImage << ';';
-                        ssDetails << tProcess.ulResident << ';';
-                        ssDetails << tProcess.ulRealMinResident << ';';
-                        ssDetails << tProcess.ulRealMaxResident;
-                        strBuffer[1].append(ssDetails.str() + "\n");
-                      }
-                      else
-                      {
-                        strBuffer[1].append("process;;;;0;0;0;0;0;0;0\n");
-                      }
-                    }
-                    // }}}
-                    // {{{ script
-                    else if (strAction == "script")
-                    {
-                      char *args[100], *pszArgument;
-                      int readpipe[2] = {-1, -1}, writepipe[2] = {-1, -1};
-                      pid_t childPid;
-                      string strArgument, strCommand, strJson;
-                      stringstream ssCommand;
-                      unsigned int unIndex = 0;
-                      gpUtility->getLine(ssLine, strCommand);
-                      manip.trim(strCommand, strCommand);
-                      ssCommand.str(strCommand);
-                      while (ssCommand >> strArgument)
-                      {
-                        pszArgument = new char[strArgument.size() + 1];
-                        strcpy(pszArgument, strArgument.c_str());
-                        args[unIndex++] = pszArgument;
-                      }
-                      gpUtility->getLine(fdSocket, strJson);
-                      manip.trim(strJson, strJson);
-                      args[unIndex] = NULL;
-                      if (pipe(readpipe) == 0)
-                      {
-                        if (pipe(writepipe) == 0)
-                        {
-                          if ((childPid = fork()) == 0)
-                          {
-                            int nReturn;
-                            string strValue;
-                            close(PARENT_WRITE);
-                            close(PARENT_READ);
-                            dup2(CHILD_READ, 0);
-                            close(CHILD_READ);
-                            dup2(CHILD_WRITE, 1);
-                            close(CHILD_WRITE);
-                            nReturn = execve(args[0], args, environ);
-                            log((string)"Failed to execute " + strCommand + (string)" " + strJson + (string)" using execl() [" + manip.toString(nReturn, strValue) + (string)"]:  " + getErrorMessage(nReturn));
-                            _exit(1);
-                          }
-                          else if (childPid > 0)
-                          {
-                            string strLine;
-                            close(CHILD_READ);
-                            close(CHILD_WRITE);
-                            write(PARENT_WRITE, (strJson + (string)"\n").c_str(), strJson.size() + 1);
-                            close(PARENT_READ);
-                            close(PARENT_WRITE);
-                          }
-                          else
-                          {
-                            log((string)"Failed to fork process to system call.  " + (string)strerror(errno));
-                          }
-                        }
-                        else
-                        {
-                          log((string)"Failed to establish write pipe to system call.  " + (string)strerror(errno));
-                        }
-                      }
-                      else
-                      {
-                        log((string)"Failed to establish read pipe to system call.  " + (string)strerror(errno));
-                      }
-                      for (unsigned int i = 0; i < unIndex; i++)
-                      {
-                        delete args[i];
-                      }
-                    }
-                    // }}}
-                    // {{{ system
-                    else if (strAction == "system")
-                    {
-                      map<string, bool> exclude;
-                      stringstream ssDetails;
-                      overall tOverall;
-                      time(&(CTimeout[0]));
-                      // {{{ gather system data
-                      if (uname(&server) != -1)
-                      {
-                        // {{{ linux
-                        #ifdef LINUX
-                        struct sysinfo sys;
-                        if (sysinfo(&sys) != -1)
-                        {
-                          ifstream inCpuSpeed("/proc/cpuinfo");
-                          if (inCpuSpeed.good())
-                          {
-                            if ((pfinPipe = popen("top -b -n 1 | sed -n '8,$p'| awk '{print $9, $12}'", "r")) != NULL)
-                            {
-                              float fCpuSpeed = 0;
-                              string strTemp;
-                              while (fCpuSpeed == 0 && file.findLine(inCpuSpeed, false, false, "cpu MHz"))
-                              {
-                                inCpuSpeed >> strTemp >> strTemp >> strTemp >> fCpuSpeed;
-                              }
-                              tOverall.strOperatingSystem = server.sysname;
-                              tOverall.strSystemRelease = server.release;
-                              tOverall.nProcessors = get_nprocs();
-                              tOverall.unCpuSpeed = ((tOverall.nProcessors > 0)?(unsigned int)fCpuSpeed:0);
-                              tOverall.usProcesses = sys.procs;
-                              char szProcess[32] = "\0";
-                              float fCpu = 0, fCpuUsage = 0;
-                              map<float, list<string> > load;
-                              while (fscanf(pfinPipe, "%f %s%*[^\n]", &fCpu, &szProcess[0]) != EOF)
-                              {
-                                fCpuUsage += fCpu;
-                                if (load.find(fCpu) == load.end())
-                                {
-                                  list<string> item;
-                                  load[fCpu] = item;
-                                }
-                                if (load.find(fCpu) != load.end())
-                                {
-                                  load[fCpu].push_back(szProcess);
-                                }
-                              }
-                              tOverall.unCpuUsage = (unsigned int)(fCpuUsage / ((tOverall.nProcessors > 0)?tOverall.nProcessors:1));
-                              while (load.size() > 5)
-                              {
-                                load.begin()->second.clear();
-                                load.erase(load.begin()->first);
-                              }
-                              for (map<float, list<string> >::iterator i = load.begin(); i != load.end(); i++)
-                              {
-                                for (list<string>::iterator j = i->second.begin(); j != i->second.end(); j++)
-                                {
-                                  stringstream ssCpuProcessUsage;
-                                  ssCpuProcessUsage << (*j) << '=' << i->first;
-                                  if (!tOverall.strCpuProcessUsage.empty())
-                                  {
-                                    ssCpuProcessUsage << ',';
-                                  }
-                                  tOverall.strCpuProcessUsage = ssCpuProcessUsage.str() + tOverall.strCpuProcessUsage;
-                                }
-                                i->second.clear();
-                              }
-                              load.clear();
-                              tOverall.lUpTime = sys.uptime / 86400;
-                              tOverall.ulMainTotal = (sys.totalram * sys.mem_unit) / 1048576;
-                              tOverall.ulMainUsed = ((sys.totalram - sys.freeram) * sys.mem_unit) / 1048576;
-                              tOverall.ulSwapTotal = (sys.totalswap * sys.mem_unit) / 1048576;
-                              tOverall.ulSwapUsed = ((sys.totalswap - sys.freeswap) * sys.mem_unit) / 1048576;
-                            }
-                            pclose(pfinPipe);
-                          }
-                          inCpuSpeed.close();
-                        }
-                        #endif
-                        // }}}
-                        // {{{ solaris
-                        #ifdef SOLARIS
-                        tOverall.strOperatingSystem = server.sysname;
-                        tOverall.strSystemRelease = server.release;
-                        tOverall.nProcessors = (int)sysconf(_SC_NPROCESSORS_CONF);
-                        kstat_ctl_t *kc;
-                        kstat_t *sys_pagesp;
-                        size_t lIdle, lKernel, lUser;
-                        kstat_named_t *kn;
-                        kc = kstat_open();
-                        if (kc != NULL && (sys_pagesp = kstat_lookup(kc, "cpu_info", 0, "cpu_info0")) != NULL)
-                        {
-                          kstat_read(kc, sys_pagesp, 0);
-                          kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "clock_MHz");
-                          tOverall.unCpuSpeed = (unsigned int)kn->value.ul;
-                        }
-                        list<string> dirList;
-                        file.directoryList("/proc/", dirList);
-                        unsigned short usProcesses = ((dirList.size() >= 2)?dirList.size() - 2:0);
-                        dirList.clear();
-                        tOverall.usProcesses = usProcesses;
-                        if (kc != NULL && (sys_pagesp = kstat_lookup(kc, "cpu", 0, "sys")) != NULL)
-                        {
-                          kstat_read(kc, sys_pagesp, 0);
-                          kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "cpu_nsec_idle");
-                          lIdle = kn->value.ul;
-                          kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "cpu_nsec_kernel");
-                          lKernel = kn->value.ul;
-                          kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "cpu_nsec_user");
-                          lUser = kn->value.ul;
-                          tOverall.unCpuUsage = (unsigned int)((lKernel + lUser) * 100 / (lIdle + lKernel + lUser));
-                        }
-                        kstat_close(kc);
-                        if (file.fileExist("/proc/0/psinfo"))
-                        {
-                          ifstream inProc("/proc/0/psinfo", ios::in|ios::binary);
-                          psinfo tPsInfo;
-                          if (inProc.good() && inProc.read((char *)&tPsInfo, sizeof(psinfo)).good())
-                          {
-                            time_t CTime;
-                            tOverall.lUpTime = (unsigned long)((time(&CTime) - tPsInfo.pr_start.tv_sec) / 60 /60 / 24);
-                          }
-                          inProc.close();
-                        }
-                        long lPageSize = sysconf(_SC_PAGESIZE);
-                        tOverall.ulMainTotal = (unsigned long)((float)lPageSize / 1024 / 1024 * sysconf(_SC_PHYS_PAGES));
-                        tOverall.ulMainUsed = (unsigned long)(tOverall.ulMainTotal - ((float)lPageSize / 1024 / 1024 * sysconf(_SC_AVPHYS_PAGES)));
-                        int nNum, nSwapCount;
-                        char szDummyBuffer[MAX_SWAP_ENTRIES][80];
-                        swapdata tSwapt;
-                        tSwapt.tblcount = MAX_SWAP_ENTRIES;
-                        for (unsigned int i = 0; i < MAX_SWAP_ENTRIES; i++)
-                        {
-                          tSwapt.swapdat[i].ste_path = szDummyBuffer[i]; 
-                        }
-                        nNum = swapctl(SC_GETNSWP, 0);
-                        nSwapCount = swapctl(SC_LIST, (void *)&tSwapt);
-                        if (nSwapCount != -1 && nNum != -1)
-                        {
-                          unsigned long ulPageTotal = 0, ulPageFree = 0;
-                          for (int i = 0; i < nSwapCount; i++)
-                          {
-                            ulPageTotal += tSwapt.swapdat[i].ste_pages;
-                            ulPageFree += tSwapt.swapdat[i].ste_free;
-                          }
-                          tOverall.ulSwapTotal = (unsigned long)((float)lPageSize / 1024 / 1024 * ulPageTotal);
-                          tOverall.ulSwapUsed = (unsigned long)(tOverall.ulSwapTotal - ((float)lPageSize / 1024 / 1024 * ulPageFree));
-                        }
-                        #endif
-                        // }}}
-                      }
-                      // }}}
-                      ssDetails << "system;";
-                      ssDetails << tOverall.strOperatingSystem << ';';
-                      ssDetails << tOverall.strSystemRelease << ';';
-                      ssDetails << tOverall.nProcessors << ';';
-                      ssDetails << tOverall.unCpuSpeed << ';';
-                      ssDetails << tOverall.usProcesses << ';';
-                      ssDetails << tOverall.unCpuUsage;
-                      if (!tOverall.strCpuProcessUsage.empty())
-                      {
-                        ssDetails << "|" << tOverall.strCpuProcessUsage;
-                      }
-                      ssDetails << ';';
-                      ssDetails << tOverall.lUpTime << ';';
-                      ssDetails << tOverall.ulMainUsed << ';';
-                      ssDetails << tOverall.ulMainTotal << ';';
-                      ssDetails << tOverall.ulSwapUsed << ';';
-                      ssDetails << tOverall.ulSwapTotal << ';';
-                      #ifdef SOLARIS
-                      if ((pfinPipe = popen("/usr/sbin/df -ln", "r")) != NULL)
-                      {
-                        char szBuffer[1024] = "\0";
-                        while (fgets(szBuffer, 1023, pfinPipe) != NULL)
-                        {
-                          string strName, strType;
-                          stringstream ssBuffer(szBuffer);
-                          getline(ssBuffer, strName, ':');
-                          manip.trim(strName, strName);
-                          getline(ssBuffer, strType, ':');
-                          manip.trim(strType, strType);
-                          if (strType == "lofs")
-                          {
-                            exclude[strName] = true;
-                          }
-                        }
-                        pclose(pfinPipe);
-                      }
-                      #endif
-                      if ((pfinPipe = popen("df -kl", "r")) != NULL)
-                      {
-                        bool bFirst = true;
-                        char szField[3][128] = {"\0", "\0", "\0"};
-                        fscanf(pfinPipe, "%*s %s %*s %*s %s %s %*s", szField[0], szField[1], szField[2]);
-                        while (fscanf(pfinPipe, "%*s %s %*s %*s %s %s", szField[0], szField[1], szField[2]) != EOF)
-                        {
-                          if (atoi(szField[0]) > 0 && exclude.find(szField[2]) == exclude.end())
-                          {
-                            string strUsage = szField[1];
-                            strUsage.erase(strUsage.size() - 1, 1);
-                            if (bFirst)
-                            {
-                              bFirst = false;
-                            }
-                            else
-                            {
-                              ssDetails << ',';
-                            }
-                            ssDetails << szField[2] << '=' << strUsage;
-                          }
-                        }
-                      }
-                      if (pfinPipe)
-                      {
-                        pclose(pfinPipe);
-                      }
-                      else
-                      {
-                        cout<<"Error("<<errno<<"): "<<strerror(errno)<<endl;
-                      }
-                      exclude.clear();
-                      strBuffer[1].append(ssDetails.str() + "\n");
-                    }
-                    // }}}
-                  }
                 }
               }
               else
@@ -881,131 +712,1565 @@ int main(int argc, char *argv[])
           {
             bExit = true;
           }
-          time(&(CTimeout[1]));
-          if ((CTimeout[1] - CTimeout[2]) > 60)
+          // {{{ process events
+          #ifdef LINUX
+          if (fds[1].revents & POLLIN)
           {
-            bExit = true;
+            list<string> changeList;
+            procEventsRead(changeList);
+            if (!changeList.empty() && unSchedule > 0)
+            {
+              string strChanged;
+              changeList.sort();
+              changeList.unique();
+              for (list<string>::iterator i = changeList.begin(); i != changeList.end(); i++)
+              {
+                strChanged += (string)" " + (*i);
+              }
+              requestList.push_back((string)"processes" + strChanged);
+            }
           }
-        }
-        SSL_shutdown(ssl);
-        SSL_free(ssl);
-        close(fdSocket);
-      }
-      sleep(300);
-    }
-    if (ctx != NULL)
-    {
-      SSL_CTX_free(ctx);
-    }
-    gpUtility->sslDeinit();
-  }
-  // }}}
-  // {{{ usage statement
-  else
-  {
-    mUSAGE(argv[0]);
-  }
-  // }}}
-  delete gpUtility;
-
-  return 0;
-}
-// }}}
-// {{{ getErrorMessage()
-string getErrorMessage(const int nError)
-{
-  string strReturn;
-
-  switch (nError)
-  {
-    #ifdef EACCES
-    case EACCES : strReturn = "EACCES Permission denied"; break;
-    #endif
-    #ifdef EPERM
-    case EPERM : strReturn = "EPERM Not super-user"; break;
-    #endif
-    #ifdef E2BIG
-    case E2BIG : strReturn = "E2BIG Arg list too long"; break;
-    #endif
-    #ifdef ENOEXEC
-    case ENOEXEC : strReturn = "ENOEXEC Exec format error"; break;
-    #endif
-    #ifdef EFAULT
-    case EFAULT : strReturn = "EFAULT Bad address"; break;
-    #endif
-    #ifdef ENAMETOOLONG
-    case ENAMETOOLONG : strReturn = "ENAMETOOLONG path name is too long"; break;
-    #endif
-    #ifdef ENOENT
-    case ENOENT : strReturn = "ENOENT No such file or directory"; break;
-    #endif
-    #ifdef ENOMEM
-    case ENOMEM : strReturn = "ENOMEM Not enough core"; break;
-    #endif
-    #ifdef ENOTDIR
-    case ENOTDIR : strReturn = "ENOTDIR Not a directory"; break;
-    #endif
-    #ifdef ELOOP
-    case ELOOP : strReturn = "ELOOP Too many symbolic links"; break;
-    #endif
-    #ifdef ETXTBSY
-    case ETXTBSY : strReturn = "ETXTBSY Text file busy"; break;
-    #endif
-    #ifdef EIO
-    case EIO : strReturn = "EIO I/O error"; break;
-    #endif
-    #ifdef ENFILE
-    case ENFILE : strReturn = "ENFILE Too many open files in system"; break;
-    #endif
-    #ifdef EINVAL
-    case EINVAL : strReturn = "EINVAL Invalid argument"; break;
-    #endif
-    #ifdef EISDIR
-    case EISDIR : strReturn = "EISDIR Is a directory"; break;
-    #endif
-    #ifdef ELIBBAD
-    case ELIBBAD : strReturn = "ELIBBAD Accessing a corrupted shared lib"; break;
-    #endif
-    default : strReturn = strerror(nError); break;
-  }
-
-  return strReturn;
-}
-// }}}
-// {{{ log()
-void log(const string strMessage)
-{
-  ofstream outLog;
-  StringManip manip;
-
-  outLog.open(LOG, ios::out|ios::app);
-  if (outLog.good())
-  {
-    time_t CTime;
-    char szTimeStamp[256] = "\0";
-    struct tm *tTime;
-    time(&CTime);
-    if ((tTime = localtime(&CTime)))
-    {
-      strftime(szTimeStamp, 17, "%Y-%m-%d %H:%M", tTime);
-    }
-    else
-    {
-      strcpy(szTimeStamp, "................");
-    }
-    outLog << szTimeStamp << " ---> "<< strMessage << endl;
-    delete tTime;
-  }
-  outLog.close();
-}
-// }}}
-// {{{ sighandle()
-void sighandle(const int nSignal)
-{
-  stringstream ssCore;
-
-  sethandles(sigdummy);
-  if (nSignal != SIGINT && nSignal != SIGTERM)
+          #endif
+          // }}}
+          // {{{ scheduled collection
+          if (unSchedule > 0 && time(&CTime) >= CSchedule)
+          {
+            requestList.push_back("system");
+            if (!strSchedule.empty())
+            {
+              requestList.push_back((string)"processes" + strSchedule);
+            }
+            while (CSchedule <= CTime)
+            {
+              CSchedule += unSchedule;
+            }
+          }
+          // }}}
+          while (!requestList.empty())
+          {
+            string strAction;
+            stringstream ssLine;
+            ssLine.str(requestList.front());
+            requestList.pop_front();
+            ssLine >> strAction;
+            if (file.directoryExist("/proc"))
+            {
+              #ifdef SOLARIS
+              FILE *pfinPipe = NULL;
+              #endif
+              struct utsname server;
+              // {{{ process
+              if (strAction == "process")
+              {
+                string strProcess;
+                ssLine >> strProcess;
+                if (!strProcess.empty())
+                {
+                  stringstream ssDetails;
+                  process *ptProcess = NULL;
+                  procSnapshot(SNAPSHOT_AGE);
+                  if (gProcessList.find(strProcess) != gProcessList.end())
+                  {
+                    ptProcess = gProcessList[strProcess];
+                  }
+                  ssDetails << "process;";
+                  ssDetails << strProcess << ';';
+                  if (ptProcess != NULL)
+                  {
+                    string strStartTime;
+                    ssDetails << startTime(ptProcess->CStartTime, strStartTime) << ';';
+                    for (map<string, unsigned int>::iterator i = ptProcess->owner.begin(); i != ptProcess->owner.end(); i++)
+                    {
+                      if (i != ptProcess->owner.begin())
+                      {
+                        ssDetails << ',';
+                      }
+                      ssDetails << i->first << '=' << i->second;
+                    }
+                    ssDetails << ';';
+                    ssDetails << ptProcess->nProcesses << ';';
+                    ssDetails << ptProcess->ulImage << ';';
+                    ssDetails << ptProcess->ulRealMinImage << ';';
+                    ssDetails << ptProcess->ulRealMaxImage << ';';
+                    ssDetails << ptProcess->ulResident << ';';
+                    ssDetails << ptProcess->ulRealMinResident << ';';
+                    ssDetails << ptProcess->ulRealMaxResident;
+                  }
+                  else
+                  {
+                    ssDetails << ";;0;0;0;0;0;0;0";
+                  }
+                  strBuffer[1].append(ssDetails.str() + "\n");
+                }
+                else
+                {
+                  strBuffer[1].append("process;;;;0;0;0;0;0;0;0\n");
+                }
+              }
+              // }}}
+              // {{{ processes
+              else if (strAction == "processes")
+              {
+                bool bKeyframe = false;
+                string strPayload, strProcess, strStartTime;
+                list<string> processList;
+                time_t CTime;
+                while (ssLine >> strProcess)
+                {
+                  processList.push_back(strProcess);
+                }
+                if ((time(&CTime) - CKeyframe[1]) >= KEYFRAME_INTERVAL)
+                {
+                  bKeyframe = true;
+                  CKeyframe[1] = CTime;
+                }
+                procSnapshot(SNAPSHOT_AGE);
+                appendVarint(strPayload, FRAME_PROCESS);
+                appendVarint(strPayload, processList.size());
+                for (list<string>::iterator i = processList.begin(); i != processList.end(); i++)
+                {
+                  map<string, process *>::iterator processIter = gProcessList.find(*i);
+                  map<string, unsigned long long>::iterator nameIter = nameList.find(*i);
+                  if (nameIter != nameList.end())
+                  {
+                    appendVarint(strPayload, nameIter->second);
+                  }
+                  else
+                  {
+                    unsigned long long ullID = nameList.size();
+                    nameList[*i] = ullID;
+                    appendVarint(strPayload, ullID);
+                    appendString(strPayload, *i);
+                  }
+                  vector<string> fieldList(9);
+                  if (processIter != gProcessList.end())
+                  {
+                    process *ptProcess = processIter->second;
+                    appendString(fieldList[0], startTime(ptProcess->CStartTime, strStartTime));
+                    appendVarint(fieldList[1], ptProcess->owner.size());
+                    for (map<string, unsigned int>::iterator j = ptProcess->owner.begin(); j != ptProcess->owner.end(); j++)
+                    {
+                      appendString(fieldList[1], j->first);
+                      appendVarint(fieldList[1], j->second);
+                    }
+                    appendVarint(fieldList[2], ptProcess->nProcesses);
+                    appendVarint(fieldList[3], ptProcess->ulImage);
+                    appendVarint(fieldList[4], ptProcess->ulRealMinImage);
+                    appendVarint(fieldList[5], ptProcess->ulRealMaxImage);
+                    appendVarint(fieldList[6], ptProcess->ulResident);
+                    appendVarint(fieldList[7], ptProcess->ulRealMinResident);
+                    appendVarint(fieldList[8], ptProcess->ulRealMaxResident);
+                  }
+                  else
+                  {
+                    appendString(fieldList[0], "");
+                    for (size_t j = 1; j < fieldList.size(); j++)
+                    {
+                      appendVarint(fieldList[j], 0);
+                    }
+                  }
+                  appendFields(strPayload, fieldList, lastProcessList[*i], (nProtocol >= 3), bKeyframe);
+                }
+                processList.clear();
+                appendFrame(strBuffer[1], strPayload);
+              }
+              // }}}
+              // {{{ protocol
+              else if (strAction == "protocol")
+              {
+                int nVersion = 0;
+                ssLine >> nVersion;
+                if (nVersion >= 2)
+                {
+                  nProtocol = min(nVersion, PROTOCOL);
+                }
+              }
+              // }}}
+              // {{{ redirect
+              else if (strAction == "redirect")
+              {
+                string strNode;
+                // A clustered central server names the node that owns this server followed by its standby.
+                while (ssLine >> strNode)
+                {
+                  redirectList.push_back(endpointFind(endpointList, strNode));
+                }
+                if (!redirectList.empty())
+                {
+                  log((string)"Redirected to central server " + redirectList.front()->strHost + (string)":" + redirectList.front()->strPort + (string)".");
+                  bClustered = true;
+                  bExit = true;
+                }
+              }
+              // }}}
+              // {{{ schedule
+              else if (strAction == "schedule")
+              {
+                string strProcess;
+                unsigned int unInterval = 0;
+                ssLine >> unInterval;
+                strSchedule.clear();
+                #ifdef LINUX
+                map<string, watch> watchList;
+                #endif
+                while (ssLine >> strProcess)
+                {
+                  size_t unBounds = strProcess.rfind('=');
+                  string strBounds;
+                  if (unBounds != string::npos)
+                  {
+                    strBounds = strProcess.substr(unBounds + 1);
+                    strProcess.erase(unBounds);
+                  }
+                  strSchedule += (string)" " + strProcess;
+                  #ifdef LINUX
+                  watch tWatch;
+                  size_t unComma = strBounds.find(',');
+                  tWatch.nMinProcesses = atoi(strBounds.substr(0, unComma).c_str());
+                  tWatch.nMaxProcesses = ((unComma != string::npos)?atoi(strBounds.substr(unComma + 1).c_str()):0);
+                  tWatch.nProcesses = 0;
+                  tWatch.nState = 0;
+                  watchList[strProcess] = tWatch;
+                  #endif
+                }
+                #ifdef LINUX
+                if (gfdProcEvents != -1)
+                {
+                  list<string> changeList;
+                  gWatchList.swap(watchList);
+                  procEventsSeed(changeList);
+                }
+                #endif
+                if (unInterval > 0)
+                {
+                  // Align collections to the interval and spread the fleet across it by server name.
+                  time_t CAligned;
+                  if (unSchedule == 0)
+                  {
+                    requestList.push_back("system");
+                    if (!strSchedule.empty())
+                    {
+                      requestList.push_back((string)"processes" + strSchedule);
+                    }
+                  }
+                  unSchedule = unInterval;
+                  time(&CAligned);
+                  CSchedule = CAligned - (CAligned % unSchedule) + (hash<string>()(strServer) % unSchedule);
+                  if (CSchedule <= CAligned)
+                  {
+                    CSchedule += unSchedule;
+                  }
+                }
+              }
+              // }}}
+              // {{{ script
+              else if (strAction == "script")
+              {
+                char *args[100], *pszArgument;
+                int readpipe[2] = {-1, -1}, writepipe[2] = {-1, -1};
+                pid_t childPid;
+                string strArgument, strCommand, strJson;
+                stringstream ssCommand;
+                unsigned int unIndex = 0;
+                gpUtility->getLine(ssLine, strCommand);
+                manip.trim(strCommand, strCommand);
+                ssCommand.str(strCommand);
+                while (ssCommand >> strArgument)
+                {
+                  pszArgument = new char[strArgument.size() + 1];
+                  strcpy(pszArgument, strArgument.c_str());
+                  args[unIndex++] = pszArgument;
+                }
+                gpUtility->getLine(fdSocket, strJson);
+                manip.trim(strJson, strJson);
+                args[unIndex] = NULL;
+                if (pipe(readpipe) == 0)
+                {
+                  if (pipe(writepipe) == 0)
+                  {
+                    if ((childPid = fork()) == 0)
+                    {
+                      int nReturn;
+                      string strValue;
+                      close(PARENT_WRITE);
+                      close(PARENT_READ);
+                      dup2(CHILD_READ, 0);
+                      close(CHILD_READ);
+                      dup2(CHILD_WRITE, 1);
+                      close(CHILD_WRITE);
+                      nReturn = execve(args[0], args, environ);
+                      log((string)"Failed to execute " + strCommand + (string)" " + strJson + (string)" using execl() [" + manip.toString(nReturn, strValue) + (string)"]:  " + getErrorMessage(nReturn));
+                      _exit(1);
+                    }
+                    else if (childPid > 0)
+                    {
+                      string strLine;
+                      close(CHILD_READ);
+                      close(CHILD_WRITE);
+                      write(PARENT_WRITE, (strJson + (string)"\n").c_str(), strJson.size() + 1);
+                      close(PARENT_READ);
+                      close(PARENT_WRITE);
+                    }
+                    else
+                    {
+                      log((string)"Failed to fork process to system call.  " + (string)strerror(errno));
+                    }
+                  }
+                  else
+                  {
+                    log((string)"Failed to establish write pipe to system call.  " + (string)strerror(errno));
+                  }
+                }
+                else
+                {
+                  log((string)"Failed to establish read pipe to system call.  " + (string)strerror(errno));
+                }
+                for (unsigned int i = 0; i < unIndex; i++)
+                {
+                  delete args[i];
+                }
+              }
+              // }}}
+              // {{{ system
+              else if (strAction == "system")
+              {
+                list<pair<string, unsigned int> > partitionList;
+                map<string, bool> exclude;
+                stringstream ssDetails;
+                overall tOverall;
+                time(&(CTimeout[0]));
+                // {{{ gather system data
+                if (uname(&server) != -1)
+                {
+                  // {{{ linux
+                  #ifdef LINUX
+                  struct sysinfo sys;
+                  if (sysinfo(&sys) != -1)
+                  {
+                    ifstream inCpuSpeed("/proc/cpuinfo");
+                    if (inCpuSpeed.good())
+                    {
+                      float fCpuSpeed = 0;
+                      string strTemp;
+                      while (fCpuSpeed == 0 && file.findLine(inCpuSpeed, false, false, "cpu MHz"))
+                      {
+                        inCpuSpeed >> strTemp >> strTemp >> strTemp >> fCpuSpeed;
+                      }
+                      procSnapshot(SNAPSHOT_AGE);
+                      tOverall.strOperatingSystem = server.sysname;
+                      tOverall.strSystemRelease = server.release;
+                      tOverall.nProcessors = get_nprocs();
+                      tOverall.unCpuSpeed = ((tOverall.nProcessors > 0)?(unsigned int)fCpuSpeed:0);
+                      tOverall.usProcesses = sys.procs;
+                      tOverall.unCpuUsage = gunCpuUsage;
+                      tOverall.strCpuProcessUsage = gstrCpuProcessUsage;
+                      tOverall.lUpTime = sys.uptime / 86400;
+                      tOverall.ulMainTotal = (sys.totalram * sys.mem_unit) / 1048576;
+                      tOverall.ulMainUsed = ((sys.totalram - sys.freeram) * sys.mem_unit) / 1048576;
+                      tOverall.ulSwapTotal = (sys.totalswap * sys.mem_unit) / 1048576;
+                      tOverall.ulSwapUsed = ((sys.totalswap - sys.freeswap) * sys.mem_unit) / 1048576;
+                    }
+                    inCpuSpeed.close();
+                  }
+                  #endif
+                  // }}}
+                  // {{{ solaris
+                  #ifdef SOLARIS
+                  tOverall.strOperatingSystem = server.sysname;
+                  tOverall.strSystemRelease = server.release;
+                  tOverall.nProcessors = (int)sysconf(_SC_NPROCESSORS_CONF);
+                  kstat_ctl_t *kc;
+                  kstat_t *sys_pagesp;
+                  size_t lIdle, lKernel, lUser;
+                  kstat_named_t *kn;
+                  kc = kstat_open();
+                  if (kc != NULL && (sys_pagesp = kstat_lookup(kc, "cpu_info", 0, "cpu_info0")) != NULL)
+                  {
+                    kstat_read(kc, sys_pagesp, 0);
+                    kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "clock_MHz");
+                    tOverall.unCpuSpeed = (unsigned int)kn->value.ul;
+                  }
+                  list<string> dirList;
+                  file.directoryList("/proc/", dirList);
+                  unsigned short usProcesses = ((dirList.size() >= 2)?dirList.size() - 2:0);
+                  dirList.clear();
+                  tOverall.usProcesses = usProcesses;
+                  if (kc != NULL && (sys_pagesp = kstat_lookup(kc, "cpu", 0, "sys")) != NULL)
+                  {
+                    kstat_read(kc, sys_pagesp, 0);
+                    kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "cpu_nsec_idle");
+                    lIdle = kn->value.ul;
+                    kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "cpu_nsec_kernel");
+                    lKernel = kn->value.ul;
+                    kn = (kstat_named_t *)kstat_data_lookup(sys_pagesp, "cpu_nsec_user");
+                    lUser = kn->value.ul;
+                    tOverall.unCpuUsage = (unsigned int)((lKernel + lUser) * 100 / (lIdle + lKernel + lUser));
+                  }
+                  kstat_close(kc);
+                  if (file.fileExist("/proc/0/psinfo"))
+                  {
+                    ifstream inProc("/proc/0/psinfo", ios::in|ios::binary);
+                    psinfo tPsInfo;
+                    if (inProc.good() && inProc.read((char *)&tPsInfo, sizeof(psinfo)).good())
+                    {
+                      time_t CTime;
+                      tOverall.lUpTime = (unsigned long)((time(&CTime) - tPsInfo.pr_start.tv_sec) / 60 /60 / 24);
+                    }
+                    inProc.close();
+                  }
+                  long lPageSize = sysconf(_SC_PAGESIZE);
+                  tOverall.ulMainTotal = (unsigned long)((float)lPageSize / 1024 / 1024 * sysconf(_SC_PHYS_PAGES));
+                  tOverall.ulMainUsed = (unsigned long)(tOverall.ulMainTotal - ((float)lPageSize / 1024 / 1024 * sysconf(_SC_AVPHYS_PAGES)));
+                  int nNum, nSwapCount;
+                  char szDummyBuffer[MAX_SWAP_ENTRIES][80];
+                  swapdata tSwapt;
+                  tSwapt.tblcount = MAX_SWAP_ENTRIES;
+                  for (unsigned int i = 0; i < MAX_SWAP_ENTRIES; i++)
+                  {
+                    tSwapt.swapdat[i].ste_path = szDummyBuffer[i]; 
+                  }
+                  nNum = swapctl(SC_GETNSWP, 0);
+                  nSwapCount = swapctl(SC_LIST, (void *)&tSwapt);
+                  if (nSwapCount != -1 && nNum != -1)
+                  {
+                    unsigned long ulPageTotal = 0, ulPageFree = 0;
+                    for (int i = 0; i < nSwapCount; i++)
+                    {
+                      ulPageTotal += tSwapt.swapdat[i].ste_pages;
+                      ulPageFree += tSwapt.swapdat[i].ste_free;
+                    }
+                    tOverall.ulSwapTotal = (unsigned long)((float)lPageSize / 1024 / 1024 * ulPageTotal);
+                    tOverall.ulSwapUsed = (unsigned long)(tOverall.ulSwapTotal - ((float)lPageSize / 1024 / 1024 * ulPageFree));
+                  }
+                  #endif
+                  // }}}
+                }
+                // }}}
+                // {{{ linux
+                #ifdef LINUX
+                mountTable();
+                for (list<filesystem *>::iterator i = gFilesystemList.begin(); i != gFilesystemList.end(); i++)
+                {
+                  unsigned int unPercent = 0;
+                  if (filesystemUsage(*i, unPercent))
+                  {
+                    partitionList.push_back(make_pair((*i)->strMount, unPercent));
+                  }
+                }
+                #endif
+                // }}}
+                // {{{ solaris
+                #ifdef SOLARIS
+                if ((pfinPipe = popen("/usr/sbin/df -ln", "r")) != NULL)
+                {
+                  char szBuffer[1024] = "\0";
+                  while (fgets(szBuffer, 1023, pfinPipe) != NULL)
+                  {
+                    string strName, strType;
+                    stringstream ssBuffer(szBuffer);
+                    getline(ssBuffer, strName, ':');
+                    manip.trim(strName, strName);
+                    getline(ssBuffer, strType, ':');
+                    manip.trim(strType, strType);
+                    if (strType == "lofs")
+                    {
+                      exclude[strName] = true;
+                    }
+                  }
+                  pclose(pfinPipe);
+                }
+                if ((pfinPipe = popen("df -kl", "r")) != NULL)
+                {
+                  char szField[3][128] = {"\0", "\0", "\0"};
+                  fscanf(pfinPipe, "%*s %s %*s %*s %s %s %*s", szField[0], szField[1], szField[2]);
+                  while (fscanf(pfinPipe, "%*s %s %*s %*s %s %s", szField[0], szField[1], szField[2]) != EOF)
+                  {
+                    if (atoi(szField[0]) > 0 && exclude.find(szField[2]) == exclude.end())
+                    {
+                      string strUsage = szField[1];
+                      strUsage.erase(strUsage.size() - 1, 1);
+                      partitionList.push_back(make_pair((string)szField[2], (unsigned int)atoi(strUsage.c_str())));
+                    }
+                  }
+                }
+                if (pfinPipe)
+                {
+                  pclose(pfinPipe);
+                }
+                else
+                {
+                  cout<<"Error("<<errno<<"): "<<strerror(errno)<<endl;
+                }
+                #endif
+                // }}}
+                exclude.clear();
+                if (nProtocol >= 2)
+                {
+                  bool bKeyframe = false;
+                  string strPayload;
+                  time_t CTime;
+                  vector<string> fieldList(13);
+                  if ((time(&CTime) - CKeyframe[0]) >= KEYFRAME_INTERVAL)
+                  {
+                    bKeyframe = true;
+                    CKeyframe[0] = CTime;
+                  }
+                  appendVarint(strPayload, FRAME_SYSTEM);
+                  appendString(fieldList[0], tOverall.strOperatingSystem);
+                  appendString(fieldList[1], tOverall.strSystemRelease);
+                  appendVarint(fieldList[2], tOverall.nProcessors);
+                  appendVarint(fieldList[3], tOverall.unCpuSpeed);
+                  appendVarint(fieldList[4], tOverall.usProcesses);
+                  appendVarint(fieldList[5], tOverall.unCpuUsage);
+                  appendString(fieldList[6], tOverall.strCpuProcessUsage);
+                  appendVarint(fieldList[7], tOverall.lUpTime);
+                  appendVarint(fieldList[8], tOverall.ulMainUsed);
+                  appendVarint(fieldList[9], tOverall.ulMainTotal);
+                  appendVarint(fieldList[10], tOverall.ulSwapUsed);
+                  appendVarint(fieldList[11], tOverall.ulSwapTotal);
+                  appendVarint(fieldList[12], partitionList.size());
+                  for (list<pair<string, unsigned int> >::iterator i = partitionList.begin(); i != partitionList.end(); i++)
+                  {
+                    appendString(fieldList[12], i->first);
+                    appendVarint(fieldList[12], i->second);
+                  }
+                  appendFields(strPayload, fieldList, lastSystemList, (nProtocol >= 3), bKeyframe);
+                  appendFrame(strBuffer[1], strPayload);
+                }
+                else
+                {
+                  ssDetails << "system;";
+                  ssDetails << tOverall.strOperatingSystem << ';';
+                  ssDetails << tOverall.strSystemRelease << ';';
+                  ssDetails << tOverall.nProcessors << ';';
+                  ssDetails << tOverall.unCpuSpeed << ';';
+                  ssDetails << tOverall.usProcesses << ';';
+                  ssDetails << tOverall.unCpuUsage;
+                  if (!tOverall.strCpuProcessUsage.empty())
+                  {
+                    ssDetails << "|" << tOverall.strCpuProcessUsage;
+                  }
+                  ssDetails << ';';
+                  ssDetails << tOverall.lUpTime << ';';
+                  ssDetails << tOverall.ulMainUsed << ';';
+                  ssDetails << tOverall.ulMainTotal << ';';
+                  ssDetails << tOverall.ulSwapUsed << ';';
+                  ssDetails << tOverall.ulSwapTotal << ';';
+                  for (list<pair<string, unsigned int> >::iterator i = partitionList.begin(); i != partitionList.end(); i++)
+                  {
+                    if (i != partitionList.begin())
+                    {
+                      ssDetails << ',';
+                    }
+                    ssDetails << i->first << '=' << i->second;
+                  }
+                  strBuffer[1].append(ssDetails.str() + "\n");
+                }
+                partitionList.clear();
+              }
+              // }}}
+            }
+          }
+          time(&(CTimeout[1]));
+          if ((CTimeout[1] - CTimeout[0]) > 60)
+          {
+            bExit = true;
+          }
+          // {{{ fail back to a preferred central server once it is healthy again
+          else if (!bClustered && unEndpoint > 0 && (CTimeout[1] - CConnected) >= ENDPOINT_FAILBACK)
+          {
+            for (size_t i = 0; !bExit && i < unEndpoint; i++)
+            {
+              if (endpointList[i]->CRetry <= CTimeout[1])
+              {
+                bExit = true;
+              }
+            }
+            if (!bExit)
+            {
+              CConnected = CTimeout[1];
+            }
+          }
+          // }}}
+        }
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(fdSocket);
+        procSnapshotFree();
+      }
+      // {{{ back off before reconnecting
+      if (bConnected && (!redirectList.empty() || (time(NULL) - CConnected) >= BACKOFF_STABLE))
+      {
+        unAttempt = 0;
+      }
+      this_thread::sleep_for(chrono::milliseconds(backoff(unAttempt++)));
+      // }}}
+    }
+    for (vector<endpoint *>::iterator i = endpointList.begin(); i != endpointList.end(); i++)
+    {
+      if ((*i)->ptSession != NULL)
+      {
+        SSL_SESSION_free((*i)->ptSession);
+      }
+      delete *i;
+    }
+    endpointList.clear();
+    if (ctx != NULL)
+    {
+      SSL_CTX_free(ctx);
+    }
+    gpUtility->sslDeinit();
+  }
+  // }}}
+  // {{{ usage statement
+  else
+  {
+    mUSAGE(argv[0]);
+  }
+  // }}}
+  delete gpUtility;
+
+  return 0;
+}
+// }}}
+// {{{ appendFields()
+void appendFields(string &strPayload, const vector<string> &fieldList, vector<string> &lastList, const bool bDelta, const bool bKeyframe)
+{
+  if (bDelta)
+  {
+    unsigned long long ullMask = 0;
+    lastList.resize(fieldList.size());
+    for (size_t i = 0; i < fieldList.size(); i++)
+    {
+      if (bKeyframe || fieldList[i] != lastList[i])
+      {
+        ullMask |= (1ULL << i);
+      }
+    }
+    appendVarint(strPayload, ullMask);
+    for (size_t i = 0; i < fieldList.size(); i++)
+    {
+      if (ullMask & (1ULL << i))
+      {
+        strPayload += fieldList[i];
+        lastList[i] = fieldList[i];
+      }
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < fieldList.size(); i++)
+    {
+      strPayload += fieldList[i];
+    }
+  }
+}
+// }}}
+// {{{ appendFrame()
+void appendFrame(string &strBuffer, const string &strPayload)
+{
+  strBuffer += FRAME_MARKER;
+  appendVarint(strBuffer, strPayload.size());
+  strBuffer += strPayload;
+}
+// }}}
+// {{{ appendString()
+void appendString(string &strBuffer, const string &strValue)
+{
+  appendVarint(strBuffer, strValue.size());
+  strBuffer += strValue;
+}
+// }}}
+// {{{ appendVarint()
+void appendVarint(string &strBuffer, unsigned long long ullValue)
+{
+  while (ullValue >= 0x80)
+  {
+    strBuffer += (char)((ullValue & 0x7f) | 0x80);
+    ullValue >>= 7;
+  }
+  strBuffer += (char)ullValue;
+}
+// }}}
+#ifdef LINUX
+// {{{ backoff()
+unsigned int backoff(const unsigned int unAttempt)
+{
+  unsigned int unDelay = BACKOFF_MAX;
+
+  if (unAttempt < 16 && ((unsigned int)BACKOFF_BASE << unAttempt) < BACKOFF_MAX)
+  {
+    unDelay = (unsigned int)BACKOFF_BASE << unAttempt;
+  }
+
+  return (unDelay / 2) + (gRandom() % ((unDelay / 2) + 1));
+}
+// }}}
+// {{{ endpointConnect()
+int endpointConnect(SSL_CTX *ctx, endpoint *ptEndpoint, SSL *&ssl, string &strError)
+{
+  int fdSocket = -1, nReturn;
+  struct addrinfo hints;
+  struct addrinfo *result;
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = 0;
+  hints.ai_protocol = 0;
+  if ((nReturn = getaddrinfo(ptEndpoint->strHost.c_str(), ptEndpoint->strPort.c_str(), &hints, &result)) == 0)
+  {
+    struct addrinfo *rp;
+    for (rp = result; fdSocket == -1 && rp != NULL; rp = rp->ai_next)
+    {
+      if ((fdSocket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol)) >= 0)
+      {
+        bool bConnected = false;
+        int nFlags = fcntl(fdSocket, F_GETFL);
+        // The connect is bounded so that an unreachable server fails over in seconds rather than after the kernel's SYN retries.
+        fcntl(fdSocket, F_SETFL, nFlags | O_NONBLOCK);
+        if (connect(fdSocket, rp->ai_addr, rp->ai_addrlen) == 0)
+        {
+          bConnected = true;
+        }
+        else if (errno == EINPROGRESS)
+        {
+          pollfd fds[1];
+          fds[0].fd = fdSocket;
+          fds[0].events = POLLOUT;
+          if (poll(fds, 1, CONNECT_TIMEOUT * 1000) == 1)
+          {
+            int nError = 0;
+            socklen_t unLength = sizeof(nError);
+            if (getsockopt(fdSocket, SOL_SOCKET, SO_ERROR, &nError, &unLength) == 0 && nError == 0)
+            {
+              bConnected = true;
+            }
+            else
+            {
+              strError = (string)"connect() " + strerror(nError);
+            }
+          }
+          else
+          {
+            strError = "connect() Timed out.";
+          }
+        }
+        else
+        {
+          strError = (string)"connect() " + strerror(errno);
+        }
+        if (bConnected)
+        {
+          timeval tTimeout;
+          tTimeout.tv_sec = CONNECT_TIMEOUT;
+          tTimeout.tv_usec = 0;
+          fcntl(fdSocket, F_SETFL, nFlags);
+          setsockopt(fdSocket, SOL_SOCKET, SO_RCVTIMEO, &tTimeout, sizeof(tTimeout));
+          setsockopt(fdSocket, SOL_SOCKET, SO_SNDTIMEO, &tTimeout, sizeof(tTimeout));
+          if ((ssl = sslResume(ctx, fdSocket, ptEndpoint, strError)) != NULL)
+          {
+            tTimeout.tv_sec = 0;
+            setsockopt(fdSocket, SOL_SOCKET, SO_RCVTIMEO, &tTimeout, sizeof(tTimeout));
+            setsockopt(fdSocket, SOL_SOCKET, SO_SNDTIMEO, &tTimeout, sizeof(tTimeout));
+          }
+          else
+          {
+            bConnected = false;
+          }
+        }
+        if (!bConnected)
+        {
+          close(fdSocket);
+          fdSocket = -1;
+        }
+      }
+    }
+    freeaddrinfo(result);
+  }
+  else
+  {
+    strError = (string)"getaddrinfo() " + gai_strerror(nReturn);
+  }
+
+  return fdSocket;
+}
+// }}}
+// {{{ endpointFind()
+endpoint *endpointFind(vector<endpoint *> &endpointList, const string &strEntry)
+{
+  endpoint *ptEndpoint = new endpoint;
+  size_t unColon;
+
+  ptEndpoint->unFailures = 0;
+  ptEndpoint->CRetry = 0;
+  ptEndpoint->strPort = PORT;
+  ptEndpoint->ptSession = NULL;
+  if (strEntry[0] == '[' && (unColon = strEntry.find(']')) != string::npos)
+  {
+    ptEndpoint->strHost = strEntry.substr(1, unColon - 1);
+    if (unColon + 2 < strEntry.size() && strEntry[unColon + 1] == ':')
+    {
+      ptEndpoint->strPort = strEntry.substr(unColon + 2);
+    }
+  }
+  else if ((unColon = strEntry.find(':')) != string::npos && strEntry.find(':', unColon + 1) == string::npos)
+  {
+    ptEndpoint->strHost = strEntry.substr(0, unColon);
+    ptEndpoint->strPort = strEntry.substr(unColon + 1);
+  }
+  else
+  {
+    ptEndpoint->strHost = strEntry;
+  }
+  for (vector<endpoint *>::iterator i = endpointList.begin(); i != endpointList.end(); i++)
+  {
+    if ((*i)->strHost == ptEndpoint->strHost && (*i)->strPort == ptEndpoint->strPort)
+    {
+      delete ptEndpoint;
+      ptEndpoint = *i;
+    }
+  }
+  if (find(endpointList.begin(), endpointList.end(), ptEndpoint) == endpointList.end())
+  {
+    endpointList.push_back(ptEndpoint);
+  }
+
+  return ptEndpoint;
+}
+// }}}
+// {{{ filesystemUsage()
+bool filesystemUsage(filesystem *ptFilesystem, unsigned int &unPercent)
+{
+  bool bResult = false;
+
+  if (!ptFilesystem->bHung)
+  {
+    shared_ptr<fsusage> ptUsage = make_shared<fsusage>();
+    string strMount = ptFilesystem->strMount;
+    ptUsage->bDone = false;
+    ptUsage->nReturn = -1;
+    thread tStatvfs([ptUsage, strMount]()
+    {
+      struct statvfs tStat;
+      int nReturn = statvfs(strMount.c_str(), &tStat);
+      lock_guard<mutex> lock(ptUsage->readyMutex);
+      ptUsage->nReturn = nReturn;
+      ptUsage->tStat = tStat;
+      ptUsage->bDone = true;
+      ptUsage->readyCondition.notify_one();
+    });
+    tStatvfs.detach();
+    unique_lock<mutex> lock(ptUsage->readyMutex);
+    if (ptUsage->readyCondition.wait_for(lock, chrono::seconds(STATVFS_TIMEOUT), [ptUsage](){return ptUsage->bDone;}))
+    {
+      if (ptUsage->nReturn == 0 && ptUsage->tStat.f_blocks > 0)
+      {
+        unsigned long long ullUsed = ptUsage->tStat.f_blocks - ptUsage->tStat.f_bfree, ullTotal = ullUsed + ptUsage->tStat.f_bavail;
+        bResult = true;
+        unPercent = ((ullTotal > 0)?(unsigned int)((ullUsed * 100 + ullTotal - 1) / ullTotal):0);
+      }
+    }
+    else
+    {
+      ptFilesystem->bHung = true;
+      log((string)"The " + ptFilesystem->strMount + (string)" filesystem did not respond to statvfs() and will be skipped until the mount table changes.");
+    }
+  }
+
+  return bResult;
+}
+// }}}
+#endif
+// {{{ getErrorMessage()
+string getErrorMessage(const int nError)
+{
+  string strReturn;
+
+  switch (nError)
+  {
+    #ifdef EACCES
+    case EACCES : strReturn = "EACCES Permission denied"; break;
+    #endif
+    #ifdef EPERM
+    case EPERM : strReturn = "EPERM Not super-user"; break;
+    #endif
+    #ifdef E2BIG
+    case E2BIG : strReturn = "E2BIG Arg list too long"; break;
+    #endif
+    #ifdef ENOEXEC
+    case ENOEXEC : strReturn = "ENOEXEC Exec format error"; break;
+    #endif
+    #ifdef EFAULT
+    case EFAULT : strReturn = "EFAULT Bad address"; break;
+    #endif
+    #ifdef ENAMETOOLONG
+    case ENAMETOOLONG : strReturn = "ENAMETOOLONG path name is too long"; break;
+    #endif
+    #ifdef ENOENT
+    case ENOENT : strReturn = "ENOENT No such file or directory"; break;
+    #endif
+    #ifdef ENOMEM
+    case ENOMEM : strReturn = "ENOMEM Not enough core"; break;
+    #endif
+    #ifdef ENOTDIR
+    case ENOTDIR : strReturn = "ENOTDIR Not a directory"; break;
+    #endif
+    #ifdef ELOOP
+    case ELOOP : strReturn = "ELOOP Too many symbolic links"; break;
+    #endif
+    #ifdef ETXTBSY
+    case ETXTBSY : strReturn = "ETXTBSY Text file busy"; break;
+    #endif
+    #ifdef EIO
+    case EIO : strReturn = "EIO I/O error"; break;
+    #endif
+    #ifdef ENFILE
+    case ENFILE : strReturn = "ENFILE Too many open files in system"; break;
+    #endif
+    #ifdef EINVAL
+    case EINVAL : strReturn = "EINVAL Invalid argument"; break;
+    #endif
+    #ifdef EISDIR
+    case EISDIR : strReturn = "EISDIR Is a directory"; break;
+    #endif
+    #ifdef ELIBBAD
+    case ELIBBAD : strReturn = "ELIBBAD Accessing a corrupted shared lib"; break;
+    #endif
+    default : strReturn = strerror(nError); break;
+  }
+
+  return strReturn;
+}
+// }}}
+// {{{ log()
+void log(const string strMessage)
+{
+  ofstream outLog;
+  StringManip manip;
+
+  outLog.open(LOG, ios::out|ios::app);
+  if (outLog.good())
+  {
+    time_t CTime;
+    char szTimeStamp[256] = "\0";
+    struct tm *tTime;
+    time(&CTime);
+    if ((tTime = localtime(&CTime)))
+    {
+      strftime(szTimeStamp, 17, "%Y-%m-%d %H:%M", tTime);
+    }
+    else
+    {
+      strcpy(szTimeStamp, "................");
+    }
+    outLog << szTimeStamp << " ---> "<< strMessage << endl;
+    delete tTime;
+  }
+  outLog.close();
+}
+// }}}
+#ifdef LINUX
+// {{{ mountTable()
+void mountTable()
+{
+  bool bReload = false;
+
+  if (gfdMountInfo == -1)
+  {
+    if ((gfdMountInfo = open("/proc/self/mountinfo", O_RDONLY)) >= 0)
+    {
+      bReload = true;
+    }
+  }
+  else
+  {
+    pollfd fds[1];
+    fds[0].fd = gfdMountInfo;
+    fds[0].events = POLLPRI;
+    if (poll(fds, 1, 0) > 0 && (fds[0].revents & (POLLERR | POLLPRI)))
+    {
+      bReload = true;
+    }
+  }
+  if (bReload)
+  {
+    char szBuffer[4096];
+    ssize_t nReturn;
+    string strLine, strMountInfo;
+    stringstream ssMountInfo;
+    map<string, list<filesystem *>::iterator> mountList;
+    set<string> deviceList;
+    const string strSkip = " 9p afs autofs binfmt_misc bpf ceph cgroup cgroup2 cifs coda configfs debugfs devpts efivarfs fuse.glusterfs fuse.s3fs fuse.sshfs fusectl glusterfs gpfs hugetlbfs lustre mqueue ncpfs nfs nfs4 nfsd nsfs proc pstore rpc_pipefs securityfs selinuxfs smb3 smbfs sysfs tracefs ";
+    lseek(gfdMountInfo, 0, SEEK_SET);
+    while ((nReturn = read(gfdMountInfo, szBuffer, sizeof(szBuffer))) > 0)
+    {
+      strMountInfo.append(szBuffer, nReturn);
+    }
+    for (list<filesystem *>::iterator i = gFilesystemList.begin(); i != gFilesystemList.end(); i++)
+    {
+      delete *i;
+    }
+    gFilesystemList.clear();
+    ssMountInfo.str(strMountInfo);
+    // id parent major:minor root mount options [optional...] - type source super
+    while (getline(ssMountInfo, strLine))
+    {
+      string strDevice, strField, strMount, strType;
+      stringstream ssLine(strLine);
+      ssLine >> strField >> strField >> strDevice >> strField >> strMount;
+      while (ssLine >> strField && strField != "-");
+      ssLine >> strType;
+      // Bind mounts repeat the major:minor of the device, so only its first mount is kept.
+      if (!strDevice.empty() && !strMount.empty() && !strType.empty() && strSkip.find((string)" " + strType + (string)" ") == string::npos && deviceList.insert(strDevice).second)
+      {
+        filesystem *ptFilesystem = new filesystem;
+        for (size_t unPosition = 0; (unPosition = strMount.find('\\', unPosition)) != string::npos; unPosition++)
+        {
+          if (unPosition + 3 < strMount.size())
+          {
+            strMount.replace(unPosition, 4, 1, (char)strtol(strMount.substr(unPosition + 1, 3).c_str(), NULL, 8));
+          }
+        }
+        ptFilesystem->bHung = false;
+        ptFilesystem->strMount = strMount;
+        ptFilesystem->strType = strType;
+        if (mountList.find(strMount) != mountList.end())
+        {
+          delete *(mountList[strMount]);
+          gFilesystemList.erase(mountList[strMount]);
+        }
+        mountList[strMount] = gFilesystemList.insert(gFilesystemList.end(), ptFilesystem);
+      }
+    }
+    deviceList.clear();
+    mountList.clear();
+  }
+}
+// }}}
+#endif
+#ifdef LINUX
+// {{{ procEventsInit()
+bool procEventsInit()
+{
+  bool bResult = false;
+
+  if ((gfdProcEvents = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR)) != -1)
+  {
+    sockaddr_nl tAddr;
+    memset(&tAddr, 0, sizeof(sockaddr_nl));
+    tAddr.nl_family = AF_NETLINK;
+    tAddr.nl_groups = CN_IDX_PROC;
+    if (bind(gfdProcEvents, (sockaddr *)&tAddr, sizeof(sockaddr_nl)) == 0)
+    {
+      char szBuffer[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))];
+      nlmsghdr *ptHeader = (nlmsghdr *)szBuffer;
+      cn_msg *ptMessage = (cn_msg *)NLMSG_DATA(ptHeader);
+      proc_cn_mcast_op eOperation = PROC_CN_MCAST_LISTEN;
+      memset(szBuffer, 0, sizeof(szBuffer));
+      ptHeader->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+      ptHeader->nlmsg_type = NLMSG_DONE;
+      ptMessage->id.idx = CN_IDX_PROC;
+      ptMessage->id.val = CN_VAL_PROC;
+      ptMessage->len = sizeof(proc_cn_mcast_op);
+      memcpy(ptMessage->data, &eOperation, sizeof(proc_cn_mcast_op));
+      if (send(gfdProcEvents, szBuffer, ptHeader->nlmsg_len, 0) != -1)
+      {
+        fcntl(gfdProcEvents, F_SETFL, fcntl(gfdProcEvents, F_GETFL) | O_NONBLOCK);
+        bResult = true;
+      }
+    }
+    if (!bResult)
+    {
+      close(gfdProcEvents);
+      gfdProcEvents = -1;
+    }
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ procEventsRead()
+void procEventsRead(list<string> &changeList)
+{
+  bool bDone = false;
+  char szBuffer[8192] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+
+  while (!bDone)
+  {
+    ssize_t nSize = recv(gfdProcEvents, szBuffer, sizeof(szBuffer), 0);
+    if (nSize > 0)
+    {
+      int nLength = (int)nSize;
+      for (nlmsghdr *ptHeader = (nlmsghdr *)szBuffer; NLMSG_OK(ptHeader, nLength); ptHeader = NLMSG_NEXT(ptHeader, nLength))
+      {
+        cn_msg *ptMessage = (cn_msg *)NLMSG_DATA(ptHeader);
+        if (ptMessage->id.idx == CN_IDX_PROC && ptMessage->id.val == CN_VAL_PROC)
+        {
+          proc_event *ptEvent = (proc_event *)ptMessage->data;
+          pid_t nPid = 0;
+          string strDaemon;
+          switch (ptEvent->what)
+          {
+            // {{{ fork
+            case proc_event::PROC_EVENT_FORK:
+            {
+              // Threads share the parent's entry; only new processes are counted.
+              if (ptEvent->event_data.fork.child_pid == ptEvent->event_data.fork.child_tgid && gPidList.find(ptEvent->event_data.fork.parent_tgid) != gPidList.end())
+              {
+                procEventsUpdate(gPidList[ptEvent->event_data.fork.parent_tgid], ptEvent->event_data.fork.child_tgid, true, changeList);
+              }
+              break;
+            }
+            // }}}
+            // {{{ exec and comm
+            case proc_event::PROC_EVENT_EXEC:
+            case proc_event::PROC_EVENT_COMM:
+            {
+              nPid = ((ptEvent->what == proc_event::PROC_EVENT_EXEC)?ptEvent->event_data.exec.process_tgid:ptEvent->event_data.comm.process_tgid);
+              if (ptEvent->what == proc_event::PROC_EVENT_EXEC || ptEvent->event_data.comm.process_pid == nPid)
+              {
+                if (gPidList.find(nPid) != gPidList.end())
+                {
+                  procEventsUpdate(gPidList[nPid], nPid, false, changeList);
+                }
+                if (procName(nPid, strDaemon))
+                {
+                  procEventsUpdate(strDaemon, nPid, true, changeList);
+                }
+              }
+              break;
+            }
+            // }}}
+            // {{{ exit
+            case proc_event::PROC_EVENT_EXIT:
+            {
+              nPid = ptEvent->event_data.exit.process_tgid;
+              if (ptEvent->event_data.exit.process_pid == nPid && gPidList.find(nPid) != gPidList.end())
+              {
+                procEventsUpdate(gPidList[nPid], nPid, false, changeList);
+              }
+              break;
+            }
+            // }}}
+            default:
+            {
+              break;
+            }
+          }
+        }
+      }
+    }
+    else if (nSize < 0 && errno == ENOBUFS)
+    {
+      procEventsSeed(changeList);
+    }
+    else
+    {
+      bDone = true;
+    }
+  }
+}
+// }}}
+// {{{ procEventsSeed()
+void procEventsSeed(list<string> &changeList)
+{
+  list<string> procList;
+  File file;
+  StringManip manip;
+
+  gPidList.clear();
+  for (map<string, watch>::iterator i = gWatchList.begin(); i != gWatchList.end(); i++)
+  {
+    i->second.nProcesses = 0;
+  }
+  file.directoryList("/proc", procList);
+  for (list<string>::iterator i = procList.begin(); i != procList.end(); i++)
+  {
+    string strDaemon;
+    if ((*i)[0] != '.' && manip.isNumeric(*i) && procName(atoi(i->c_str()), strDaemon) && gWatchList.find(strDaemon) != gWatchList.end())
+    {
+      gPidList[atoi(i->c_str())] = strDaemon;
+      gWatchList[strDaemon].nProcesses++;
+    }
+  }
+  procList.clear();
+  for (map<string, watch>::iterator i = gWatchList.begin(); i != gWatchList.end(); i++)
+  {
+    int nState = procEventsState(i->second);
+    if (i->second.nState != nState)
+    {
+      i->second.nState = nState;
+      changeList.push_back(i->first);
+    }
+  }
+}
+// }}}
+// {{{ procEventsState()
+int procEventsState(const watch &tWatch)
+{
+  int nState = 0;
+
+  if (tWatch.nProcesses == 0)
+  {
+    nState = 1;
+  }
+  else if (tWatch.nMinProcesses > 0 && tWatch.nProcesses < tWatch.nMinProcesses)
+  {
+    nState = 2;
+  }
+  else if (tWatch.nMaxProcesses > 0 && tWatch.nProcesses > tWatch.nMaxProcesses)
+  {
+    nState = 3;
+  }
+
+  return nState;
+}
+// }}}
+// {{{ procEventsUpdate()
+void procEventsUpdate(const string strDaemon, const pid_t nPid, const bool bAdd, list<string> &changeList)
+{
+  map<string, watch>::iterator watchIter = gWatchList.find(strDaemon);
+
+  if (watchIter != gWatchList.end())
+  {
+    int nState;
+    watch &tWatch = watchIter->second;
+    if (bAdd)
+    {
+      if (gPidList.find(nPid) == gPidList.end())
+      {
+        gPidList[nPid] = strDaemon;
+        tWatch.nProcesses++;
+      }
+    }
+    else if (gPidList.erase(nPid) > 0 && tWatch.nProcesses > 0)
+    {
+      tWatch.nProcesses--;
+    }
+    // Keep an existing snapshot current so an immediate frame carries the live count.
+    if (gCSnapshot != 0)
+    {
+      map<string, process *>::iterator processIter = gProcessList.find(strDaemon);
+      if (processIter != gProcessList.end())
+      {
+        if (tWatch.nProcesses > 0)
+        {
+          processIter->second->nProcesses = tWatch.nProcesses;
+        }
+        else
+        {
+          processIter->second->owner.clear();
+          delete processIter->second;
+          gProcessList.erase(processIter);
+        }
+      }
+      else if (tWatch.nProcesses > 0)
+      {
+        // A newly appeared daemon has no start time, owners or sizes yet, so the next frame takes a fresh snapshot.
+        gCSnapshot = 0;
+      }
+    }
+    nState = procEventsState(tWatch);
+    if (tWatch.nState != nState)
+    {
+      tWatch.nState = nState;
+      changeList.push_back(strDaemon);
+    }
+  }
+  else if (!bAdd)
+  {
+    gPidList.erase(nPid);
+  }
+}
+// }}}
+// {{{ procName()
+bool procName(const pid_t nPid, string &strDaemon)
+{
+  bool bResult = false;
+  stringstream ssPath;
+  ifstream inStat;
+
+  ssPath << "/proc/" << nPid << "/stat";
+  inStat.open(ssPath.str().c_str());
+  if (inStat.good())
+  {
+    string strLine;
+    if (getline(inStat, strLine))
+    {
+      size_t unOpen = strLine.find('('), unClose = strLine.rfind(')');
+      if (unOpen != string::npos && unClose != string::npos && unClose > unOpen)
+      {
+        strDaemon = strLine.substr(unOpen + 1, unClose - unOpen - 1);
+        bResult = true;
+      }
+    }
+  }
+  inStat.close();
+
+  return bResult;
+}
+// }}}
+#endif
+// {{{ procSnapshot()
+void procSnapshot(const time_t CMaxAge)
+{
+  time_t CTime;
+
+  time(&CTime);
+  if (gCSnapshot == 0 || (CTime - gCSnapshot) >= CMaxAge)
+  {
+    list<string> procList;
+    map<uid_t, string> userList;
+    File file;
+    StringManip manip;
+    #ifdef LINUX
+    int nProcessors = get_nprocs();
+    long lPageSize = sysconf(_SC_PAGE_SIZE) / 1024, lTicks = sysconf(_SC_CLK_TCK);
+    unsigned long long ullCpuBusy = 0, ullCpuTotal = 0, ullCpuDelta = 0;
+    map<string, cpusample> cpuList;
+    list<pair<float, string> > usageList;
+    ifstream inStat("/proc/stat");
+    string strLine;
+    // {{{ overall jiffies
+    while (getline(inStat, strLine))
+    {
+      if (strLine.size() > 4 && strLine.substr(0, 4) == "cpu ")
+      {
+        unsigned long long ullValue[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        stringstream ssCpu(strLine.substr(4, strLine.size() - 4));
+        // user nice system idle iowait irq softirq steal
+        for (unsigned int i = 0; i < 8 && ssCpu >> ullValue[i]; i++);
+        ullCpuBusy = ullValue[0] + ullValue[1] + ullValue[2] + ullValue[5] + ullValue[6] + ullValue[7];
+        ullCpuTotal = ullCpuBusy + ullValue[3] + ullValue[4];
+      }
+      else if (gCBootTime == 0 && strLine.size() > 6 && strLine.substr(0, 6) == "btime ")
+      {
+        gCBootTime = atol(strLine.substr(6, strLine.size() - 6).c_str());
+      }
+    }
+    inStat.close();
+    if (ullCpuTotal > gullCpuTotal && ullCpuBusy >= gullCpuBusy)
+    {
+      ullCpuDelta = ullCpuTotal - gullCpuTotal;
+      gunCpuUsage = (unsigned int)((ullCpuBusy - gullCpuBusy) * 100 / ullCpuDelta);
+    }
+    gullCpuBusy = ullCpuBusy;
+    gullCpuTotal = ullCpuTotal;
+    // }}}
+    #endif
+    procSnapshotFree();
+    gCSnapshot = CTime;
+    file.directoryList("/proc", procList);
+    for (list<string>::iterator i = procList.begin(); i != procList.end(); i++)
+    {
+      if ((*i)[0] != '.' && manip.isNumeric(*i))
+      {
+        bool bFound = false;
+        uid_t nUid = 0;
+        unsigned long ulImage = 0, ulResident = 0;
+        string strDaemon;
+        time_t CStartTime = 0;
+        // {{{ linux
+        #ifdef LINUX
+        struct stat tStat;
+        if (stat(((string)"/proc/" + (*i)).c_str(), &tStat) == 0)
+        {
+          ifstream inStat(((string)"/proc/" + (*i) + (string)"/stat").c_str());
+          string strLine;
+          if (inStat.good() && getline(inStat, strLine))
+          {
+            size_t unOpen = strLine.find('('), unClose = strLine.rfind(')');
+            if (unOpen != string::npos && unClose != string::npos && unClose > unOpen)
+            {
+              string strTemp;
+              stringstream ssStat(strLine.substr(unClose + 1));
+              cpusample tSample;
+              unsigned long long ullSystem = 0, ullUser = 0;
+              strDaemon = strLine.substr(unOpen + 1, unClose - unOpen - 1);
+              for (unsigned int j = 3; j < 14; j++)
+              {
+                ssStat >> strTemp;
+              }
+              ssStat >> ullUser >> ullSystem;
+              for (unsigned int j = 16; j < 22; j++)
+              {
+                ssStat >> strTemp;
+              }
+              ssStat >> tSample.ullStartTime >> ulImage >> ulResident;
+              if (gCBootTime > 0 && lTicks > 0)
+              {
+                CStartTime = gCBootTime + (time_t)(tSample.ullStartTime / lTicks);
+              }
+              // {{{ cpu usage
+              tSample.ullTicks = ullUser + ullSystem;
+              if (ullCpuDelta > 0 && gCpuList.find(*i) != gCpuList.end() && gCpuList[*i].ullStartTime == tSample.ullStartTime && tSample.ullTicks > gCpuList[*i].ullTicks)
+              {
+                float fUsage = (float)(tSample.ullTicks - gCpuList[*i].ullTicks) * 100 * ((nProcessors > 0)?nProcessors:1) / ullCpuDelta;
+                usageList.push_back(make_pair((float)((int)(fUsage * 10 + 0.5)) / 10, strDaemon));
+              }
+              cpuList[*i] = tSample;
+              // }}}
+              ulImage /= 1024;
+              ulResident *= lPageSize;
+              nUid = tStat.st_uid;
+              bFound = true;
+            }
+          }
+          inStat.close();
+        }
+        #endif
+        // }}}
+        // {{{ solaris
+        #ifdef SOLARIS
+        ifstream inProc(((string)"/proc/" + (*i) + (string)"/psinfo").c_str(), ios::in|ios::binary);
+        psinfo tPsInfo;
+        if (inProc.good() && inProc.read((char *)&tPsInfo, sizeof(psinfo)).good())
+        {
+          strDaemon = tPsInfo.pr_fname;
+          ulImage = tPsInfo.pr_size;
+          ulResident = tPsInfo.pr_rssize;
+          CStartTime = tPsInfo.pr_start.tv_sec;
+          nUid = tPsInfo.pr_uid;
+          bFound = true;
+        }
+        inProc.close();
+        #endif
+        // }}}
+        if (bFound && !strDaemon.empty())
+        {
+          process *ptProcess;
+          if (userList.find(nUid) == userList.end())
+          {
+            struct passwd *ptPasswd = getpwuid(nUid);
+            if (ptPasswd != NULL)
+            {
+              userList[nUid] = ptPasswd->pw_name;
+            }
+            else
+            {
+              stringstream ssUid;
+              ssUid << nUid;
+              userList[nUid] = ssUid.str();
+            }
+          }
+          if (gProcessList.find(strDaemon) == gProcessList.end())
+          {
+            ptProcess = new process;
+            ptProcess->nProcesses = 0;
+            ptProcess->ulImage = 0;
+            ptProcess->ulRealMinImage = 0;
+            ptProcess->ulRealMaxImage = 0;
+            ptProcess->ulResident = 0;
+            ptProcess->ulRealMinResident = 0;
+            ptProcess->ulRealMaxResident = 0;
+            ptProcess->CStartTime = 0;
+            gProcessList[strDaemon] = ptProcess;
+          }
+          else
+          {
+            ptProcess = gProcessList[strDaemon];
+          }
+          if (ptProcess->owner.find(userList[nUid]) == ptProcess->owner.end())
+          {
+            ptProcess->owner[userList[nUid]] = 0;
+          }
+          ptProcess->owner[userList[nUid]]++;
+          ptProcess->nProcesses++;
+          ptProcess->ulImage += ulImage;
+          if (ptProcess->ulRealMinImage == 0 || ulImage < ptProcess->ulRealMinImage)
+          {
+            ptProcess->ulRealMinImage = ulImage;
+          }
+          if (ptProcess->ulRealMaxImage == 0 || ulImage > ptProcess->ulRealMaxImage)
+          {
+            ptProcess->ulRealMaxImage = ulImage;
+          }
+          ptProcess->ulResident += ulResident;
+          if (ptProcess->ulRealMinResident == 0 || ulResident < ptProcess->ulRealMinResident)
+          {
+            ptProcess->ulRealMinResident = ulResident;
+          }
+          if (ptProcess->ulRealMaxResident == 0 || ulResident > ptProcess->ulRealMaxResident)
+          {
+            ptProcess->ulRealMaxResident = ulResident;
+          }
+          if (CStartTime > 0 && (ptProcess->CStartTime == 0 || CStartTime < ptProcess->CStartTime))
+          {
+            ptProcess->CStartTime = CStartTime;
+          }
+        }
+      }
+    }
+    procList.clear();
+    userList.clear();
+    #ifdef LINUX
+    // {{{ top cpu consumers
+    gCpuList.swap(cpuList);
+    cpuList.clear();
+    usageList.sort();
+    usageList.reverse();
+    gstrCpuProcessUsage.clear();
+    unsigned int unCount = 0;
+    for (list<pair<float, string> >::iterator i = usageList.begin(); unCount < 5 && i != usageList.end(); i++)
+    {
+      if (i->first > 0)
+      {
+        stringstream ssCpuProcessUsage;
+        unCount++;
+        if (!gstrCpuProcessUsage.empty())
+        {
+          ssCpuProcessUsage << ',';
+        }
+        ssCpuProcessUsage << i->second << '=' << i->first;
+        gstrCpuProcessUsage += ssCpuProcessUsage.str();
+      }
+    }
+    usageList.clear();
+    // }}}
+    #endif
+  }
+}
+// }}}
+// {{{ procSnapshotFree()
+void procSnapshotFree()
+{
+  for (map<string, process *>::iterator i = gProcessList.begin(); i != gProcessList.end(); i++)
+  {
+    i->second->owner.clear();
+    delete i->second;
+  }
+  gProcessList.clear();
+  gCSnapshot = 0;
+}
+// }}}
+// {{{ startTime()
+string &startTime(const time_t CStartTime, string &strStartTime)
+{
+  strStartTime.clear();
+  if (CStartTime > 0)
+  {
+    stringstream ssStartTime;
+    struct tm *ptTime = localtime(&CStartTime);
+    ssStartTime << setw(4) << setfill('0') << (ptTime->tm_year + 1900) << '-';
+    ssStartTime << setw(2) << setfill('0') << (ptTime->tm_mon + 1) << '-';
+    ssStartTime << setw(2) << setfill('0') << ptTime->tm_mday << ' ';
+    ssStartTime << setw(2) << setfill('0') << ptTime->tm_hour << ':';
+    ssStartTime << setw(2) << setfill('0') << ptTime->tm_min << ' ';
+    ssStartTime << gstrTimezonePrefix << ((ptTime->tm_isdst)?'d':'s') << "t";
+    strStartTime = ssStartTime.str();
+  }
+
+  return strStartTime;
+}
+// }}}
+// {{{ sighandle()
+void sighandle(const int nSignal)
+{
+  stringstream ssCore;
+
+  sethandles(sigdummy);
+  if (nSignal != SIGINT && nSignal != SIGTERM)
   {
     ssCore << "gcore " << getpid() << " >/dev/null 2>&1";
     system(ssCore.str().c_str());
@@ -1013,3 +2278,71 @@ void sighandle(const int nSignal)
   exit(1);
 }
 // }}}
+// {{{ sslNewSession()
+int sslNewSession(SSL *ssl, SSL_SESSION *ptSession)
+{
+  int nReturn = 0;
+  endpoint *ptEndpoint = (endpoint *)SSL_get_app_data(ssl);
+
+  if (ptEndpoint != NULL)
+  {
+    if (ptEndpoint->ptSession != NULL)
+    {
+      SSL_SESSION_free(ptEndpoint->ptSession);
+    }
+    ptEndpoint->ptSession = ptSession;
+    nReturn = 1;
+  }
+
+  return nReturn;
+}
+// }}}
+// {{{ sslResume()
+SSL *sslResume(SSL_CTX *ctx, const int fdSocket, endpoint *ptEndpoint, string &strError)
+{
+  SSL *ssl = NULL;
+
+  if ((ssl = SSL_new(ctx)) != NULL)
+  {
+    if (SSL_set_fd(ssl, fdSocket) == 1)
+    {
+      int nReturn;
+      SSL_set_app_data(ssl, ptEndpoint);
+      if (ptEndpoint->ptSession != NULL)
+      {
+        SSL_set_session(ssl, ptEndpoint->ptSession);
+      }
+      if ((nReturn = SSL_connect(ssl)) != 1)
+      {
+        char szError[256];
+        ERR_error_string_n(ERR_get_error(), szError, sizeof(szError));
+        strError = (string)"SSL_connect() " + szError;
+        SSL_free(ssl);
+        ssl = NULL;
+        // The cached session is dropped in case it is what the server rejected.
+        if (ptEndpoint->ptSession != NULL)
+        {
+          SSL_SESSION_free(ptEndpoint->ptSession);
+          ptEndpoint->ptSession = NULL;
+        }
+      }
+    }
+    else
+    {
+      char szError[256];
+      ERR_error_string_n(ERR_get_error(), szError, sizeof(szError));
+      strError = (string)"SSL_set_fd() " + szError;
+      SSL_free(ssl);
+      ssl = NULL;
+    }
+  }
+  else
+  {
+    char szError[256];
+    ERR_error_string_n(ERR_get_error(), szError, sizeof(szError));
+    strError = (string)"SSL_new() " + szError;
+  }
+
+  return ssl;
+}
+// }}}
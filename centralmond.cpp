@@ -25,26 +25,55 @@
 * Analyzes and acts upon system information.
 */
 // {{{ includes
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <cerrno>
+#include <climits>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <dirent.h>
 #include <fcntl.h>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <map>
+#include <mutex>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#include <openssl/rand.h>
+#include <openssl/x509v3.h>
 #include <poll.h>
+#include <set>
+#include <shared_mutex>
 #include <string>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
+#if defined(LINUX) && !defined(NO_EPOLL)
+#include <sys/epoll.h>
+#endif
 #include <sys/utsname.h>
 #include <sys/wait.h>
+#include <thread>
+#include <vector>
 using namespace std;
 #include <Central>
 #include <Json>
@@ -64,28 +93,261 @@ using namespace common;
 /*! \def mUSAGE(A)
 * \brief Prints the usage statement.
 */
-#define mUSAGE(A) cout << endl << "Usage:  "<< A << " [options]"  << endl << endl << " --central=CENTRAL" << endl << "     Provides the path to the central file." << endl << endl << " --certificate=CERTIFICATE" << endl << "     Provides the path to the certificate file." << endl << endl << " -c CREDENTIALS, --cred=CREDENTIALS" << endl << "     Provides the path to the credentials file." << endl << endl << " -d, --daemon" << endl << "     Turns the process into a daemon." << endl << endl << " -e EMAIL, --email=EMAIL" << endl << "     Provides the email address for default notifications." << endl << endl << " -h, --help" << endl << "     Displays this usage screen." << endl << endl << " --private-key=PRIVATE_KEY" << endl << "     Provides the path to the private key file." << endl << endl << " -r ROOM, --room=ROOM" << endl << "     Provides the chat room." << endl << endl << " -v, --version" << endl << "     Displays the current version of this software." << endl << endl
+#define mUSAGE(A) cout << endl << "Usage:  "<< A << " [options]"  << endl << endl << " --central=CENTRAL" << endl << "     Provides the path to the central file." << endl << endl << " --certificate=CERTIFICATE" << endl << "     Provides the path to the certificate file." << endl << endl << " --cluster=NODES" << endl << "     Provides the comma separated HOST:PORT nodes of the cluster, which must be listed in the same order on every node." << endl << endl << " -c CREDENTIALS, --cred=CREDENTIALS" << endl << "     Provides the path to the credentials file." << endl << endl << " -d, --daemon" << endl << "     Turns the process into a daemon." << endl << endl << " -e EMAIL, --email=EMAIL" << endl << "     Provides the email address for default notifications." << endl << endl << " -h, --help" << endl << "     Displays this usage screen." << endl << endl << " --history=HISTORY" << endl << "     Provides the directory for the metric history store." << endl << endl << " --history-retention=DAYS" << endl << "     Provides the number of days of history to keep (defaults to " << HISTORY_RETENTION << ")." << endl << endl << " --node=NODE" << endl << "     Provides the HOST:PORT of this node within the cluster." << endl << endl << " --peer-ca=PEER_CA" << endl << "     Provides the path to the CA file that issues the certificates of cluster nodes and regional relays, which is required to replicate or relay." << endl << endl << " --port=PORT" << endl << "     Provides the listening port (defaults to " << PORT << ")." << endl << endl << " --private-key=PRIVATE_KEY" << endl << "     Provides the path to the private key file." << endl << endl << " --relays=HOSTS" << endl << "     Provides the comma separated hosts whose certificates, issued by --peer-ca, may relay to this server." << endl << endl << " -r ROOM, --room=ROOM" << endl << "     Provides the chat room." << endl << endl << " --snapshot=SNAPSHOT" << endl << "     Provides the path to the state snapshot file used for warm restarts." << endl << endl << " --threads=THREADS" << endl << "     Provides the number of event loop threads (defaults to the number of processors)." << endl << endl << " --upstream=UPSTREAM" << endl << "     Provides the HOST:PORT of the central server this server relays to as a regional relay." << endl << endl << " -v, --version" << endl << "     Displays the current version of this software." << endl << endl
 /*! \def mVER_USAGE(A,B)
 * \brief Prints the version number.
 */
 #define mVER_USAGE(A,B) cout << endl << A << " Version: " << B << endl << endl
+/*! \def PROTOCOL
+* \brief Supplies the highest client protocol version understood.
+*/
+#define PROTOCOL 4
 /*! \def PORT
 * \brief Supplies the status communication port.
 */
 #define PORT "4636"
+/*! \def SCHEDULE_INTERVAL
+* \brief Supplies the number of seconds between client collections.
+*/
+#define SCHEDULE_INTERVAL 30
+/*! \def SNAPSHOT_ADOPT
+* \brief Supplies the number of seconds restored servers are kept waiting for their clients to reconnect.
+*/
+#define SNAPSHOT_ADOPT 900
+/*! \def SNAPSHOT_INTERVAL
+* \brief Supplies the maximum seconds between state snapshots.
+*/
+#define SNAPSHOT_INTERVAL 15
+/*! \def SNAPSHOT_MAGIC
+* \brief Identifies a state snapshot file and its format version.
+*/
+#define SNAPSHOT_MAGIC "CMS1"
+/*! \def SUBSCRIBE_BACKLOG
+* \brief Supplies the output buffer size above which a subscriber's queued events are held back.
+*/
+#define SUBSCRIBE_BACKLOG 262144
+/*! \def SUBSCRIBE_QUEUE
+* \brief Supplies the bytes of events queued for a subscriber before further events are dropped.
+*/
+#define SUBSCRIBE_QUEUE 1048576
+/*! \def SYNC_DELAY
+* \brief Supplies the maximum seconds a requested threshold synchronization is deferred.
+*/
+#define SYNC_DELAY 10
+/*! \def SYNC_QUIET
+* \brief Supplies the seconds without new requests before a threshold synchronization runs.
+*/
+#define SYNC_QUIET 2
+/*! \def TICKET_KEYS
+* \brief Supplies the number of previous rotation periods whose session tickets are still accepted.
+*/
+#define TICKET_KEYS 3
+/*! \def TICKET_MAGIC
+* \brief Identifies the session ticket key file format.
+*/
+#define TICKET_MAGIC "CMT1"
+/*! \def TICKET_ROTATE
+* \brief Supplies the seconds each session ticket key issues tickets before it is rotated.
+*/
+#define TICKET_ROTATE 3600
+/*! \def UPSTREAM_INTERVAL
+* \brief Supplies the seconds between aggregated state transfers to the upstream central server.
+*/
+#define UPSTREAM_INTERVAL 60
+/*! \def CHAIN_BLOCK
+* \brief Supplies the size of an output buffer block, which matches the largest TLS record.
+*/
+#define CHAIN_BLOCK 16384
+/*! \def CHAIN_VECTORS
+* \brief Supplies the maximum number of output buffer blocks handed to a single vectored write.
+*/
+#define CHAIN_VECTORS 64
+/*! \def CLUSTER_FULL
+* \brief Supplies the seconds between complete state transfers to the standby node.
+*/
+#define CLUSTER_FULL 60
+/*! \def CLUSTER_HANDBACK
+* \brief Supplies the seconds a returning node must be replicating before its servers are handed back.
+*/
+#define CLUSTER_HANDBACK 5
+/*! \def CLUSTER_INTERVAL
+* \brief Supplies the seconds between attempts to reach the standby node.
+*/
+#define CLUSTER_INTERVAL 1
+/*! \def CLUSTER_POINTS
+* \brief Supplies the number of points each node places on the consistent hash ring.
+*/
+#define CLUSTER_POINTS 64
+/*! \def CLUSTER_TIMEOUT
+* \brief Supplies the seconds without replication after which the standby takes over the servers of its node, and without a heartbeat answer after which a relay reconnects upstream.
+*/
+#define CLUSTER_TIMEOUT 10
+/*! \def FRAME_MARKER
+* \brief Supplies the byte that starts a protocol 2 binary frame in place of a text line.
+*/
+#define FRAME_MARKER '\x02'
+/*! \def FRAME_HEARTBEAT
+* \brief Identifies a replication frame that only signals the node is alive.
+*/
+#define FRAME_HEARTBEAT 3
+/*! \def FRAME_MAX
+* \brief Supplies the maximum payload size of a binary frame.
+*/
+#define FRAME_MAX 1048576
+/*! \def FRAME_PROCESS
+* \brief Identifies a binary frame holding a batch of process values.
+*/
+#define FRAME_PROCESS 2
+/*! \def FRAME_PROCESS_FIELDS
+* \brief Supplies the field mask of a complete process entry.
+*/
+#define FRAME_PROCESS_FIELDS 0x1ff
+/*! \def FRAME_REMOVE
+* \brief Identifies a relay frame withdrawing a server whose client disconnected.
+*/
+#define FRAME_REMOVE 5
+/*! \def FRAME_RECORD
+* \brief Identifies a replication frame holding the state of one server.
+*/
+#define FRAME_RECORD 4
+/*! \def FRAME_SYSTEM
+* \brief Identifies a binary frame holding system values.
+*/
+#define FRAME_SYSTEM 1
+/*! \def FRAME_SYSTEM_FIELDS
+* \brief Supplies the field mask of a complete system record.
+*/
+#define FRAME_SYSTEM_FIELDS 0x1fff
+/*! \def HANDSHAKE_SOURCE
+* \brief Supplies the number of handshakes allowed in progress from one source address.
+*/
+#define HANDSHAKE_SOURCE 8
+/*! \def HANDSHAKE_THREADS
+* \brief Supplies the number of handshake threads.
+*/
+#define HANDSHAKE_THREADS 2
+/*! \def HANDSHAKE_TIMEOUT
+* \brief Supplies the seconds a connection has to complete its handshake.
+*/
+#define HANDSHAKE_TIMEOUT 10
+/*! \def HISTORY_BLOCK
+* \brief Supplies the number of samples a history series buffers before it is written as a block.
+*/
+#define HISTORY_BLOCK 120
+/*! \def HISTORY_BUCKETS
+* \brief Supplies the maximum number of points a history query answers with.
+*/
+#define HISTORY_BUCKETS 10000
+/*! \def HISTORY_FLUSH
+* \brief Supplies the maximum seconds a history sample stays buffered in memory.
+*/
+#define HISTORY_FLUSH 600
+/*! \def HISTORY_POINTS
+* \brief Supplies the number of points a history query is downsampled to when no step is given.
+*/
+#define HISTORY_POINTS 500
+/*! \def HISTORY_RETENTION
+* \brief Supplies the default number of days of history segments kept on disk.
+*/
+#define HISTORY_RETENTION 90
+/*! \def HISTORY_THREADS
+* \brief Supplies the number of threads answering history queries.
+*/
+#define HISTORY_THREADS 2
+/*! \def ROLLUP_TIERS
+* \brief Supplies the number of in-memory history rollup granularities.
+*/
+#define ROLLUP_TIERS 3
+/*! \def MAX_EVENTS
+* \brief Supplies the maximum events returned by a single event loop wait.
+*/
+#define MAX_EVENTS 256
+/*! \def NOTIFY_ATTEMPTS
+* \brief Supplies the number of delivery attempts made for a notification.
+*/
+#define NOTIFY_ATTEMPTS 5
+/*! \def NOTIFY_BACKOFF
+* \brief Supplies the initial retry delay in seconds, which doubles with each failed attempt.
+*/
+#define NOTIFY_BACKOFF 15
+/*! \def NOTIFY_QUEUE
+* \brief Supplies the maximum number of queued notifications.
+*/
+#define NOTIFY_QUEUE 4096
+/*! \def NOTIFY_THREADS
+* \brief Supplies the number of notification worker threads.
+*/
+#define NOTIFY_THREADS 2
+#if defined(LINUX) && !defined(NO_EPOLL)
+/*! \def USE_EPOLL
+* \brief Selects the edge-triggered epoll event loop (define NO_EPOLL to build with poll instead).
+*/
+#define USE_EPOLL
+#endif
 // }}}
 // {{{ structs
+struct historyquery;
+struct overall;
+struct shard;
+struct subscriber;
+struct chain
+{
+  size_t unOffset;
+  size_t unSize;
+  list<string> blockList;
+};
 struct connection
 {
   bool bClient;
   bool bClose;
+  bool bDrain;
+  bool bRelay;
+  bool bReplica;
   int fdData;
-  string strBuffer[2];
+  int nProtocol;
+  short sWait;
+  size_t unBuffer;
+  chain outBuffer;
+  string strBuffer;
   string strServer;
+  string strSource;
+  unsigned long long ullSchedule;
   time_t CStartTime;
   time_t CEndTime;
   SSL *ssl;
   common_socket_type eSocketType;
+  list<connection *>::iterator iterBridge;
+  historyquery *ptHistory;
+  overall *ptOverall;
+  subscriber *ptSubscriber;
+  set<string> relayList;
+  vector<string> nameList;
+};
+struct contact
+{
+  string strEmail;
+  string strUserID;
+};
+struct field
+{
+  const char *pData;
+  size_t unSize;
+};
+struct history
+{
+  vector<time_t> timeList;
+  vector<unsigned long long> valueList;
+};
+struct historyquery
+{
+  time_t CFrom;
+  time_t CStep;
+  time_t CTo;
+  string strMetric;
+  string strResponse;
+  string strServer;
+  connection *ptConnection;
+  shard *ptShard;
 };
 struct message
 {
@@ -96,6 +358,32 @@ struct message
   string strMessage;
   string strType;
 };
+struct notification
+{
+  bool bPage;
+  unsigned int unAttempts;
+  unsigned int unCount;
+  time_t CNext;
+  time_t CQueued;
+  string strMessage;
+  string strProcess;
+  string strRecipient;
+  string strServer;
+  string strSubject;
+  string strType;
+};
+struct notifystats
+{
+  size_t unMaxDepth;
+  unsigned long long ullCoalesced;
+  unsigned long long ullDelivered;
+  unsigned long long ullDropped;
+  unsigned long long ullFailed;
+  unsigned long long ullLatency;
+  unsigned long long ullMaxLatency;
+  unsigned long long ullQueued;
+  unsigned long long ullRetried;
+};
 struct process
 {
   bool bChecking;
@@ -128,10 +416,14 @@ struct process
 };
 struct overall
 {
+  bool bDirty;
   bool bHaveThresholds;
   bool bHaveValues;
   bool bPage;
   bool bPrevPage;
+  bool bReplicate;
+  bool bUpstream;
+  bool bUpstreamAlarm;
   int nProcessors;
   unsigned int unCpuSpeed;
   unsigned int unCpuUsage;
@@ -146,37 +438,396 @@ struct overall
   unsigned long ulMainUsed;
   unsigned long ulSwapTotal;
   unsigned long ulSwapUsed;
+  unsigned long long ullSchedule;
+  time_t CReplicated;
   map<string, unsigned int> partition;
   string strCpuProcessUsage;
+  string strLine;
   string strOperatingSystem;
   string strPartitions;
   string strSystemRelease;
   stringstream ssAlarms;
   stringstream ssPrevAlarms;
   map<string, process *> processList;
+  mutex mutexOverall;
+};
+struct rollup
+{
+  unsigned int unBucket;
+  unsigned int unCount;
+  unsigned long long ullMaximum;
+  unsigned long long ullMinimum;
+  unsigned long long ullSum;
+};
+struct shard
+{
+  int fdEpoll;
+  int fdWake[2];
+  size_t unIndex;
+  list<connection *> queue;
+  list<historyquery *> historyList;
+  mutex mutexQueue;
+  thread *pThread;
+};
+struct subscriber
+{
+  bool bAlarms;
+  size_t unQueued;
+  unsigned long long ullDropped;
+  connection *ptConnection;
+  shard *ptShard;
+  list<string> filterList;
+  list<string> outbox;
+  mutex mutexOutbox;
+};
+struct summary
+{
+  time_t CLast;
+  time_t CSince;
+  vector<rollup> rollupList;
+};
+struct ticketkey
+{
+  long long llPeriod;
+  unsigned char ucAes[32];
+  unsigned char ucHmac[32];
+  unsigned char ucName[16];
 };
 // }}}
 // {{{ global variables
+static atomic<bool> gbShutdown(false); //!< Global shutdown variable.
+static atomic<time_t> gCPeerSeen(0); //!< Contains when replication was last received from the node this node stands by for.
+static atomic<time_t> gCPeerSince(0); //!< Contains when the current run of replication from that node began.
+static atomic<size_t> gunSubscribers(0); //!< Contains the number of subscribers so publishing is skipped when there are none.
+static atomic<unsigned long long> gullFleetChanges(1); //!< Counts changes to the servers reported by the fleet system response.
+static atomic<unsigned long long> gullHandshakeFailed(0); //!< Contains the number of handshakes that failed or timed out.
+static atomic<unsigned long long> gullHandshakeLimited(0); //!< Contains the number of connections refused for exceeding the per source handshake limit.
+static atomic<unsigned long long> gullHandshakes(0); //!< Contains the number of completed TLS handshakes.
+static atomic<unsigned long long> gullResumed(0); //!< Contains the number of TLS handshakes that resumed a session.
 static bool gbDaemon = false; //!< Global daemon variable.
-static bool gbShutdown = false; //!< Global shutdown variable.
+static bool gbSnapshot = false; //!< Contains whether alarm state changed since the last snapshot.
+static bool gbUpstream = false; //!< Contains whether an alarm transitioned since the last upstream transfer.
+static condition_variable gHistoryCondition; //!< Wakes the history writer thread.
+static condition_variable gHistoryQueryCondition; //!< Wakes the history query threads.
+static condition_variable gNotificationCondition; //!< Wakes the notification worker threads.
+static condition_variable gSnapshotCondition; //!< Wakes the snapshot thread.
+static condition_variable gSyncCondition; //!< Wakes the synchronization thread.
+static condition_variable gUpstreamCondition; //!< Wakes the upstream relay thread.
 static int gfdStatus; //!< Global socket descriptor.
+static list<notification *> gNotificationQueue; //!< Contains the queued notifications.
+static list<subscriber *> gSubscriberList; //!< Contains the streaming subscribers.
+static list<ticketkey> gTicketKeyList; //!< Contains the session ticket keys of the current and accepted previous periods, newest first.
 static list<message *> gMessageList; //!< Contains the message list.
+static map<string, list<contact> > gServerContactList; //!< Contains the server contacts by server.
+static map<string, map<string, list<contact> > > gApplicationContactList; //!< Contains the application contacts by server and daemon.
+static map<string, notification *> gNotificationPending; //!< Indexes the queued deliveries by recipient for coalescing.
+static list<historyquery *> gHistoryQueryList; //!< Contains the history queries awaiting a history query thread.
+static map<string, map<string, history> > gHistoryList; //!< Contains the buffered history samples indexed by server and metric.
+static map<string, map<string, summary> > gSummaryList; //!< Contains the history rollups indexed by server and metric.
 static map<string, overall *> gOverallList; //!< Contains the overall list.
+static map<string, size_t> gHandshakeSourceList; //!< Contains the handshakes in progress indexed by source address.
+static map<string, overall *> gRestoreList; //!< Contains the restored servers awaiting their clients, guarded by gOverallMutex.
+static map<string, overall *> gStandbyList; //!< Contains the servers replicated from the node this node stands by for, guarded by gOverallMutex.
+static map<unsigned long long, size_t> gClusterRing; //!< Contains the consistent hash ring of node indexes.
+static mutex gFleetMutex; //!< Guards the cached fleet system response.
+static mutex gHandshakeMutex; //!< Guards the handshakes in progress by source address.
+static mutex gHistoryMutex; //!< Guards the buffered history samples.
+static mutex gHistoryQueryMutex; //!< Guards the pending history queries, the answered queries of each event loop and the connection of each query.
+static mutex gHistorySegmentMutex; //!< Serializes history segment writes against the start of queries.
+static mutex gMalformedMutex; //!< Guards the malformed reply statistics.
+static mutex gMessageMutex; //!< Guards the message list.
+static mutex gNotificationMutex; //!< Guards the notification queue and statistics.
+static mutex gSnapshotMutex; //!< Guards the snapshot request flag.
+static mutex gSyncMutex; //!< Guards the synchronization request times.
+static mutex gTicketMutex; //!< Guards the session ticket keys.
+static mutex gUpstreamMutex; //!< Guards the upstream transfer request flag.
+static notifystats gNotificationStats = {0, 0, 0, 0, 0, 0, 0, 0, 0}; //!< Contains the notification statistics.
+static recursive_mutex gCentralMutex; //!< Serializes database use of the Central class.
+static recursive_mutex gDeliveryMutex; //!< Serializes deliveries through the Junction and Radial classes.
+static shared_timed_mutex gContactMutex; //!< Guards the contact index.
+static shared_timed_mutex gOverallMutex; //!< Guards membership of the overall list.
+static shared_timed_mutex gSubscriberMutex; //!< Guards membership of the subscriber list.
+static unsigned long long gullFleetVersion = 0; //!< Contains the change count the cached fleet system response reflects.
+static unsigned long long gullMalformed = 0; //!< Contains the number of malformed client replies.
+static size_t gunHistoryRetention = HISTORY_RETENTION; //!< Contains the number of days of history segments kept on disk.
+static size_t gunNode = 0; //!< Contains the index of this node within the cluster.
+static size_t gunThreads = 1; //!< Contains the number of event loop threads.
+static const size_t gunRollupSlots[ROLLUP_TIERS] = {120, 288, 336}; //!< Contains the ring size of each rollup tier (two hours, one day and two weeks).
+static const time_t gCRollupWidth[ROLLUP_TIERS] = {60, 300, 3600}; //!< Contains the bucket width in seconds of each rollup tier.
+static vector<string> gClusterList; //!< Contains the HOST:PORT nodes of the cluster.
+static vector<string> gRelayList; //!< Contains the hosts whose certificates may relay to this server.
+static vector<shard *> gHandshakeList; //!< Contains the handshake threads.
+static vector<shard *> gShardList; //!< Contains the event loop threads.
+static vector<thread *> gNotifierList; //!< Contains the notification worker threads.
 static string gstrApplication = "Central Monitor"; //!< Global application name.
 static string gstrEmail; //!< Global notification email address.
+static string gstrFleet; //!< Contains the cached fleet system response.
+static string gstrHistory; //!< Contains the history store directory.
+static string gstrMalformed; //!< Contains the most recent malformed client reply error.
+static string gstrPeerCa; //!< Contains the path to the CA file that issues the certificates of cluster nodes and regional relays.
+static string gstrPort = PORT; //!< Contains the listening port.
 static string gstrRoom; //!< Global chat room.
+static string gstrSnapshot; //!< Contains the state snapshot path.
+static string gstrTickets; //!< Contains the session ticket key file path, which is kept beside the state snapshot.
 static string gstrTimezonePrefix = "c"; //!< Contains the local timezone.
+static string gstrUpstream; //!< Contains the HOST:PORT of the upstream central server when running as a relay.
+static atomic<time_t> gCRestore(0); //!< Contains the time servers were last restored from the snapshot or handed back by the standby node.
+static time_t gCSyncFirst = 0; //!< Contains the time of the first pending synchronization request.
+static time_t gCSyncLast = 0; //!< Contains the time of the latest pending synchronization request.
 static Central *gpCentral = NULL; //!< Contains the Central class.
 static Radial *gpRadial = NULL; //!< Contains the Radial class.
 // }}}
 // {{{ prototypes
-/*! \fn bool chat(const string strMessage, string &strError)
-* \brief Sends a chat message to the Bridge.
-* \param strMessage Contains the message.
+/*! \fn void append(chain &outBuffer, const char *pData, size_t unSize)
+* \brief Appends data to a chained output buffer without moving what is already queued.
+* \param outBuffer Contains the output buffer.
+* \param pData Contains the data.
+* \param unSize Contains the data size.
+*/
+void append(chain &outBuffer, const char *pData, size_t unSize);
+/*! \fn void append(chain &outBuffer, const string &strData)
+* \brief Appends a string to a chained output buffer.
+* \param outBuffer Contains the output buffer.
+* \param strData Contains the data.
+*/
+void append(chain &outBuffer, const string &strData);
+/*! \fn void appendString(string &strBuffer, const string &strValue)
+* \brief Appends a varint length prefixed string.
+* \param strBuffer Contains the buffer.
+* \param strValue Contains the string.
+*/
+void appendString(string &strBuffer, const string &strValue);
+/*! \fn void appendVarint(string &strBuffer, unsigned long long ullValue)
+* \brief Appends a base 128 varint.
+* \param strBuffer Contains the buffer.
+* \param ullValue Contains the value.
+*/
+void appendVarint(string &strBuffer, unsigned long long ullValue);
+/*! \fn bool clusterAccepts(const string &strServer)
+* \brief Determines whether this node serves a server.
+*
+* A node serves the servers it owns on the hash ring, and the servers of the
+* node it stands by for once that node has stopped replicating.
+* \param strServer Contains the server.
+* \return Returns a boolean true/false value.
+*/
+bool clusterAccepts(const string &strServer);
+/*! \fn unsigned long long clusterHash(const string &strValue)
+* \brief Hashes a value onto the ring identically on every node.
+* \param strValue Contains the value.
+* \return Returns the 64-bit FNV-1a hash.
+*/
+unsigned long long clusterHash(const string &strValue);
+/*! \fn size_t clusterOwner(const string &strServer)
+* \brief Determines the node that owns a server on the hash ring.
+* \param strServer Contains the server.
+* \return Returns the node index.
+*/
+size_t clusterOwner(const string &strServer);
+/*! \fn string clusterRedirect(const string &strServer)
+* \brief Builds the redirect line sending a client to its owning node, followed by that node's standby.
+* \param strServer Contains the server.
+* \return Returns the line.
+*/
+string clusterRedirect(const string &strServer);
+/*! \fn void consume(chain &outBuffer, size_t unSize)
+* \brief Releases written data from the front of a chained output buffer.
+* \param outBuffer Contains the output buffer.
+* \param unSize Contains the number of written bytes.
+*/
+void consume(chain &outBuffer, size_t unSize);
+/*! \fn bool decodeProcess(process *ptProcess, const field *ptField, string &strError)
+* \brief Decodes the fields of a process reply into a process.
+*
+* The process is left untouched when any field is malformed.
+* \param ptProcess Contains the process.
+* \param ptField Contains the thirteen reply fields.
+* \param strError Contains the returned error.
+* \return Returns a boolean true/false value.
+*/
+bool decodeProcess(process *ptProcess, const field *ptField, string &strError);
+/*! \fn bool decodeSystem(overall *ptOverall, const field *ptField, string &strError)
+* \brief Decodes the fields of a system reply into the server values.
+*
+* The server values are left untouched when any field is malformed.
+* \param ptOverall Contains the server values.
+* \param ptField Contains the thirteen reply fields.
+* \param strError Contains the returned error.
+* \return Returns a boolean true/false value.
+*/
+bool decodeSystem(overall *ptOverall, const field *ptField, string &strError);
+/*! \fn bool deliver(notification *ptNotification, string &strError)
+* \brief Makes a single delivery attempt for a chat, email or page notification.
+* \param ptNotification Contains the notification.
 * \param strError Contains the returned error.
 * \return Returns a boolean true/false value.
 */
-bool chat(const string strMessage, string &strError);
+bool deliver(notification *ptNotification, string &strError);
+/*! \fn bool enqueue(notification *ptNotification)
+* \brief Queues a notification for the worker threads.
+*
+* An email or page headed to a recipient that already has one waiting is
+* folded into the waiting one.  The notification is dropped when the
+* queue is full.  Ownership of the notification passes to the queue.
+* \param ptNotification Contains the notification.
+* \return Returns false when the notification was dropped.
+*/
+bool enqueue(notification *ptNotification);
+/*! \fn void handoff(shard *ptShard, connection *ptConnection)
+* \brief Queues a connection onto an event loop thread.
+* \param ptShard Contains the event loop.
+* \param ptConnection Contains the connection.
+*/
+void handoff(shard *ptShard, connection *ptConnection);
+/*! \fn int handshake(SSL_CTX *ctx, connection *ptConnection)
+* \brief Advances the non-blocking socket type detection and TLS handshake of a new connection.
+* \param ctx Contains the SSL context.
+* \param ptConnection Contains the connection, whose sWait is set to the readiness the handshake waits for.
+* \return Returns 1 when established, 0 while in progress or -1 on failure.
+*/
+int handshake(SSL_CTX *ctx, connection *ptConnection);
+/*! \fn void handshaker(shard *ptStage, SSL_CTX *ctx)
+* \brief Runs a handshake thread.
+*
+* New connections are established here and only then handed to an event
+* loop, so a burst of handshakes never delays established clients.
+* \param ptStage Contains the handshake stage.
+* \param ctx Contains the SSL context.
+*/
+void handshaker(shard *ptStage, SSL_CTX *ctx);
+/*! \fn void historian()
+* \brief Writes buffered history samples to the daily segment files.
+*
+* A series is written once it holds HISTORY_BLOCK samples or its oldest
+* sample is HISTORY_FLUSH seconds old, and everything is written at shutdown.
+* Once a day the segments older than the retention period are removed.
+*/
+void historian();
+/*! \fn void historyAnswer(historyquery *ptQuery)
+* \brief Answers a history query from the rollups or, failing that, the segments.
+*
+* The step is widened when needed so the answer holds at most
+* HISTORY_BUCKETS points.
+* \param ptQuery Contains the query, whose response is filled in.
+*/
+void historyAnswer(historyquery *ptQuery);
+/*! \fn void historyCancel(connection *ptConnection)
+* \brief Detaches a closing connection from its pending history query so the query is discarded once answered.
+* \param ptConnection Contains the connection.
+*/
+void historyCancel(connection *ptConnection);
+/*! \fn void historyDecode(field tBlock, const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, list<pair<time_t, unsigned long long> > &pointList)
+* \brief Decodes the samples of a segment block that fall within a time range.
+* \param tBlock Contains the block.
+* \param strServer Contains the server.
+* \param strMetric Contains the metric.
+* \param CFrom Contains the start of the range.
+* \param CTo Contains the end of the range.
+* \param pointList Returns the matching samples.
+*/
+void historyDecode(field tBlock, const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, list<pair<time_t, unsigned long long> > &pointList);
+/*! \fn void historyEncode(string &strSegment, const string &strServer, const string &strMetric, const history &tHistory, const size_t unBegin, const size_t unEnd)
+* \brief Appends a length prefixed columnar segment block.
+*
+* The block holds the server and metric names, the sample count, the
+* timestamps as a first value followed by zigzag varint delta-of-deltas and
+* the values as a first value followed by varints of each XOR with its
+* predecessor.
+* \param strSegment Contains the segment data.
+* \param strServer Contains the server.
+* \param strMetric Contains the metric.
+* \param tHistory Contains the samples.
+* \param unBegin Contains the first sample.
+* \param unEnd Contains one past the last sample.
+*/
+void historyEncode(string &strSegment, const string &strServer, const string &strMetric, const history &tHistory, const size_t unBegin, const size_t unEnd);
+/*! \fn void historyPrune(const time_t CTime)
+* \brief Removes the history segments older than the retention period.
+* \param CTime Contains the current time.
+*/
+void historyPrune(const time_t CTime);
+/*! \fn void historyQuery(const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, list<pair<time_t, unsigned long long> > &pointList)
+* \brief Retrieves the stored and buffered samples of a metric within a time range.
+* \param strServer Contains the server.
+* \param strMetric Contains the metric.
+* \param CFrom Contains the start of the range.
+* \param CTo Contains the end of the range.
+* \param pointList Returns the samples.
+*/
+void historyQuery(const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, list<pair<time_t, unsigned long long> > &pointList);
+/*! \fn void historyRecord(const string &strServer, const list<pair<string, unsigned long long> > &metricList)
+* \brief Buffers the current value of each metric of a server.
+* \param strServer Contains the server.
+* \param metricList Contains the metric names and values.
+*/
+void historyRecord(const string &strServer, const list<pair<string, unsigned long long> > &metricList);
+/*! \fn void historyResponder()
+* \brief Runs a history query thread.
+*
+* Queries that the rollups cannot answer read segment files, so they are
+* answered here rather than on an event loop and the answer is handed back
+* to the event loop of the connection.
+*/
+void historyResponder();
+/*! \fn bool historyRollup(const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, const time_t CStep, map<time_t, rollup> &bucketList)
+* \brief Answers a history query from the coarsest rollup tier that satisfies the step.
+*
+* A tier qualifies when its width does not exceed the step, its ring
+* still reaches back to the start of the range and it was being fed at
+* that time.
+* \param strServer Contains the server.
+* \param strMetric Contains the metric.
+* \param CFrom Contains the start of the range.
+* \param CTo Contains the end of the range.
+* \param CStep Contains the step.
+* \param bucketList Returns the step buckets.
+* \return Returns false when no tier qualifies.
+*/
+bool historyRollup(const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, const time_t CStep, map<time_t, rollup> &bucketList);
+/*! \fn string historySegment(const time_t CTime, const string &strServer)
+* \brief Builds the path of the segment holding one day of samples for one server.
+*
+* Each day has its own directory with one segment per server, so a query
+* only reads the segments of the server it asks about.
+* \param CTime Contains a time within the day.
+* \param strServer Contains the server.
+* \return Returns the path.
+*/
+string historySegment(const time_t CTime, const string &strServer);
+/*! \fn void lines(shard *ptShard, connection *ptConnection, bool &bSync)
+* \brief Processes the complete lines waiting in the read buffer of a connection.
+*
+* Processing stops once a connection registers as a client owned by a
+* different event loop so that the owner handles the remaining lines.
+* \param ptShard Contains the event loop.
+* \param ptConnection Contains the connection.
+* \param bSync Returns true when thresholds should be synchronized.
+*/
+void lines(shard *ptShard, connection *ptConnection, bool &bSync);
+/*! \fn void loadContacts()
+* \brief Loads the server and application contact index from the database in bulk.
+*/
+void loadContacts();
+/*! \fn void lookupContacts(const string strServer, const string strProcess, const bool bApplication, list<string> &emailList, list<string> &pageList)
+* \brief Looks up the contacts of a server or application from the contact index.
+* \param strServer Contains the server name.
+* \param strProcess Contains the process name.
+* \param bApplication Contains whether to look up application contacts instead of server contacts.
+* \param emailList Returns the email addresses.
+* \param pageList Returns the pager user IDs.
+*/
+void lookupContacts(const string strServer, const string strProcess, const bool bApplication, list<string> &emailList, list<string> &pageList);
+/*! \fn void malformed(connection *ptConnection, const string &strAction, const string &strError)
+* \brief Records a malformed client reply.
+* \param ptConnection Contains the client connection.
+* \param strAction Contains the reply type.
+* \param strError Contains the error.
+*/
+void malformed(connection *ptConnection, const string &strAction, const string &strError);
+/*! \fn void notifier()
+* \brief Runs a notification worker thread.
+*/
+void notifier();
 /*! \fn bool notify(const string strMessage, string &strError)
 * \brief Notifies the email box.
 * \param strMessage Contains the message.
@@ -184,22 +835,382 @@ bool chat(const string strMessage, string &strError);
 * \return Returns a boolean true/false value.
 */
 bool notify(const string strMessage, string &strError);
-/*! \fn void notifyApplicationContact(const string strServer, const string strProcess)
-* \brief Notifies application contacts.
+/*! \fn void notifyApplicationContact(const string strServer, const string strProcess, process *ptProcess)
+* \brief Queues a notification for the application contacts.
 * \param strServer Contains the server name.
 * \param strProcess Contains the process name.
+* \param ptProcess Contains the process.
 */
-void notifyApplicationContact(const string strServer, const string strProcess);
-/*! \fn void notifyServerContact(const string strServer)
+void notifyApplicationContact(const string strServer, const string strProcess, process *ptProcess);
+/*! \fn void notifyServerContact(const string strServer, overall *ptOverall)
 * \param strServer Contains the server name.
-* \brief Notifies server contacts.
+* \param ptOverall Contains the server values.
+* \brief Queues a notification for the server contacts.
 */
-void notifyServerContact(const string strServer);
+void notifyServerContact(const string strServer, overall *ptOverall);
+/*! \fn bool parseNumber(const field &tField, unsigned long long &ullValue)
+* \brief Converts a field of decimal digits into a number.
+*
+* An empty field converts to zero, matching the historical atoi() decoding.
+* \param tField Contains the field.
+* \param ullValue Returns the number.
+* \return Returns false when the field holds a non-digit or overflows.
+*/
+bool parseNumber(const field &tField, unsigned long long &ullValue);
+/*! \fn bool peerAuthenticated(connection *ptConnection, const vector<string> &hostList)
+* \brief Determines whether a connection presented a certificate issued by --peer-ca for one of the given hosts.
+* \param ptConnection Contains the connection.
+* \param hostList Contains the hosts, one of which the certificate must name.
+* \return Returns a boolean true/false value.
+*/
+bool peerAuthenticated(connection *ptConnection, const vector<string> &hostList);
+/*! \fn int peerConnect(const string &strNode, SSL_CTX *ctx, SSL *&ssl)
+* \brief Connects to another central server for replication or relaying.
+*
+* Reads and writes on the socket time out after CLUSTER_TIMEOUT seconds so
+* that a stalled peer never wedges the calling thread.  The peer
+* certificate is verified against the host of strNode.
+* \param strNode Contains the HOST:PORT of the peer.
+* \param ctx Contains the client SSL context, or NULL to connect in the clear.
+* \param ssl Returns the SSL connection, or NULL when in the clear.
+* \return Returns the socket or -1 on failure.
+*/
+int peerConnect(const string &strNode, SSL_CTX *ctx, SSL *&ssl);
+/*! \fn string peerHost(const string &strNode)
+* \brief Extracts the host from a HOST:PORT or [HOST]:PORT peer.
+* \param strNode Contains the peer.
+* \return Returns the host.
+*/
+string peerHost(const string &strNode);
+/*! \fn int peerVerify(int nPreverify, X509_STORE_CTX *ptStore)
+* \brief Lets handshakes complete whatever certificate a client presents.
+*
+* The listener is shared with ordinary clients, so the verification result
+* is only recorded here and consulted by peerAuthenticated().
+* \param nPreverify Contains whether the certificate verified.
+* \param ptStore Contains the certificate store context.
+* \return Returns 1 to continue the handshake.
+*/
+int peerVerify(int nPreverify, X509_STORE_CTX *ptStore);
+/*! \fn bool peerWrite(const int fdSocket, SSL *ssl, const string &strBuffer)
+* \brief Writes a buffer to a peer in full.
+* \param fdSocket Contains the socket.
+* \param ssl Contains the SSL connection, or NULL when in the clear.
+* \param strBuffer Contains the buffer.
+* \return Returns a boolean true/false value.
+*/
+bool peerWrite(const int fdSocket, SSL *ssl, const string &strBuffer);
+/*! \fn void processAlarms(connection *ptConnection, const string &strProcess, process *ptProcess)
+* \brief Evaluates the alarms of a process after new values arrive.
+* \param ptConnection Contains the client connection.
+* \param strProcess Contains the process name.
+* \param ptProcess Contains the process.
+*/
+void processAlarms(connection *ptConnection, const string &strProcess, process *ptProcess);
+/*! \fn string processLine(process *ptProcess)
+* \brief Builds the process query response line.
+* \param ptProcess Contains the process.
+* \return Returns the line without its newline.
+*/
+string processLine(process *ptProcess);
+/*! \fn void publish(const string &strServer, const string &strProcess, const string &strLine, const bool bAlarm)
+* \brief Queues an event for every subscriber whose filter matches.
+* \param strServer Contains the server.
+* \param strProcess Contains the process, or is empty for server events.
+* \param strLine Contains the event line without its newline.
+* \param bAlarm Contains whether the event is an alarm transition.
+*/
+void publish(const string &strServer, const string &strProcess, const string &strLine, const bool bAlarm);
+/*! \fn void reactor(shard *ptShard, SSL_CTX *ctx)
+* \brief Runs an event loop thread over its shard of connections.
+* \param ptShard Contains the event loop.
+* \param ctx Contains the SSL context.
+*/
+void reactor(shard *ptShard, SSL_CTX *ctx);
+/*! \fn void readClient(connection *ptConnection, const string &strLine)
+* \brief Processes a line received from a client and evaluates its alarms.
+* \param ptConnection Contains the connection.
+* \param strLine Contains the line.
+*/
+void readClient(connection *ptConnection, const string &strLine);
+/*! \fn void readFrame(connection *ptConnection, field tPayload)
+* \brief Processes a protocol 2 binary frame received from a client.
+*
+* Frames carry varint encoded values.  Process names are interned per
+* connection:  an identifier equal to the size of the name table is
+* followed by the name it defines.  From protocol 3 each system record and
+* process entry leads with a field mask, and fields missing from the mask
+* keep their previous values.
+* \param ptConnection Contains the connection.
+* \param tPayload Contains the frame payload.
+*/
+void readFrame(connection *ptConnection, field tPayload);
+/*! \fn void readQuery(shard *ptShard, connection *ptConnection, const string &strLine, bool &bSync)
+* \brief Processes a line received from a non-client connection.
+* \param ptShard Contains the event loop.
+* \param ptConnection Contains the connection.
+* \param strLine Contains the line.
+* \param bSync Returns true when thresholds should be synchronized.
+*/
+void readQuery(shard *ptShard, connection *ptConnection, const string &strLine, bool &bSync);
+/*! \fn void readRelay(connection *ptConnection, field tPayload)
+* \brief Processes a frame received from a regional relay.
+*
+* Relayed servers are listed alongside directly connected ones, their alarm
+* transitions are published to subscribers and they are withdrawn when the
+* relay disconnects.  Alarms were already evaluated and paged by the relay.
+* Heartbeats are answered so the relay can detect a dead link.
+* \param ptConnection Contains the relay connection.
+* \param tPayload Contains the frame payload.
+*/
+void readRelay(connection *ptConnection, field tPayload);
+/*! \fn void readReplica(connection *ptConnection, field tPayload)
+* \brief Processes a replication frame received from the node this node stands by for.
+* \param ptConnection Contains the connection.
+* \param tPayload Contains the frame payload.
+*/
+void readReplica(connection *ptConnection, field tPayload);
+/*! \fn bool readSocket(connection *ptConnection)
+* \brief Reads everything currently available on a non-blocking connection.
+* \param ptConnection Contains the connection.
+* \return Returns false when the connection has been closed or has failed.
+*/
+bool readSocket(connection *ptConnection);
+/*! \fn bool readString(field &tData, field &tString)
+* \brief Reads a varint length prefixed string from binary data.
+* \param tData Contains the data, which is advanced past the string.
+* \param tString Returns the string.
+* \return Returns false when the data is truncated.
+*/
+bool readString(field &tData, field &tString);
+/*! \fn bool readVarint(field &tData, unsigned long long &ullValue)
+* \brief Reads a base 128 varint from binary data.
+* \param tData Contains the data, which is advanced past the varint.
+* \param ullValue Returns the value.
+* \return Returns false when the data is truncated or the varint is too long.
+*/
+bool readVarint(field &tData, unsigned long long &ullValue);
+/*! \fn bool relayDecode(field &tData, string &strServer, overall *&ptOverall)
+* \brief Decodes the summary of one server written by relayEncode().
+* \param tData Contains the data, which is advanced past the server.
+* \param strServer Returns the server.
+* \param ptOverall Returns the newly allocated server values, or NULL on failure.
+* \return Returns false when the data is malformed.
+*/
+bool relayDecode(field &tData, string &strServer, overall *&ptOverall);
+/*! \fn void relayEncode(string &strBuffer, const string &strServer, overall *ptOverall)
+* \brief Encodes the summary of one server for the upstream central server.
+*
+* Only the values reported by the system and process query lines are sent
+* along with the alarms, since thresholds and paging stay with the relay.
+* The overall mutex of the server must be held.
+* \param strBuffer Returns the appended data.
+* \param strServer Contains the server.
+* \param ptOverall Contains the server values.
+*/
+void relayEncode(string &strBuffer, const string &strServer, overall *ptOverall);
+/*! \fn void replicator(SSL_CTX *ctx)
+* \brief Streams the state of the servers this node owns to its standby node.
+*
+* Changed servers are sent every second alongside a heartbeat, and every
+* server every CLUSTER_FULL seconds.  Servers the standby served while this
+* node was away are received back and adopted when their clients return.
+* \param ctx Contains the client SSL context, or NULL to replicate in the clear.
+*/
+void replicator(SSL_CTX *ctx);
+/*! \fn void requestSnapshot()
+* \brief Asks the snapshot thread to write the state snapshot promptly.
+*/
+void requestSnapshot();
+/*! \fn void requestSync()
+* \brief Requests a debounced threshold synchronization.
+*/
+void requestSync();
+/*! \fn void requestUpstream()
+* \brief Asks the upstream relay thread to forward alarm transitions promptly.
+*/
+void requestUpstream();
+/*! \fn void restoreExpire()
+* \brief Discards the restored and handed back servers whose clients have not returned within SNAPSHOT_ADOPT seconds.
+*
+* Called by the snapshot thread and by the replication thread, so it runs
+* whenever either can fill gRestoreList.
+*/
+void restoreExpire();
+/*! \fn void resolve(notification *ptNotification)
+* \brief Resolves the contacts of a server or application alarm and queues their deliveries.
+* \param ptNotification Contains the alarm.
+*/
+void resolve(notification *ptNotification);
+/*! \fn void service(shard *ptShard, connection *ptConnection, SSL_CTX *ctx, const bool bRead, const bool bWrite, bool &bSync)
+* \brief Services the read and write readiness of a connection.
+* \param ptShard Contains the event loop.
+* \param ptConnection Contains the connection.
+* \param ctx Contains the SSL context.
+* \param bRead Contains whether the connection is readable.
+* \param bWrite Contains whether the connection is writable.
+* \param bSync Returns true when thresholds should be synchronized.
+*/
+void service(shard *ptShard, connection *ptConnection, SSL_CTX *ctx, const bool bRead, const bool bWrite, bool &bSync);
+/*! \fn size_t shardIndex(const string strServer)
+* \brief Determines the event loop that owns a server.
+* \param strServer Contains the server name.
+* \return Returns the event loop index.
+*/
+size_t shardIndex(const string strServer);
 /*! \fn void sighandle(const int nSignal)
 * \brief Establishes signal handling for the application.
+*
+* SIGINT and SIGTERM only request a shutdown, which main() carries out so
+* that the final snapshot is written and buffered history is flushed.  Any
+* other signal exits immediately.
 * \param nSignal Contains the caught signal.
 */
 void sighandle(const int nSignal);
+/*! \fn bool snapshotDecode(field &tData, string &strServer, overall *&ptOverall)
+* \brief Decodes the state of one server written by snapshotEncode().
+* \param tData Contains the encoded data, which is advanced past the server.
+* \param strServer Returns the server.
+* \param ptOverall Returns the newly allocated server state, or NULL on failure.
+* \return Returns a boolean true/false value.
+*/
+bool snapshotDecode(field &tData, string &strServer, overall *&ptOverall);
+/*! \fn void snapshotEncode(string &strBuffer, const string &strServer, overall *ptOverall)
+* \brief Encodes the thresholds, values and alarm state of one server.
+*
+* Used by the state snapshot, cluster replication and relaying.  The caller holds
+* the server's mutexOverall.
+* \param strBuffer Contains the buffer that is appended to.
+* \param strServer Contains the server.
+* \param ptOverall Contains the server state.
+*/
+void snapshotEncode(string &strBuffer, const string &strServer, overall *ptOverall);
+/*! \fn bool snapshotRead(string &strError)
+* \brief Restores servers, alarm state and messages from the state snapshot.
+*
+* Restored servers wait in gRestoreList until their clients register again
+* so that alarms which already paged are not paged a second time.
+* \param strError Returns the error message.
+* \return Returns a boolean true/false value.
+*/
+bool snapshotRead(string &strError);
+/*! \fn bool snapshotWrite(string &strError)
+* \brief Writes servers, alarm state and messages to the state snapshot.
+*
+* The snapshot is copied into a memory-mapped temporary file which
+* replaces the previous snapshot once it is synced.
+* \param strError Returns the error message.
+* \return Returns a boolean true/false value.
+*/
+bool snapshotWrite(string &strError);
+/*! \fn void snapshotter()
+* \brief Runs the snapshot thread which writes the state snapshot periodically, on alarm changes and at shutdown.
+*/
+void snapshotter();
+/*! \fn void sync()
+* \brief Synchronizes the server and process thresholds from the database.
+*
+* Thresholds for the whole fleet are fetched with two set-based queries and
+* only the servers and processes whose thresholds changed are updated.
+*/
+void sync();
+/*! \fn void syncer()
+* \brief Runs the synchronization thread which coalesces bursts of synchronization requests.
+*/
+void syncer();
+/*! \fn const string &systemLine(const string &strServer, overall *ptOverall)
+* \brief Retrieves the cached system query line of a server, rebuilding it after new values arrive.
+*
+* The overall mutex of the server must be held.
+* \param strServer Contains the server.
+* \param ptOverall Contains the server values.
+* \return Returns the line without its trailing newline.
+*/
+const string &systemLine(const string &strServer, overall *ptOverall);
+/*! \fn void systemAlarms(connection *ptConnection)
+* \brief Evaluates the server alarms after new system values arrive.
+* \param ptConnection Contains the client connection.
+*/
+void systemAlarms(connection *ptConnection);
+/*! \fn int ticketCallback(SSL *ssl, unsigned char *pucName, unsigned char *pucIv, EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int nEncrypt)
+* \brief Supplies the session ticket keys to OpenSSL.
+*
+* Tickets are issued under the key of the current rotation period and
+* accepted under the keys of the previous TICKET_KEYS periods.  Before
+* OpenSSL 3.0 the MAC context is an HMAC_CTX.
+* \param ssl Contains the SSL connection.
+* \param pucName Contains the key name.
+* \param pucIv Contains the initialization vector.
+* \param ctx Contains the cipher context.
+* \param hctx Contains the MAC context.
+* \param nEncrypt Contains whether a ticket is being issued.
+* \return Returns 1 to use the key, 2 to use the key and issue a fresh ticket, 0 when the key is unknown, or -1 on failure.
+*/
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int ticketCallback(SSL *ssl, unsigned char *pucName, unsigned char *pucIv, EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int nEncrypt);
+#else
+int ticketCallback(SSL *ssl, unsigned char *pucName, unsigned char *pucIv, EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int nEncrypt);
+#endif
+/*! \fn bool ticketMac(EVP_MAC_CTX *hctx, const ticketkey &tKey)
+* \brief Keys the ticket MAC context with HMAC-SHA256.
+*
+* Before OpenSSL 3.0 the MAC context is an HMAC_CTX.
+* \param hctx Contains the MAC context.
+* \param tKey Contains the key.
+* \return Returns a boolean true/false value.
+*/
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+bool ticketMac(EVP_MAC_CTX *hctx, const ticketkey &tKey);
+#else
+bool ticketMac(HMAC_CTX *hctx, const ticketkey &tKey);
+#endif
+/*! \fn void ticketRead()
+* \brief Restores the session ticket keys still in use from the ticket key file.
+*/
+void ticketRead();
+/*! \fn bool ticketRotate(const long long llPeriod)
+* \brief Generates a random key for a new rotation period and discards expired keys.
+*
+* Keys are never derived from anything long lived, so a key that has been
+* discarded cannot be recomputed and tickets issued under it stay sealed.
+* The caller holds gTicketMutex.
+* \param llPeriod Contains the current rotation period.
+* \return Returns false when no key could be generated.
+*/
+bool ticketRotate(const long long llPeriod);
+/*! \fn void ticketWrite()
+* \brief Writes the session ticket keys still in use to the ticket key file, readable only by the owner.
+*
+* The caller holds gTicketMutex.
+*/
+void ticketWrite();
+/*! \fn size_t tokenize(const char *pData, const size_t unSize, const char cDelimiter, field *ptField, const size_t unFields)
+* \brief Splits data into delimited fields in a single pass without copying.
+* \param pData Contains the data.
+* \param unSize Contains the data size.
+* \param cDelimiter Contains the delimiter.
+* \param ptField Returns the fields, with missing fields left empty.
+* \param unFields Contains the number of fields wanted.
+* \return Returns the number of fields found up to unFields.
+*/
+size_t tokenize(const char *pData, const size_t unSize, const char cDelimiter, field *ptField, const size_t unFields);
+/*! \fn void upstream(SSL_CTX *ctx)
+* \brief Relays the servers of this regional relay to the upstream central server over one connection.
+*
+* Each server is sent at most once every UPSTREAM_INTERVAL seconds as a summary
+* of its system and process query values, alarm transitions are sent as soon
+* as they occur and servers whose clients disconnect are withdrawn.  A
+* heartbeat is kept outstanding and the connection is reestablished when the
+* upstream central server has not answered it within CLUSTER_TIMEOUT seconds.
+* \param ctx Contains the client SSL context, or NULL to relay in the clear.
+*/
+void upstream(SSL_CTX *ctx);
+/*! \fn bool writeSocket(connection *ptConnection)
+* \brief Writes as much of the pending output as a non-blocking connection accepts.
+* \param ptConnection Contains the connection.
+* \return Returns false when the connection has failed.
+*/
+bool writeSocket(connection *ptConnection);
 // }}}
 // {{{ main()
 /*! \fn int main(int argc, char *argv[])
@@ -209,11 +1220,15 @@ void sighandle(const int nSignal);
 int main(int argc, char *argv[])
 {
   bool bSetCredentials = false;
-  string strCertificate, strCred, strError, strPrivateKey;
+  string strCertificate, strCred, strError, strNode, strPrivateKey;
   SSL_CTX *ctx = NULL;
 
   gpCentral = new Central(strError);
   gpRadial = new Radial(strError);
+  if (thread::hardware_concurrency() > 0)
+  {
+    gunThreads = thread::hardware_concurrency();
+  }
   // {{{ set signal handling
   sethandles(sighandle);
   signal(SIGBUS, SIG_IGN);
@@ -241,6 +1256,21 @@ int main(int argc, char *argv[])
       gpCentral->manip()->purgeChar(strCertificate, strCertificate, "'");
       gpCentral->manip()->purgeChar(strCertificate, strCertificate, "\"");
     }
+    else if (strArg.size() > 10 && strArg.substr(0, 10) == "--cluster=")
+    {
+      string strNode;
+      stringstream ssCluster(strArg.substr(10, strArg.size() - 10));
+      while (getline(ssCluster, strNode, ','))
+      {
+        gpCentral->manip()->purgeChar(strNode, strNode, "'");
+        gpCentral->manip()->purgeChar(strNode, strNode, "\"");
+        gpCentral->manip()->trim(strNode, strNode);
+        if (!strNode.empty())
+        {
+          gClusterList.push_back(strNode);
+        }
+      }
+    }
     else if (strArg == "-c" || (strArg.size() > 7 && strArg.substr(0, 7) == "--cred="))
     {
       if (strArg == "-c" && i + 1 < argc && argv[i+1][0] != '-')
@@ -276,12 +1306,59 @@ int main(int argc, char *argv[])
       mUSAGE(argv[0]);
       return 0;
     }
+    else if (strArg.size() > 10 && strArg.substr(0, 10) == "--history=")
+    {
+      gstrHistory = strArg.substr(10, strArg.size() - 10);
+      gpCentral->manip()->purgeChar(gstrHistory, gstrHistory, "'");
+      gpCentral->manip()->purgeChar(gstrHistory, gstrHistory, "\"");
+    }
+    else if (strArg.size() > 20 && strArg.substr(0, 20) == "--history-retention=")
+    {
+      int nDays = atoi(strArg.substr(20, strArg.size() - 20).c_str());
+      if (nDays > 0)
+      {
+        gunHistoryRetention = nDays;
+      }
+    }
+    else if (strArg.size() > 7 && strArg.substr(0, 7) == "--node=")
+    {
+      strNode = strArg.substr(7, strArg.size() - 7);
+      gpCentral->manip()->purgeChar(strNode, strNode, "'");
+      gpCentral->manip()->purgeChar(strNode, strNode, "\"");
+    }
+    else if (strArg.size() > 10 && strArg.substr(0, 10) == "--peer-ca=")
+    {
+      gstrPeerCa = strArg.substr(10, strArg.size() - 10);
+      gpCentral->manip()->purgeChar(gstrPeerCa, gstrPeerCa, "'");
+      gpCentral->manip()->purgeChar(gstrPeerCa, gstrPeerCa, "\"");
+    }
+    else if (strArg.size() > 7 && strArg.substr(0, 7) == "--port=")
+    {
+      gstrPort = strArg.substr(7, strArg.size() - 7);
+      gpCentral->manip()->purgeChar(gstrPort, gstrPort, "'");
+      gpCentral->manip()->purgeChar(gstrPort, gstrPort, "\"");
+    }
     else if (strArg.size() > 14 && strArg.substr(0, 14) == "--private-key=")
     {
       strPrivateKey = strArg.substr(14, strArg.size() - 14);
       gpCentral->manip()->purgeChar(strPrivateKey, strPrivateKey, "'");
       gpCentral->manip()->purgeChar(strPrivateKey, strPrivateKey, "\"");
     }
+    else if (strArg.size() > 9 && strArg.substr(0, 9) == "--relays=")
+    {
+      string strRelay;
+      stringstream ssRelays(strArg.substr(9, strArg.size() - 9));
+      while (getline(ssRelays, strRelay, ','))
+      {
+        gpCentral->manip()->purgeChar(strRelay, strRelay, "'");
+        gpCentral->manip()->purgeChar(strRelay, strRelay, "\"");
+        gpCentral->manip()->trim(strRelay, strRelay);
+        if (!strRelay.empty())
+        {
+          gRelayList.push_back(strRelay);
+        }
+      }
+    }
     else if (strArg == "-r" || (strArg.size() > 7 && strArg.substr(0, 7) == "--room="))
     {
       if (strArg == "-r" && i + 1 < argc && argv[i+1][0] != '-')
@@ -295,6 +1372,26 @@ int main(int argc, char *argv[])
       gpCentral->manip()->purgeChar(gstrRoom, gstrRoom, "'");
       gpCentral->manip()->purgeChar(gstrRoom, gstrRoom, "\"");
     }
+    else if (strArg.size() > 11 && strArg.substr(0, 11) == "--snapshot=")
+    {
+      gstrSnapshot = strArg.substr(11, strArg.size() - 11);
+      gpCentral->manip()->purgeChar(gstrSnapshot, gstrSnapshot, "'");
+      gpCentral->manip()->purgeChar(gstrSnapshot, gstrSnapshot, "\"");
+    }
+    else if (strArg.size() > 10 && strArg.substr(0, 10) == "--threads=")
+    {
+      int nThreads = atoi(strArg.substr(10, strArg.size() - 10).c_str());
+      if (nThreads > 0)
+      {
+        gunThreads = nThreads;
+      }
+    }
+    else if (strArg.size() > 11 && strArg.substr(0, 11) == "--upstream=")
+    {
+      gstrUpstream = strArg.substr(11, strArg.size() - 11);
+      gpCentral->manip()->purgeChar(gstrUpstream, gstrUpstream, "'");
+      gpCentral->manip()->purgeChar(gstrUpstream, gstrUpstream, "\"");
+    }
     else if (strArg == "-v" || strArg == "--version")
     {
       mVER_USAGE(argv[0], VERSION);
@@ -308,6 +1405,34 @@ int main(int argc, char *argv[])
     }
   }
   // }}}
+  // {{{ cluster
+  if (!gClusterList.empty())
+  {
+    vector<string>::iterator nodeIter = find(gClusterList.begin(), gClusterList.end(), strNode);
+    if (nodeIter == gClusterList.end())
+    {
+      cout << endl << "Please provide --node matching one of the --cluster nodes." << endl;
+      mUSAGE(argv[0]);
+      return 0;
+    }
+    gunNode = nodeIter - gClusterList.begin();
+    for (size_t i = 0; i < gClusterList.size(); i++)
+    {
+      for (size_t j = 0; j < CLUSTER_POINTS; j++)
+      {
+        stringstream ssPoint;
+        ssPoint << gClusterList[i] << '#' << j;
+        gClusterRing[clusterHash(ssPoint.str())] = i;
+      }
+    }
+  }
+  if ((gClusterList.size() > 1 || !gstrUpstream.empty() || !gRelayList.empty()) && gstrPeerCa.empty())
+  {
+    cout << endl << "Please provide --peer-ca to authenticate the other cluster nodes, the regional relays or the upstream central server." << endl;
+    mUSAGE(argv[0]);
+    return 0;
+  }
+  // }}}
   gpCentral->setApplication(gstrApplication);
   gpCentral->setEmail(gstrEmail);
   if (!gstrRoom.empty())
@@ -352,14 +1477,49 @@ int main(int argc, char *argv[])
   {
     cerr << "Central::utility()->sslInitServer() error:  " << strError << endl;
   }
-  // {{{ normal run
-  if (!gstrEmail.empty() && bSetCredentials && ctx != NULL)
+  // {{{ peer authentication
+  // Clients are accepted with or without a certificate, but only peers presenting one issued by --peer-ca for a --cluster or --relays host may replicate or relay.
+  if (ctx != NULL && !gstrPeerCa.empty())
   {
-    ifstream inFile;
-    socklen_t clilen;
-    sockaddr_in cli_addr;
-    struct addrinfo hints;
-    struct addrinfo *result;
+    STACK_OF(X509_NAME) *ptNames;
+    if (SSL_CTX_load_verify_locations(ctx, gstrPeerCa.c_str(), NULL) == 1 && (ptNames = SSL_load_client_CA_file(gstrPeerCa.c_str())) != NULL)
+    {
+      SSL_CTX_set_client_CA_list(ctx, ptNames);
+      SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, peerVerify);
+    }
+    else
+    {
+      cerr << "SSL_CTX_load_verify_locations() error:  " << ERR_error_string(ERR_get_error(), NULL) << endl;
+    }
+  }
+  // }}}
+  // {{{ session resumption
+  if (ctx != NULL)
+  {
+    // Keys only outlive the process when there is a snapshot to restart warm from.
+    if (!gstrSnapshot.empty())
+    {
+      gstrTickets = gstrSnapshot + (string)".tickets";
+      ticketRead();
+    }
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"centralmond", 11);
+    SSL_CTX_set_timeout(ctx, TICKET_ROTATE * TICKET_KEYS);
+    #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketCallback);
+    #else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketCallback);
+    #endif
+  }
+  // }}}
+  // {{{ normal run
+  if (!gstrEmail.empty() && bSetCredentials && ctx != NULL)
+  {
+    ifstream inFile;
+    socklen_t clilen;
+    sockaddr_storage cli_addr;
+    struct addrinfo hints;
+    struct addrinfo *result;
     int nReturn;
     if (gbDaemon)
     {
@@ -403,7 +1563,7 @@ int main(int argc, char *argv[])
     hints.ai_family = AF_INET6;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags = AI_PASSIVE;
-    if ((nReturn = getaddrinfo(NULL, PORT, &hints, &result)) == 0)
+    if ((nReturn = getaddrinfo(NULL, gstrPort.c_str(), &hints, &result)) == 0)
     {
       bool bBound = false;
       struct addrinfo *rp;
@@ -429,814 +1589,165 @@ int main(int argc, char *argv[])
         if (listen(gfdStatus, 50) == 0)
         {
           bool bExit = false;
-          list<connection *> bridge;
-          pollfd *fds;
-          size_t unIndex;
+          size_t unNext = 0;
           stringstream ssMessage;
-          clilen = sizeof(cli_addr);
-          while (!gbShutdown && !bExit)
-          {
-            fds = new pollfd[bridge.size()+1];
-            unIndex = 0;
-            fds[unIndex].fd = gfdStatus;
-            fds[unIndex].events = POLLIN;
-            unIndex++;
-            for (list<connection *>::iterator i = bridge.begin(); i != bridge.end(); i++)
+          thread threadSync(syncer);
+          vector<thread *> responderList;
+          thread *pHistorian = NULL, *pReplicator = NULL, *pSnapshotter = NULL, *pUpstream = NULL;
+          SSL_CTX *ctxPeer = NULL;
+          if (!gstrSnapshot.empty())
+          {
+            if (!snapshotRead(strError))
+            {
+              notify((string)"Could not restore the state snapshot.  " + strError, strError);
+            }
+            pSnapshotter = new thread(snapshotter);
+          }
+          if (!gstrHistory.empty())
+          {
+            mkdir(gstrHistory.c_str(), 0755);
+            pHistorian = new thread(historian);
+            for (size_t i = 0; i < HISTORY_THREADS; i++)
+            {
+              responderList.push_back(new thread(historyResponder));
+            }
+          }
+          for (size_t i = 0; i < NOTIFY_THREADS; i++)
+          {
+            gNotifierList.push_back(new thread(notifier));
+          }
+          // {{{ peer context
+          // Peers present this server's certificate and must present one for their --cluster or --upstream host issued by --peer-ca.
+          if (gClusterList.size() > 1 || !gstrUpstream.empty())
+          {
+            if ((ctxPeer = SSL_CTX_new(TLS_client_method())) != NULL && SSL_CTX_load_verify_locations(ctxPeer, gstrPeerCa.c_str(), NULL) == 1 && SSL_CTX_use_certificate_chain_file(ctxPeer, strCertificate.c_str()) == 1 && SSL_CTX_use_PrivateKey_file(ctxPeer, strPrivateKey.c_str(), SSL_FILETYPE_PEM) == 1)
+            {
+              SSL_CTX_set_verify(ctxPeer, SSL_VERIFY_PEER, NULL);
+            }
+            else
             {
-              fds[unIndex].fd = (*i)->fdData;
-              fds[unIndex].events = POLLIN;
-              if (!(*i)->strBuffer[1].empty())
+              strError = ERR_error_string(ERR_get_error(), NULL);
+              notify((string)"Could not create the client TLS context for replication and relaying.  " + strError, strError);
+              if (ctxPeer != NULL)
               {
-                fds[unIndex].events |= POLLOUT;
+                SSL_CTX_free(ctxPeer);
+                ctxPeer = NULL;
               }
-              unIndex++;
             }
-            if ((nReturn = poll(fds, unIndex, 250)) > 0)
+          }
+          // }}}
+          if (ctxPeer != NULL)
+          {
+            if (gClusterList.size() > 1)
+            {
+              pReplicator = new thread(replicator, ctxPeer);
+            }
+            if (!gstrUpstream.empty())
+            {
+              pUpstream = new thread(upstream, ctxPeer);
+            }
+          }
+          // {{{ start event loops
+          for (size_t i = 0; i < gunThreads; i++)
+          {
+            shard *ptShard = new shard;
+            ptShard->unIndex = i;
+            if (pipe(ptShard->fdWake) == 0)
+            {
+              fcntl(ptShard->fdWake[0], F_SETFL, fcntl(ptShard->fdWake[0], F_GETFL) | O_NONBLOCK);
+              fcntl(ptShard->fdWake[1], F_SETFL, fcntl(ptShard->fdWake[1], F_GETFL) | O_NONBLOCK);
+              #ifdef USE_EPOLL
+              epoll_event event;
+              event.events = EPOLLIN;
+              event.data.ptr = NULL;
+              ptShard->fdEpoll = epoll_create1(0);
+              epoll_ctl(ptShard->fdEpoll, EPOLL_CTL_ADD, ptShard->fdWake[0], &event);
+              #endif
+              ptShard->pThread = new thread(reactor, ptShard, ctx);
+              gShardList.push_back(ptShard);
+            }
+            else
+            {
+              delete ptShard;
+            }
+          }
+          // }}}
+          // {{{ start handshake threads
+          for (size_t i = 0; !gShardList.empty() && i < HANDSHAKE_THREADS; i++)
+          {
+            shard *ptStage = new shard;
+            ptStage->unIndex = i;
+            if (pipe(ptStage->fdWake) == 0)
+            {
+              fcntl(ptStage->fdWake[0], F_SETFL, fcntl(ptStage->fdWake[0], F_GETFL) | O_NONBLOCK);
+              fcntl(ptStage->fdWake[1], F_SETFL, fcntl(ptStage->fdWake[1], F_GETFL) | O_NONBLOCK);
+              ptStage->pThread = new thread(handshaker, ptStage, ctx);
+              gHandshakeList.push_back(ptStage);
+            }
+            else
+            {
+              delete ptStage;
+            }
+          }
+          // }}}
+          while (!gbShutdown && !bExit && !gHandshakeList.empty())
+          {
+            pollfd fds[1];
+            fds[0].fd = gfdStatus;
+            fds[0].events = POLLIN;
+            if ((nReturn = poll(fds, 1, 250)) > 0)
             {
-              bool bSync = false;
-              time_t CTime;
-              list<list<connection *>::iterator> removeList;
-              if (fds[0].revents & POLLIN)
+              int fdData;
+              clilen = sizeof(cli_addr);
+              if ((fdData = accept(gfdStatus, (struct sockaddr *)&cli_addr, &clilen)) >= 0)
               {
-                int fdData;
-                if ((fdData = accept(gfdStatus, (struct sockaddr *)&cli_addr, &clilen)) >= 0)
+                bool bAllowed = false;
+                char szSource[NI_MAXHOST];
+                if (getnameinfo((struct sockaddr *)&cli_addr, clilen, szSource, sizeof(szSource), NULL, 0, NI_NUMERICHOST) != 0)
+                {
+                  szSource[0] = '\0';
+                }
+                gHandshakeMutex.lock();
+                if (gHandshakeSourceList[szSource] < HANDSHAKE_SOURCE)
+                {
+                  bAllowed = true;
+                  gHandshakeSourceList[szSource]++;
+                }
+                gHandshakeMutex.unlock();
+                if (bAllowed)
                 {
                   connection *ptConnection = new connection;
                   ptConnection->bClient = false;
                   ptConnection->bClose = false;
+                  ptConnection->bDrain = false;
+                  ptConnection->bRelay = false;
+                  ptConnection->bReplica = false;
                   ptConnection->fdData = fdData;
                   ptConnection->ssl = NULL;
                   ptConnection->eSocketType = COMMON_SOCKET_UNKNOWN;
-                  bridge.push_back(ptConnection);
+                  ptConnection->ptOverall = NULL;
+                  ptConnection->ptHistory = NULL;
+                  ptConnection->ptSubscriber = NULL;
+                  ptConnection->nProtocol = 1;
+                  ptConnection->ullSchedule = 0;
+                  ptConnection->unBuffer = 0;
+                  ptConnection->outBuffer.unOffset = 0;
+                  ptConnection->outBuffer.unSize = 0;
+                  ptConnection->sWait = POLLIN;
+                  ptConnection->strSource = szSource;
+                  time(&(ptConnection->CStartTime));
+                  fcntl(fdData, F_SETFL, fcntl(fdData, F_GETFL) | O_NONBLOCK);
+                  handoff(gHandshakeList[unNext++ % gHandshakeList.size()], ptConnection);
                 }
                 else
                 {
-                  bExit = true;
-                }
-              }
-              time(&CTime);
-              for (size_t i = 1; i < unIndex; i++)
-              {
-                bool bFound = false;
-                for (list<connection *>::iterator j = bridge.begin(); !bFound && j != bridge.end(); j++)
-                {
-                  if (fds[i].fd == (*j)->fdData)
-                  {
-                    overall *ptOverall = NULL;
-                    bFound = true;
-                    if ((*j)->bClient && gOverallList.find((*j)->strServer) != gOverallList.end())
-                    {
-                      ptOverall = gOverallList[(*j)->strServer];
-                    }
-                    if (fds[i].revents & POLLIN)
-                    {
-                      if ((*j)->eSocketType == COMMON_SOCKET_UNKNOWN)
-                      {
-                        if (gpCentral->utility()->socketType((*j)->fdData, (*j)->eSocketType, strError))
-                        {
-                          if ((*j)->eSocketType == COMMON_SOCKET_ENCRYPTED && ((*j)->ssl = gpCentral->utility()->sslAccept(ctx, (*j)->fdData, strError)) == NULL)
-                          {
-                            (*j)->bClose = true;
-                          }
-                        }
-                        else
-                        {
-                          (*j)->bClose = true;
-                        }
-                      }
-                      if (!(*j)->bClose && (((*j)->eSocketType == COMMON_SOCKET_ENCRYPTED && gpCentral->utility()->sslRead((*j)->ssl, (*j)->strBuffer[0], nReturn)) || ((*j)->eSocketType == COMMON_SOCKET_UNENCRYPTED && gpCentral->utility()->fdRead((*j)->fdData, (*j)->strBuffer[0], nReturn))))
-                      {
-                        size_t nPosition;
-                        while ((nPosition = (*j)->strBuffer[0].find("\n")) != string::npos)
-                        {
-                          string strAction, strLine = (*j)->strBuffer[0].substr(0, nPosition);
-                          (*j)->strBuffer[0].erase(0, nPosition + 1);
-                          if ((*j)->bClient)
-                          {
-                            gpCentral->manip()->getToken(strAction, strLine, 1, ";");
-                            // {{{ process
-                            if (strAction == "process")
-                            {
-                              string strProcess;
-                              if (!gpCentral->manip()->getToken(strProcess, strLine, 2, ";").empty())
-                              {
-                                string strToken, strOwners, strOwner, strCount;
-                                if (ptOverall != NULL && ptOverall->processList.find(strProcess) != ptOverall->processList.end())
-                                {
-                                  ptOverall->processList[strProcess]->strStartTime = gpCentral->manip()->getToken(strToken, strLine, 3, ";");
-                                  ptOverall->processList[strProcess]->owner.clear();
-                                  gpCentral->manip()->getToken(strOwners, strLine, 4, ";");
-                                  for (int k = 1; !gpCentral->manip()->getToken(strToken, strOwners, k, ",", true).empty(); k++)
-                                  {
-                                    if (!gpCentral->manip()->getToken(strOwner, strToken, 1, "=").empty())
-                                    {
-                                      ptOverall->processList[strProcess]->owner[strOwner] = (unsigned int)atoi(gpCentral->manip()->getToken(strCount, strToken, 2, "=").c_str());
-                                    }
-                                  }
-                                  ptOverall->processList[strProcess]->nProcesses = atoi(gpCentral->manip()->getToken(strToken, strLine, 5, ";").c_str());
-                                  ptOverall->processList[strProcess]->ulImage = atol(gpCentral->manip()->getToken(strToken, strLine, 6, ";").c_str());
-                                  ptOverall->processList[strProcess]->ulRealMinImage = atol(gpCentral->manip()->getToken(strToken, strLine, 7, ";").c_str());
-                                  ptOverall->processList[strProcess]->ulRealMaxImage = atol(gpCentral->manip()->getToken(strToken, strLine, 8, ";").c_str());
-                                  ptOverall->processList[strProcess]->ulResident = atol(gpCentral->manip()->getToken(strToken, strLine, 9, ";").c_str());
-                                  ptOverall->processList[strProcess]->ulRealMinResident = atol(gpCentral->manip()->getToken(strToken, strLine, 10, ";").c_str());
-                                  ptOverall->processList[strProcess]->ulRealMaxResident = atol(gpCentral->manip()->getToken(strToken, strLine, 11, ";").c_str());
-                                  if (ptOverall->processList[strProcess]->nProcesses <= 0)
-                                  {
-                                    if (ptOverall->processList[strProcess]->CTime <= 0)
-                                    {
-                                      time(&(ptOverall->processList[strProcess]->CTime));
-                                    }
-                                  }
-                                  else
-                                  {
-                                    ptOverall->processList[strProcess]->CTime = 0;
-                                  }
-                                  ptOverall->processList[strProcess]->bHaveValues = true;
-                                  // {{{ write out process alarm information
-                                  ptOverall->processList[strProcess]->bPage = false;
-                                  ptOverall->processList[strProcess]->ssAlarms.str("");
-                                  if (ptOverall->processList[strProcess]->nProcesses <= 0)
-                                  {
-                                    time_t CTime;
-                                    time(&CTime);
-                                    if (ptOverall->processList[strProcess]->nDelay <= 0 || (ptOverall->processList[strProcess]->CTime > 0 && CTime - ptOverall->processList[strProcess]->CTime >= ptOverall->processList[strProcess]->nDelay))
-                                    {
-                                      ptOverall->processList[strProcess]->bPage = true;
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " is not currently running";
-                                    }
-                                  }
-                                  else
-                                  {
-                                    if (!ptOverall->processList[strProcess]->strOwner.empty())
-                                    {
-                                      bool bFoundOwner = false;
-                                      for (map<string, unsigned int>::iterator k = ptOverall->processList[strProcess]->owner.begin(); !bFoundOwner && k != ptOverall->processList[strProcess]->owner.end(); k++)
-                                      {
-                                        if (ptOverall->processList[strProcess]->strOwner == k->first)
-                                        {
-                                          bFoundOwner = true;
-                                        }
-                                      }
-                                      if (!bFoundOwner)
-                                      {
-                                        ptOverall->processList[strProcess]->bPage = true;
-                                        ptOverall->processList[strProcess]->ssAlarms << strProcess << " is not running under the required " << ptOverall->processList[strProcess]->strOwner << " account";
-                                      }
-                                    }
-                                    if (ptOverall->processList[strProcess]->nMinProcesses > 0 && ptOverall->processList[strProcess]->nProcesses < ptOverall->processList[strProcess]->nMinProcesses)
-                                    {
-                                      if (!ptOverall->processList[strProcess]->ssAlarms.str().empty())
-                                      {
-                                        ptOverall->processList[strProcess]->ssAlarms << ",";
-                                      }
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " is running " << ptOverall->processList[strProcess]->nProcesses << " processes which is less than the minimum " << ptOverall->processList[strProcess]->nMinProcesses << " processes";
-                                    }
-                                    else if (ptOverall->processList[strProcess]->nMaxProcesses > 0 && ptOverall->processList[strProcess]->nProcesses > ptOverall->processList[strProcess]->nMaxProcesses)
-                                    {
-                                      if (!ptOverall->processList[strProcess]->ssAlarms.str().empty())
-                                      {
-                                        ptOverall->processList[strProcess]->ssAlarms << ",";
-                                      }
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " is running " << ptOverall->processList[strProcess]->nProcesses << " processes which is more than the maximum " << ptOverall->processList[strProcess]->nMaxProcesses << " processes";
-                                    }
-                                    if (ptOverall->processList[strProcess]->ulMinImage > 0 && ptOverall->processList[strProcess]->ulRealMinImage < ptOverall->processList[strProcess]->ulMinImage)
-                                    {
-                                      if (!ptOverall->processList[strProcess]->ssAlarms.str().empty())
-                                      {
-                                        ptOverall->processList[strProcess]->ssAlarms << ",";
-                                      }
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " has an image size of " << ptOverall->processList[strProcess]->ulRealMinImage << "KB which is less than the minimum " << ptOverall->processList[strProcess]->ulMinImage << "KB";
-                                    }
-                                    if (ptOverall->processList[strProcess]->ulMaxImage > 0 && ptOverall->processList[strProcess]->ulRealMaxImage > ptOverall->processList[strProcess]->ulMaxImage)
-                                    {
-                                      if (!ptOverall->processList[strProcess]->ssAlarms.str().empty())
-                                      {
-                                        ptOverall->processList[strProcess]->ssAlarms << ",";
-                                      }
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " has an image size of " << ptOverall->processList[strProcess]->ulRealMaxImage << "KB which is more than the maximum " << ptOverall->processList[strProcess]->ulMaxImage << "KB";
-                                    }
-                                    if (ptOverall->processList[strProcess]->ulMinResident > 0 && ptOverall->processList[strProcess]->ulRealMinResident < ptOverall->processList[strProcess]->ulMinResident)
-                                    {
-                                      if (!ptOverall->processList[strProcess]->ssAlarms.str().empty())
-                                      {
-                                        ptOverall->processList[strProcess]->ssAlarms << ",";
-                                      }
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " has a resident size of " << ptOverall->processList[strProcess]->ulRealMinResident << "KB which is less than the minimum " << ptOverall->processList[strProcess]->ulMinResident << "KB";
-                                    }
-                                    if (ptOverall->processList[strProcess]->ulMaxResident > 0 && ptOverall->processList[strProcess]->ulRealMaxResident > ptOverall->processList[strProcess]->ulMaxResident)
-                                    {
-                                      if (!ptOverall->processList[strProcess]->ssAlarms.str().empty())
-                                      {
-                                        ptOverall->processList[strProcess]->ssAlarms << ",";
-                                      }
-                                      ptOverall->processList[strProcess]->ssAlarms << strProcess << " has a resident size of " << ptOverall->processList[strProcess]->ulRealMaxResident << "KB which is more than the maximum " << ptOverall->processList[strProcess]->ulMaxResident << "KB";
-                                    }
-                                  }
-                                  if (!ptOverall->processList[strProcess]->ssAlarms.str().empty() && (ptOverall->processList[strProcess]->ssPrevAlarms.str().empty() || (ptOverall->processList[strProcess]->bPage && !ptOverall->processList[strProcess]->bPrevPage)))
-                                  {
-                                    ptOverall->processList[strProcess]->bPrevPage = ptOverall->processList[strProcess]->bPage;
-                                    ptOverall->processList[strProcess]->ssPrevAlarms << ptOverall->processList[strProcess]->ssAlarms.str();
-                                    if (ptOverall->processList[strProcess]->strScript.empty())
-                                    {
-                                      notifyApplicationContact((*j)->strServer, strProcess);
-                                    }
-                                    else
-                                    {
-                                      list<string> contactList;
-                                      string strValue;
-                                      stringstream ssQuery, ssMessage;
-                                      Json *ptJson = new Json;
-                                      ptJson->insert("type", "process");
-                                      ptJson->insert("daemon", strProcess);
-                                      ptJson->insert("start", ptOverall->processList[strProcess]->strStartTime);
-                                      ptJson->m["owner"] = new Json;
-                                      for (map<string, unsigned int>::iterator k = ptOverall->processList[strProcess]->owner.begin(); k != ptOverall->processList[strProcess]->owner.end(); k++)
-                                      {
-                                        ptJson->m["owner"]->insert(k->first, gpCentral->manip()->toString(k->second, strValue));
-                                      }
-                                      ptJson->insert("processes", gpCentral->manip()->toString(ptOverall->processList[strProcess]->nProcesses, strValue));
-                                      ptJson->insert("min_processes", gpCentral->manip()->toString(ptOverall->processList[strProcess]->nMinProcesses, strValue));
-                                      ptJson->insert("max_processes", gpCentral->manip()->toString(ptOverall->processList[strProcess]->nMaxProcesses, strValue));
-                                      ptJson->insert("image", gpCentral->manip()->toString(ptOverall->processList[strProcess]->ulImage, strValue));
-                                      ptJson->insert("min_image", gpCentral->manip()->toString(ptOverall->processList[strProcess]->ulRealMinImage, strValue));
-                                      ptJson->insert("max_image", gpCentral->manip()->toString(ptOverall->processList[strProcess]->ulRealMaxImage, strValue));
-                                      ptJson->insert("resident", gpCentral->manip()->toString(ptOverall->processList[strProcess]->ulResident, strValue));
-                                      ptJson->insert("min_resident", gpCentral->manip()->toString(ptOverall->processList[strProcess]->ulRealMinResident, strValue));
-                                      ptJson->insert("max_resident", gpCentral->manip()->toString(ptOverall->processList[strProcess]->ulRealMaxResident, strValue));
-                                      ssQuery << "select distinct c.id server_id, d.id application_contact_id, f.userid, f.email from application_server_detail a, application_server b, server c, application_contact d, contact_type e, person f where a.application_server_id=b.id and b.server_id=c.id and b.application_id=d.application_id and d.type_id=e.id and d.contact_id=f.id and a.daemon = '" << strProcess << "' and c.name = '" << (*j)->strServer << "' and (e.type = 'Primary Developer' or e.type = 'Backup Developer' or e.type = 'Primary Contact')";
-                                      list<map<string, string> > *getApplicationContact = gpCentral->query("central", ssQuery.str(), strError);
-                                      if (getApplicationContact != NULL)
-                                      {
-                                        for (list<map<string, string> >::iterator getApplicationContactIter = getApplicationContact->begin(); getApplicationContactIter != getApplicationContact->end(); getApplicationContactIter++)
-                                        {
-                                          map<string, string> getApplicationContactRow = *getApplicationContactIter;
-                                          ssQuery.str("");
-                                          ssQuery << "select count(*) num_rows from application_server_contact where application_contact_id = " << getApplicationContactRow["application_contact_id"];
-                                          list<map<string, string> > *getApplicationServerContactCount = gpCentral->query("central", ssQuery.str(), strError);
-                                          if (getApplicationServerContactCount != NULL && !getApplicationServerContactCount->empty())
-                                          {
-                                            map<string, string> getApplicationServerContactCountRow = getApplicationServerContactCount->front();
-                                            if (atoi(getApplicationServerContactCountRow["num_rows"].c_str()) > 0)
-                                            {
-                                              ssQuery.str("");
-                                              ssQuery << "select b.* from application_server a, application_server_contact b where a.id=b.application_server_id and a.server_id = " << getApplicationContactRow["server_id"] << " and b.application_contact_id = " << getApplicationContactRow["application_contact_id"];
-                                              list<map<string, string> > *getApplicationServerContact = gpCentral->query("central", ssQuery.str(), strError);
-                                              if (getApplicationServerContact != NULL && !getApplicationServerContact->empty())
-                                              {
-                                                map<string, string> getApplicationServerContactRow = getApplicationServerContact->front();
-                                                contactList.push_back(getApplicationContactRow["email"]);
-                                                if (ptOverall->processList[strProcess]->bPage && ptOverall->processList[strProcess]->strScript.empty())
-                                                {
-                                                  contactList.push_back((string)"!" + getApplicationContactRow["userid"]);
-                                                }
-                                              }
-                                              gpCentral->free(getApplicationServerContact);
-                                            }
-                                            else
-                                            {
-                                              contactList.push_back(getApplicationContactRow["email"]);
-                                              if (ptOverall->processList[strProcess]->bPage && ptOverall->processList[strProcess]->strScript.empty())
-                                              {
-                                                contactList.push_back((string)"!" + getApplicationContactRow["userid"]);
-                                              }
-                                            }
-                                          }
-                                          gpCentral->free(getApplicationServerContactCount);
-                                        }
-                                      }
-                                      gpCentral->free(getApplicationContact);
-                                      contactList.push_back("#nma.system");
-                                      contactList.sort();
-                                      contactList.unique();
-                                      ptJson->m["contacts"] = new Json;
-                                      for (list<string>::iterator k = contactList.begin(); k != contactList.end(); k++)
-                                      {
-                                        Json *ptSubJson = new Json;
-                                        ptSubJson->v= *k;
-                                        ptJson->m["contacts"]->l.push_back(ptSubJson);
-                                      }
-                                      contactList.clear();
-                                      ssMessage << "script " << ptOverall->processList[strProcess]->strScript << endl << ptJson << endl;
-                                      delete ptJson;
-                                      (*j)->strBuffer[1] += ssMessage.str();
-                                      ssMessage.str("");
-                                    }
-                                  }
-                                  // }}}
-                                }
-                              }
-                            }
-                            // }}}
-                            // {{{ system
-                            else if (strAction == "system")
-                            {
-                              string strItem, strPartitions, strPercent, strSubToken, strToken;
-                              ptOverall->strOperatingSystem = gpCentral->manip()->getToken(strToken, strLine, 2, ";");
-                              ptOverall->strSystemRelease = gpCentral->manip()->getToken(strToken, strLine, 3, ";");
-                              ptOverall->nProcessors = atoi(gpCentral->manip()->getToken(strToken, strLine, 4, ";").c_str());
-                              ptOverall->unCpuSpeed = atoi(gpCentral->manip()->getToken(strToken, strLine, 5, ";").c_str());
-                              ptOverall->usProcesses = atoi(gpCentral->manip()->getToken(strToken, strLine, 6, ";").c_str());
-                              gpCentral->manip()->getToken(strToken, strLine, 7, ";").c_str();
-                              ptOverall->unCpuUsage = atoi(gpCentral->manip()->getToken(strSubToken, strToken, 1, "|").c_str());
-                              ptOverall->strCpuProcessUsage = gpCentral->manip()->getToken(strSubToken, strToken, 2, "|");
-                              ptOverall->lUpTime = atol(gpCentral->manip()->getToken(strToken, strLine, 8, ";").c_str());
-                              ptOverall->ulMainUsed = atol(gpCentral->manip()->getToken(strToken, strLine, 9, ";").c_str());
-                              ptOverall->ulMainTotal = atol(gpCentral->manip()->getToken(strToken, strLine, 10, ";").c_str());
-                              ptOverall->ulSwapUsed = atol(gpCentral->manip()->getToken(strToken, strLine, 11, ";").c_str());
-                              ptOverall->ulSwapTotal = atol(gpCentral->manip()->getToken(strToken, strLine, 12, ";").c_str());
-                              ptOverall->partition.clear();
-                              gpCentral->manip()->getToken(ptOverall->strPartitions, strLine, 13, ";");
-                              for (int k = 1; !gpCentral->manip()->getToken(strItem, ptOverall->strPartitions, k, ",", true).empty(); k++)
-                              {
-                                if (!gpCentral->manip()->getToken(strToken, strItem, 1, "=").empty())
-                                {
-                                  ptOverall->partition[strToken] = (unsigned int)atoi(gpCentral->manip()->getToken(strPercent, strItem, 2, "=").c_str());
-                                }
-                              }
-                              ptOverall->bHaveValues = true;
-                              // {{{ write out system alarm information
-                              if (ptOverall->bHaveThresholds)
-                              {
-                                ptOverall->ssAlarms.str("");
-                                ptOverall->bPage = false;
-                                if (ptOverall->usMaxProcesses > 0 && ptOverall->usProcesses > ptOverall->usMaxProcesses)
-                                {
-                                  if (!ptOverall->ssAlarms.str().empty())
-                                  {
-                                    ptOverall->ssAlarms << ",";
-                                  }
-                                  ptOverall->ssAlarms << ptOverall->usProcesses << " processes are running which is more than the maximum " << ptOverall->usMaxProcesses << " processes";
-                                }
-                                if (ptOverall->unMaxCpuUsage > 0 && ptOverall->unCpuUsage > ptOverall->unMaxCpuUsage)
-                                {
-                                  if (!ptOverall->ssAlarms.str().empty())
-                                  {
-                                    ptOverall->ssAlarms << ",";
-                                  }
-                                  ptOverall->ssAlarms << "using " << ptOverall->unCpuUsage << "% CPU which is more than the maximum " << ptOverall->unMaxCpuUsage << "%";
-                                  if (!ptOverall->strCpuProcessUsage.empty())
-                                  {
-                                    ptOverall->ssAlarms << " --- (" << ptOverall->strCpuProcessUsage << ")";
-                                  }
-                                }
-                                if (ptOverall->unMaxMainUsage > 0 && ptOverall->ulMainTotal > 0 && (unsigned int)(ptOverall->ulMainUsed * 100 / ptOverall->ulMainTotal) >= ptOverall->unMaxMainUsage)
-                                {
-                                  if (!ptOverall->ssAlarms.str().empty())
-                                  {
-                                    ptOverall->ssAlarms << ",";
-                                  }
-                                  ptOverall->ssAlarms << "using " << (ptOverall->ulMainUsed * 100 / ptOverall->ulMainTotal) << "% main memory which is more than the maximum " << ptOverall->unMaxMainUsage << "%";
-                                }
-                                if (ptOverall->unMaxSwapUsage > 0 && ptOverall->ulSwapTotal > 0 && (unsigned int)(ptOverall->ulSwapUsed * 100 / ptOverall->ulSwapTotal) >= ptOverall->unMaxSwapUsage)
-                                {
-                                  ptOverall->bPage = true;
-                                  if (!ptOverall->ssAlarms.str().empty())
-                                  {
-                                    ptOverall->ssAlarms << ",";
-                                  }
-                                  ptOverall->ssAlarms << "using " << (ptOverall->ulSwapUsed * 100 / ptOverall->ulSwapTotal) << "% swap memory which is more than the maximum " << ptOverall->unMaxSwapUsage << "%";
-                                }
-                                for (map<string, unsigned int>::iterator k = ptOverall->partition.begin(); k != ptOverall->partition.end(); k++)
-                                {
-                                  if (ptOverall->unMaxDiskUsage > 0 && k->second >= ptOverall->unMaxDiskUsage && k->first.find("cdrom", 0) == string::npos)
-                                  {
-                                    if (!ptOverall->ssAlarms.str().empty())
-                                    {
-                                      ptOverall->ssAlarms << ",";
-                                    }
-                                    ptOverall->ssAlarms << k->first << " partition is " << k->second << "% filled which is more than the maximum " << ptOverall->unMaxDiskUsage << "%";
-                                  }
-                                }
-                                if (!ptOverall->ssAlarms.str().empty() && (ptOverall->ssPrevAlarms.str().empty() || (ptOverall->bPage && !ptOverall->bPrevPage)))
-                                {
-                                  ptOverall->bPrevPage = ptOverall->bPage;
-                                  ptOverall->ssPrevAlarms << ptOverall->ssAlarms.str();
-                                  notifyServerContact((*j)->strServer);
-                                }
-                              }
-                              // }}}
-                            }
-                            // }}}
-                          }
-                          else
-                          {
-                            stringstream ssLine;
-                            ssLine.str(strLine);
-                            ssLine >> strAction;
-                            // {{{ message
-                            if (strAction == "message")
-                            {
-                              string strSubLine, strToken;
-                              time_t CTime;
-                              message *ptMessage = new message;
-                              (*j)->strBuffer[1] += "okay\n";
-                              gpCentral->manip()->trim(strSubLine, ssLine.str());
-                              gpCentral->manip()->getToken(ptMessage->strType, strSubLine, 1, ";");
-                              if (ptMessage->strType.size() >= 8 && ptMessage->strType.substr(0, 8) == "message ")
-                              {
-                                ptMessage->strType.erase(0, 8);
-                              }
-                              gpCentral->manip()->getToken(ptMessage->strApplication, strSubLine, 2, ";");
-                              ptMessage->CStartTime = atoi(gpCentral->manip()->getToken(strToken, strSubLine, 3, ";").c_str());
-                              ptMessage->CEndTime = atoi(gpCentral->manip()->getToken(strToken, strSubLine, 4, ";").c_str());
-                              gpCentral->manip()->getToken(ptMessage->strMessage, strSubLine, 5, ";");
-                              time(&CTime);
-                              if (ptMessage->CEndTime > CTime)
-                              {
-                                gMessageList.push_back(ptMessage);
-                              }
-                              else
-                              {
-                                delete ptMessage;
-                              }
-                            }
-                            // }}}
-                            // {{{ messages
-                            else if (strAction == "messages")
-                            {
-                              bool bFound = false;
-                              time_t CTime;
-                              list<list<message *>::iterator> removeSubList;
-                              time(&CTime);
-                              for (list<message *>::iterator k = gMessageList.begin(); k != gMessageList.end(); k++)
-                              {
-                                if ((*k)->CStartTime <= CTime)
-                                {
-                                  if ((*k)->CEndTime > CTime)
-                                  {
-                                    stringstream ssMessage;
-                                    bFound = true;
-                                    ssMessage << (*k)->strType << ";" << (*k)->strApplication << ";" << (*k)->strMessage;
-                                    (*j)->strBuffer[1].append(ssMessage.str() + "\n");
-                                  }
-                                  else
-                                  {
-                                    delete *k;
-                                    removeSubList.push_back(k);
-                                  }
-                                }
-                              }
-                              for (list<list<message *>::iterator>::iterator k = removeSubList.begin(); k != removeSubList.end(); k++)
-                              {
-                                gMessageList.erase(*k);
-                              }
-                              removeSubList.clear();
-                              if (!bFound)
-                              {
-                                (*j)->bClose = true;
-                              }
-                            }
-                            // }}}
-                            // {{{ process
-                            else if (strAction == "process")
-                            {
-                              string strServer, strProcess;
-                              ssLine >> strServer >> strProcess;
-                              if (!strServer.empty() && gOverallList.find(strServer) != gOverallList.end() && !strProcess.empty() && gOverallList[strServer]->processList.find(strProcess) != gOverallList[strServer]->processList.end() && gOverallList[strServer]->processList[strProcess]->bHaveValues)
-                              {
-                                stringstream ssDetails;
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->strStartTime << ';';
-                                for (map<string, unsigned int>::iterator k = gOverallList[strServer]->processList[strProcess]->owner.begin(); k != gOverallList[strServer]->processList[strProcess]->owner.end(); k++)
-                                {
-                                  if (k != gOverallList[strServer]->processList[strProcess]->owner.begin())
-                                  {
-                                    ssDetails << ", ";
-                                  }
-                                  ssDetails << k->first << '(' << k->second << ')';
-                                }
-                                ssDetails << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->nProcesses << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ulImage << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ulRealMinImage << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ulRealMaxImage << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ulResident << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ulRealMinResident << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ulRealMaxResident << ';';
-                                ssDetails << gOverallList[strServer]->processList[strProcess]->ssAlarms.str();
-                                (*j)->strBuffer[1] += ssDetails.str() + "\n";
-                              }
-                              else
-                              {
-                                strError.clear();
-                                if (strServer.empty())
-                                {
-                                  strError = "Please provide the server.";
-                                }
-                                else if (gOverallList.find(strServer) == gOverallList.end())
-                                {
-                                  strError = "Please provide a valid server.";
-                                }
-                                else if (strProcess.empty())
-                                {
-                                  strError = "Please provide the process.";
-                                }
-                                else if (gOverallList[strServer]->processList.find(strProcess) == gOverallList[strServer]->processList.end())
-                                {
-                                  strError = "Please provide a valid process.";
-                                }
-                                else if (!gOverallList[strServer]->processList[strProcess]->bHaveValues)
-                                {
-                                  strError = "Process has no values.";
-                                }
-                                (*j)->strBuffer[1] += (string)";;;;;;;;;" + strError + (string)"\n";
-                              }
-                            }
-                            // }}}
-                            // {{{ server
-                            else if (strAction == "server")
-                            {
-                              string strServer;
-                              ssLine >> strServer;
-                              if (!strServer.empty())
-                              {
-                                char szIP[INET6_ADDRSTRLEN];
-                                sockaddr_storage addr;
-                                socklen_t len = sizeof(addr);
-                                string strClient;
-                                getpeername((*j)->fdData, (sockaddr*)&addr, &len);
-                                if (addr.ss_family == AF_INET)
-                                {
-                                  sockaddr_in *s = (sockaddr_in *)&addr;
-                                  inet_ntop(AF_INET, &s->sin_addr, szIP, sizeof(szIP));
-                                }
-                                else if (addr.ss_family == AF_INET6)
-                                {
-                                  sockaddr_in6 *s = (sockaddr_in6 *)&addr;
-                                  inet_ntop(AF_INET6, &s->sin6_addr, szIP, sizeof(szIP));
-                                }
-                                strClient = szIP;
-                                if (gOverallList.find(strServer) == gOverallList.end())
-                                {
-                                  (*j)->bClient = true;
-                                  (*j)->strServer = strServer;
-                                  (*j)->CStartTime = 0;
-                                  gOverallList[strServer] = new overall;
-                                  gOverallList[strServer]->bHaveThresholds = false;
-                                  gOverallList[strServer]->bHaveValues = false;
-                                  gOverallList[strServer]->bPage = false;
-                                  bSync = true;
-                                }
-                                else
-                                {
-                                  (*j)->bClose = true;
-                                }
-                              }
-                              else
-                              {
-                                (*j)->bClose = true;
-                              }
-                            }
-                            // }}}
-                            // {{{ system
-                            else if (strAction == "system")
-                            {
-                              string strServer;
-                              ssLine >> strServer;
-                              if (strServer.empty())
-                              {
-                                bool bFound = false;
-                                for (map<string, overall *>::iterator k = gOverallList.begin(); k != gOverallList.end(); k++)
-                                {
-                                  if (k->second->bHaveValues)
-                                  {
-                                    stringstream ssDetails;
-                                    bFound = true;
-                                    ssDetails << k->first << ';';
-                                    ssDetails << k->second->strOperatingSystem << ';';
-                                    ssDetails << k->second->strSystemRelease << ';';
-                                    ssDetails << k->second->nProcessors << ';';
-                                    ssDetails << k->second->unCpuSpeed << ';';
-                                    ssDetails << k->second->usProcesses << ';';
-                                    ssDetails << k->second->unCpuUsage << ';';
-                                    ssDetails << k->second->lUpTime << ';';
-                                    ssDetails << k->second->ulMainUsed << ';';
-                                    ssDetails << k->second->ulMainTotal << ';';
-                                    ssDetails << k->second->ulSwapUsed << ';';
-                                    ssDetails << k->second->ulSwapTotal << ';';
-                                    ssDetails << k->second->strPartitions << ';';
-                                    ssDetails << k->second->ssAlarms.str();
-                                    (*j)->strBuffer[1] += ssDetails.str() + "\n";
-                                  }
-                                }
-                                if (!bFound)
-                                {
-                                  (*j)->strBuffer[1] += ";;;;;;;;;;;;;No servers with values exist.\n";
-                                }
-                              }
-                              else if (gOverallList.find(strServer) != gOverallList.end())
-                              {
-                                if (gOverallList[strServer]->bHaveValues)
-                                {
-                                  stringstream ssDetails;
-                                  ssDetails << strServer << ';';
-                                  ssDetails << gOverallList[strServer]->strOperatingSystem << ';';
-                                  ssDetails << gOverallList[strServer]->strSystemRelease << ';';
-                                  ssDetails << gOverallList[strServer]->nProcessors << ';';
-                                  ssDetails << gOverallList[strServer]->unCpuSpeed << ';';
-                                  ssDetails << gOverallList[strServer]->usProcesses << ';';
-                                  ssDetails << gOverallList[strServer]->unCpuUsage << ';';
-                                  ssDetails << gOverallList[strServer]->lUpTime << ';';
-                                  ssDetails << gOverallList[strServer]->ulMainUsed << ';';
-                                  ssDetails << gOverallList[strServer]->ulMainTotal << ';';
-                                  ssDetails << gOverallList[strServer]->ulSwapUsed << ';';
-                                  ssDetails << gOverallList[strServer]->ulSwapTotal << ';';
-                                  ssDetails << gOverallList[strServer]->strPartitions << ';';
-                                  ssDetails << gOverallList[strServer]->ssAlarms.str();
-                                  (*j)->strBuffer[1] += ssDetails.str() + "\n";
-                                }
-                                else
-                                {
-                                  (*j)->strBuffer[1] += ";;;;;;;;;;;;;Server has no values.\n";
-                                }
-                              }
-                              else
-                              {
-                                (*j)->strBuffer[1] += ";;;;;;;;;;;;;Please provide a valid server.\n";
-                              }
-                            }
-                            // }}}
-                            // {{{ update
-                            else if (strAction == "update")
-                            {
-                              (*j)->strBuffer[1] += "okay\n";
-                              bSync = true;
-                            }
-                            // }}}
-                          }
-                        }
-                      }
-                      else
-                      {
-                        (*j)->bClose = true;
-                      }
-                    }
-                    if (fds[i].revents & POLLOUT)
-                    {
-                      if (!(*j)->bClose && (((*j)->eSocketType == COMMON_SOCKET_ENCRYPTED && gpCentral->utility()->sslWrite((*j)->ssl, (*j)->strBuffer[1], nReturn)) || ((*j)->eSocketType == COMMON_SOCKET_UNENCRYPTED && gpCentral->utility()->fdWrite((*j)->fdData, (*j)->strBuffer[1], nReturn))))
-                      {
-                        if (!(*j)->bClient && (*j)->strBuffer[1].empty())
-                        {
-                          (*j)->bClose = true;
-                        }
-                      }
-                      else
-                      {
-                        (*j)->bClose = true;
-                      }
-                    }
-                    if ((*j)->bClose)
-                    {
-                      removeList.push_back(j);
-                    }
-                    else if ((*j)->bClient && gOverallList.find((*j)->strServer) != gOverallList.end())
-                    {
-                      time(&((*j)->CEndTime));
-                      if ((*j)->CEndTime - (*j)->CStartTime > 30)
-                      {
-                        (*j)->strBuffer[1] += "system\n";
-                        if (ptOverall != NULL)
-                        {
-                          for (map<string, process *>::iterator k = ptOverall->processList.begin(); k != ptOverall->processList.end(); k++)
-                          {
-                            (*j)->strBuffer[1] += (string)"process " + k->first + (string)"\n";
-                          }
-                        }
-                        time(&((*j)->CStartTime));
-                      }
-                    }
-                  }
-                }
-              }
-              for (list<list<connection *>::iterator>::iterator i = removeList.begin(); i != removeList.end(); i++)
-              {
-                if ((*(*i))->bClient)
-                {
-                  gOverallList[(*(*i))->strServer]->partition.clear();
-                  for (map<string, process *>::iterator j = gOverallList[(*(*i))->strServer]->processList.begin(); j != gOverallList[(*(*i))->strServer]->processList.end(); j++)
-                  {
-                    j->second->owner.clear();
-                    delete j->second;
-                  }
-                  gOverallList[(*(*i))->strServer]->processList.clear();
-                  delete gOverallList[(*(*i))->strServer];
-                  gOverallList.erase((*(*i))->strServer);
-                  //notify((string)"Lost client connection to " + (*(*i))->strServer, strError);
-                }
-                if ((*(*i))->eSocketType == COMMON_SOCKET_ENCRYPTED)
-                {
-                  // Disabled SSL_shutdown() due it appearing to hang on an underlying read().
-                  //SSL_shutdown((*(*i))->ssl);
-                  SSL_free((*(*i))->ssl);
+                  gullHandshakeLimited++;
+                  close(fdData);
                 }
-                close((*(*i))->fdData);
-                delete *(*i);
-                bridge.erase(*i);
               }
-              removeList.clear();
-              if (bSync)
+              else
               {
-                stringstream ssQuery;
-                for (map<string, overall *>::iterator i = gOverallList.begin(); i != gOverallList.end(); i++)
-                {
-                  vector<string> remove;
-                  // {{{ system
-                  ssQuery.str("");
-                  ssQuery << "select distinct * from server where name = \'" << i->first << "\'";
-                  list<map<string, string> > *getServer = gpCentral->query("central", ssQuery.str(), strError);
-                  if (getServer != NULL && !getServer->empty())
-                  {
-                    map<string, string> getServerRow = getServer->front();
-                    i->second->unMaxCpuUsage = atoi(getServerRow["cpu_usage"].c_str());
-                    i->second->unMaxDiskUsage = atoi(getServerRow["disk_size"].c_str());
-                    i->second->unMaxMainUsage = atoi(getServerRow["main_memory"].c_str());
-                    i->second->unMaxSwapUsage = atoi(getServerRow["swap_memory"].c_str());
-                    i->second->usMaxProcesses = atoi(getServerRow["processes"].c_str());
-                    i->second->bHaveThresholds = true;
-                  }
-                  gpCentral->free(getServer);
-                  // }}}
-                  // {{{ process
-                  for (map<string, process *>::iterator j = i->second->processList.begin(); j != i->second->processList.end(); j++)
-                  {
-                    j->second->bChecking = true;
-                  }
-                  ssQuery.str("");
-                  ssQuery << "select distinct a.* from application_server_detail a, application_server b, server c where a.application_server_id=b.id and b.server_id=c.id and a.daemon is not null and a.daemon != \'\' and c.name = \'" << i->first << "\'";
-                  list<map<string, string> > *getApplicationServer = gpCentral->query("central", ssQuery.str(), strError);
-                  if (getApplicationServer != NULL)
-                  {
-                    for (list<map<string, string> >::iterator getApplicationServerIter = getApplicationServer->begin(); getApplicationServerIter != getApplicationServer->end(); getApplicationServerIter++)
-                    {
-                      bool bChanged = false, bDoNothing = false;
-                      map<string, string> getApplicationServerRow = *getApplicationServerIter;
-                      string strProcess = getApplicationServerRow["daemon"];
-                      process *ptProcess = new process;
-                      ptProcess->bChecking = false;
-                      ptProcess->bHaveValues = false;
-                      ptProcess->bPage = false;
-                      ptProcess->nDelay = atoi(getApplicationServerRow["delay"].c_str());
-                      ptProcess->nProcesses = 0;
-                      ptProcess->nMinProcesses = atoi(getApplicationServerRow["min_processes"].c_str());
-                      ptProcess->nMaxProcesses = atoi(getApplicationServerRow["max_processes"].c_str());
-                      ptProcess->ulImage = 0;
-                      ptProcess->ulRealMinImage = 0;
-                      ptProcess->ulRealMaxImage = 0;
-                      ptProcess->ulMinImage = (unsigned long)atol(getApplicationServerRow["min_image"].c_str());
-                      ptProcess->ulMaxImage = (unsigned long)atol(getApplicationServerRow["max_image"].c_str());
-                      ptProcess->ulResident = 0;
-                      ptProcess->ulRealMinResident = 0;
-                      ptProcess->ulRealMaxResident = 0;
-                      ptProcess->ulMinResident = (unsigned long)atol(getApplicationServerRow["min_resident"].c_str());
-                      ptProcess->ulMaxResident = (unsigned long)atol(getApplicationServerRow["max_resident"].c_str());
-                      ptProcess->CTime = 0;
-                      ptProcess->strApplicationServerID = getApplicationServerRow["id"];
-                      ptProcess->strOwner = getApplicationServerRow["owner"];
-                      ptProcess->strScript = getApplicationServerRow["script"];
-                      if (i->second->processList.find(strProcess) != i->second->processList.end())
-                      {
-                        i->second->processList[strProcess]->bChecking = false;
-                        if (i->second->processList[strProcess]->nMinProcesses != ptProcess->nMinProcesses || i->second->processList[strProcess]->nMaxProcesses != ptProcess->nMaxProcesses || i->second->processList[strProcess]->ulMinImage != ptProcess->ulMinImage || i->second->processList[strProcess]->ulMaxImage != ptProcess->ulMaxImage || i->second->processList[strProcess]->ulMinResident != ptProcess->ulMinResident || i->second->processList[strProcess]->ulMaxResident != ptProcess->ulMaxResident || i->second->processList[strProcess]->strOwner != ptProcess->strOwner || i->second->processList[strProcess]->strScript != ptProcess->strScript)
-                        {
-                          bChanged = true;
-                        }
-                        if (bChanged)
-                        {
-                          i->second->processList[strProcess]->owner.clear();
-                          delete i->second->processList[strProcess];
-                          i->second->processList.erase(strProcess);
-                        }
-                        else
-                        {
-                          bDoNothing = true;
-                        }
-                      }
-                      if (bDoNothing)
-                      {
-                        delete ptProcess;
-                      }
-                      else
-                      {
-                        i->second->processList[strProcess] = ptProcess;
-                      }
-                    }
-                  }
-                  gpCentral->free(getApplicationServer);
-                  for (map<string, process *>::iterator j = i->second->processList.begin(); j != i->second->processList.end(); j++)
-                  {
-                    if (j->second->bChecking)
-                    {
-                      remove.push_back(j->first);
-                      j->second->owner.clear();
-                      delete j->second;
-                    }
-                  }
-                  for (vector<string>::iterator j = remove.begin(); j != remove.end(); j++)
-                  {
-                    i->second->processList.erase(*j);
-                  }
-                  remove.clear();
-                  // }}}
-                }
+                bExit = true;
               }
             }
             else if (nReturn < 0 && errno != EINTR)
@@ -1244,14 +1755,108 @@ int main(int argc, char *argv[])
               bExit = true;
               notify((string)"Poll error: " + strerror(errno), strError);
             }
-            delete[] fds;
           }
-          for (list<connection *>::iterator i = bridge.begin(); i != bridge.end(); i++)
+          if (gbShutdown)
+          {
+            ssMessage << "Received a shutdown signal.  Exiting...";
+          }
+          else
+          {
+            ssMessage << "Lost connection to status socket!  " << strerror(errno) << "(" << errno << ").  Exiting...";
+          }
+          gbShutdown = true;
+          // {{{ stop history query threads
+          gHistoryQueryCondition.notify_all();
+          for (vector<thread *>::iterator i = responderList.begin(); i != responderList.end(); i++)
+          {
+            (*i)->join();
+            delete *i;
+          }
+          responderList.clear();
+          // }}}
+          // {{{ stop handshake threads
+          for (vector<shard *>::iterator i = gHandshakeList.begin(); i != gHandshakeList.end(); i++)
+          {
+            (*i)->pThread->join();
+            delete (*i)->pThread;
+            close((*i)->fdWake[0]);
+            close((*i)->fdWake[1]);
+            for (list<connection *>::iterator j = (*i)->queue.begin(); j != (*i)->queue.end(); j++)
+            {
+              close((*j)->fdData);
+              delete *j;
+            }
+            (*i)->queue.clear();
+            delete *i;
+          }
+          gHandshakeList.clear();
+          // }}}
+          // {{{ stop event loops
+          for (vector<shard *>::iterator i = gShardList.begin(); i != gShardList.end(); i++)
+          {
+            (*i)->pThread->join();
+            delete (*i)->pThread;
+            #ifdef USE_EPOLL
+            close((*i)->fdEpoll);
+            #endif
+            close((*i)->fdWake[0]);
+            close((*i)->fdWake[1]);
+            for (list<connection *>::iterator j = (*i)->queue.begin(); j != (*i)->queue.end(); j++)
+            {
+              close((*j)->fdData);
+              delete *j;
+            }
+            (*i)->queue.clear();
+            for (list<historyquery *>::iterator j = (*i)->historyList.begin(); j != (*i)->historyList.end(); j++)
+            {
+              delete *j;
+            }
+            (*i)->historyList.clear();
+            delete *i;
+          }
+          gShardList.clear();
+          for (list<historyquery *>::iterator i = gHistoryQueryList.begin(); i != gHistoryQueryList.end(); i++)
+          {
+            delete *i;
+          }
+          gHistoryQueryList.clear();
+          // }}}
+          gSyncCondition.notify_all();
+          threadSync.join();
+          if (pHistorian != NULL)
+          {
+            gHistoryCondition.notify_all();
+            pHistorian->join();
+            delete pHistorian;
+          }
+          if (pSnapshotter != NULL)
+          {
+            gSnapshotCondition.notify_all();
+            pSnapshotter->join();
+            delete pSnapshotter;
+          }
+          if (pReplicator != NULL)
+          {
+            pReplicator->join();
+            delete pReplicator;
+          }
+          if (pUpstream != NULL)
+          {
+            gUpstreamCondition.notify_all();
+            pUpstream->join();
+            delete pUpstream;
+          }
+          if (ctxPeer != NULL)
+          {
+            SSL_CTX_free(ctxPeer);
+          }
+          gNotificationCondition.notify_all();
+          for (vector<thread *>::iterator i = gNotifierList.begin(); i != gNotifierList.end(); i++)
           {
+            (*i)->join();
             delete *i;
           }
-          bridge.clear();
-          ssMessage << "Lost connection to status socket!  " << strerror(errno) << "(" << errno << ").  Exiting...";
+          gNotifierList.clear();
           notify(ssMessage.str(), strError);
         }
         else
@@ -1288,194 +1893,4619 @@ int main(int argc, char *argv[])
   return 0;
 }
 // }}}
-// {{{ chat()
-bool chat(const string strMessage, string &strError)
+// {{{ append()
+void append(chain &outBuffer, const char *pData, size_t unSize)
 {
-  bool bResult = false;
-
-  if (gpRadial->ircChat(gstrRoom, strMessage, strError))
+  while (unSize > 0)
   {
-    bResult = true;
+    size_t unChunk;
+    if (outBuffer.blockList.empty() || outBuffer.blockList.back().size() >= CHAIN_BLOCK)
+    {
+      outBuffer.blockList.push_back(string());
+      outBuffer.blockList.back().reserve(CHAIN_BLOCK);
+    }
+    string &strBlock = outBuffer.blockList.back();
+    unChunk = min(unSize, CHAIN_BLOCK - strBlock.size());
+    strBlock.append(pData, unChunk);
+    outBuffer.unSize += unChunk;
+    pData += unChunk;
+    unSize -= unChunk;
   }
-  else
+}
+void append(chain &outBuffer, const string &strData)
+{
+  append(outBuffer, strData.data(), strData.size());
+}
+// }}}
+// {{{ appendString()
+void appendString(string &strBuffer, const string &strValue)
+{
+  appendVarint(strBuffer, strValue.size());
+  strBuffer += strValue;
+}
+// }}}
+// {{{ appendVarint()
+void appendVarint(string &strBuffer, unsigned long long ullValue)
+{
+  while (ullValue >= 0x80)
+  {
+    strBuffer += (char)((ullValue & 0x7f) | 0x80);
+    ullValue >>= 7;
+  }
+  strBuffer += (char)ullValue;
+}
+// }}}
+// {{{ clusterAccepts()
+bool clusterAccepts(const string &strServer)
+{
+  bool bResult = true;
+
+  if (gClusterList.size() > 1)
   {
-    notify((string)"Failed to chat the following message:  " + strMessage + (string)" --- " + strError, strError);
+    size_t unOwner = clusterOwner(strServer);
+    if (unOwner != gunNode)
+    {
+      bResult = ((unOwner + 1) % gClusterList.size() == gunNode && (time(NULL) - gCPeerSeen) > CLUSTER_TIMEOUT);
+    }
   }
 
   return bResult;
 }
 // }}}
-// {{{ notify()
-bool notify(const string strMessage, string &strError)
+// {{{ clusterHash()
+unsigned long long clusterHash(const string &strValue)
 {
-  bool bResult = false;
-  list<string> toList, ccList, bccList, fileList;
-  utsname tServer;
+  unsigned long long ullHash = 14695981039346656037ULL;
 
-  uname(&tServer);
-  toList.push_back(gstrEmail);
-  if (gpCentral->junction()->email((string)"root@"+(string)tServer.nodename, toList, ccList, bccList, gstrApplication, strMessage, "", fileList, strError))
+  for (size_t i = 0; i < strValue.size(); i++)
   {
-    bResult = true;
+    ullHash ^= (unsigned char)strValue[i];
+    ullHash *= 1099511628211ULL;
   }
-  toList.clear();
 
-  return bResult;
+  return ullHash;
 }
 // }}}
-// {{{ notifyApplicationContact()
-void notifyApplicationContact(const string strServer, const string strProcess)
+// {{{ clusterOwner()
+size_t clusterOwner(const string &strServer)
 {
-  if (gOverallList.find(strServer) != gOverallList.end() && gOverallList[strServer]->processList.find(strProcess) != gOverallList[strServer]->processList.end())
+  size_t unOwner = 0;
+
+  if (!gClusterRing.empty())
   {
-    struct utsname tServer;
-    list<string> toList, ccList, bccList, fileList, pageList;
-    string strError, strMessage = gOverallList[strServer]->processList[strProcess]->ssAlarms.str(), strSubject;
-    stringstream ssQuery;
-    uname(&tServer);
-    strSubject = ((!strServer.empty())?strServer:(string)tServer.nodename);
-    ssQuery << "select distinct c.id server_id, d.id application_contact_id, f.userid, f.email from application_server_detail a, application_server b, server c, application_contact d, contact_type e, person f where a.application_server_id=b.id and b.server_id=c.id and b.application_id=d.application_id and d.type_id=e.id and d.contact_id=f.id and a.daemon = '" << strProcess << "' and c.name = '" << strServer << "' and (e.type = 'Primary Developer' or e.type = 'Backup Developer' or e.type = 'Primary Contact')";
-    list<map<string, string> > *getApplicationContact = gpCentral->query("central", ssQuery.str(), strError);
-    if (getApplicationContact != NULL)
-    {
-      for (list<map<string, string> >::iterator getApplicationContactIter = getApplicationContact->begin(); getApplicationContactIter != getApplicationContact->end(); getApplicationContactIter++)
-      {
-        map<string, string> getApplicationContactRow = *getApplicationContactIter;
-        ssQuery.str("");
-        ssQuery << "select count(*) num_rows from application_server_contact where application_contact_id = " << getApplicationContactRow["application_contact_id"];
-        list<map<string, string> > *getApplicationServerContactCount = gpCentral->query("central", ssQuery.str(), strError);
-        if (getApplicationServerContactCount != NULL && !getApplicationServerContactCount->empty())
-        {
-          map<string, string> getApplicationServerContactCountRow = getApplicationServerContactCount->front();
-          if (atoi(getApplicationServerContactCountRow["num_rows"].c_str()) > 0)
-          {
-            ssQuery.str("");
-            ssQuery << "select b.* from application_server a, application_server_contact b where a.id=b.application_server_id and a.server_id = " << getApplicationContactRow["server_id"] << " and b.application_contact_id = " << getApplicationContactRow["application_contact_id"];
-            list<map<string, string> > *getApplicationServerContact = gpCentral->query("central", ssQuery.str(), strError);
-            if (getApplicationServerContact != NULL && !getApplicationServerContact->empty())
-            {
-              map<string, string> getApplicationServerContactRow = getApplicationServerContact->front();
-              toList.push_back(getApplicationContactRow["email"]);
-              if (gOverallList[strServer]->processList[strProcess]->bPage && gOverallList[strServer]->processList[strProcess]->strScript.empty())
-              {
-                if (!gpCentral->junction()->page(getApplicationContactRow["userid"], gstrApplication + (string)":  " + strSubject + (string)"\n\n" + strMessage, strError))
-                {
-                  stringstream ssError;
-                  ssError << "notifyApplicationContact()->central->junction()->page() error [" << strServer << "," << strProcess << "," << getApplicationContactRow["userid"] << "]:  " << strError;
-                  notify(ssError.str(), strError);
-                }
-              }
-            }
-            gpCentral->free(getApplicationServerContact);
-          }
-          else
-          {
-            toList.push_back(getApplicationContactRow["email"]);
-            if (gOverallList[strServer]->processList[strProcess]->bPage && gOverallList[strServer]->processList[strProcess]->strScript.empty())
-            {
-              if (!gpCentral->junction()->page(getApplicationContactRow["userid"], gstrApplication + (string)":  " + strSubject + (string)"\n\n" + strMessage, strError))
-              {
-                stringstream ssError;
-                ssError << "notifyApplicationContact()->central->junction()->page() error [" << strServer << "," << strProcess << "," << getApplicationContactRow["userid"] << "]:  " << strError;
-                notify(ssError.str(), strError);
-              }
-            }
-          }
-        }
-        gpCentral->free(getApplicationServerContactCount);
-      }
+    map<unsigned long long, size_t>::iterator ringIter = gClusterRing.lower_bound(clusterHash(strServer));
+    if (ringIter == gClusterRing.end())
+    {
+      ringIter = gClusterRing.begin();
     }
-    gpCentral->free(getApplicationContact);
-    if (!chat(strSubject + (string)":  " + strMessage, strError))
+    unOwner = ringIter->second;
+  }
+
+  return unOwner;
+}
+// }}}
+// {{{ clusterRedirect()
+string clusterRedirect(const string &strServer)
+{
+  size_t unOwner = clusterOwner(strServer);
+
+  return (string)"redirect " + gClusterList[unOwner] + (string)" " + gClusterList[(unOwner + 1) % gClusterList.size()] + (string)"\n";
+}
+// }}}
+// {{{ consume()
+void consume(chain &outBuffer, size_t unSize)
+{
+  outBuffer.unSize -= unSize;
+  while (unSize > 0 && !outBuffer.blockList.empty())
+  {
+    size_t unRemaining = outBuffer.blockList.front().size() - outBuffer.unOffset;
+    if (unSize >= unRemaining)
     {
-      stringstream ssError;
-      ssError << "notifyApplicationContact()->chat() error [" << strServer << "," << strProcess << "]:  " << strError;
-      notify(ssError.str(), strError);
+      outBuffer.blockList.pop_front();
+      outBuffer.unOffset = 0;
+      unSize -= unRemaining;
     }
-    if (!toList.empty())
+    else
     {
-      if (!gpCentral->junction()->email((string)"root@" + (string)tServer.nodename, toList, ccList, bccList, gstrApplication + (string)":  " + strSubject, strMessage, "", fileList, strError))
-      {
-        stringstream ssError;
-        ssError << "notifyApplicationContact()->central->junction()->email() error [" << strServer << "," << strProcess;
-        for (list<string>::iterator i = toList.begin(); i != toList.end(); i++)
-        {
-          ssError << "," << (*i);
-        }
-        ssError << "]:  " << strError;
-        notify(ssError.str(), strError);
-      }
+      outBuffer.unOffset += unSize;
+      unSize = 0;
     }
   }
 }
 // }}}
-// {{{ notifyServerContact()
-void notifyServerContact(const string strServer)
+// {{{ decodeProcess()
+bool decodeProcess(process *ptProcess, const field *ptField, string &strError)
 {
-  struct utsname tServer;
-  list<string> toList, ccList, bccList, fileList;
-  string strError, strMessage = gOverallList[strServer]->ssAlarms.str(), strSubject;
-  stringstream ssQuery;
+  bool bResult = true;
+  const char *szName[7] = {"processes", "image", "minimum image", "maximum image", "resident", "minimum resident", "maximum resident"};
+  unsigned long long ullValue[7];
+  map<string, unsigned int> ownerList;
 
-  uname(&tServer);
-  strSubject = ((!strServer.empty())?strServer:(string)tServer.nodename);
-  ssQuery << "select d.userid, d.email from server_contact a, server b, contact_type c, person d where a.server_id=b.id and a.type_id=c.id and a.contact_id=d.id and b.name = '" << strServer << "' and (c.type = 'Primary Admin' or c.type = 'Backup Admin' or c.type = 'Primary Contact') and a.notify = 1";
-  list<map<string, string> > *getServerContact = gpCentral->query("central", ssQuery.str(), strError);
-  if (getServerContact != NULL)
+  for (size_t i = 0; bResult && i < 7; i++)
+  {
+    if (!parseNumber(ptField[i + 4], ullValue[i]))
+    {
+      bResult = false;
+      strError = (string)"Malformed " + szName[i] + (string)" field.";
+    }
+  }
+  if (bResult)
   {
-    for (list<map<string, string> >::iterator getServerContactIter = getServerContact->begin(); getServerContactIter != getServerContact->end(); getServerContactIter++)
+    field tOwner[2], tOwners = ptField[3];
+    while (bResult && tOwners.unSize > 0)
     {
-      map<string, string> getServerContactRow = *getServerContactIter;
-      toList.push_back(getServerContactRow["email"]);
-      if (gOverallList[strServer]->bPage)
+      field tItem = tOwners;
+      const char *pComma = (const char *)memchr(tOwners.pData, ',', tOwners.unSize);
+      if (pComma != NULL)
       {
-        if (!gpCentral->junction()->page(getServerContactRow["userid"], gstrApplication + (string)":  " + strSubject + (string)"\n\n" + strMessage, strError))
+        tItem.unSize = pComma - tOwners.pData;
+        tOwners.unSize -= tItem.unSize + 1;
+        tOwners.pData = pComma + 1;
+      }
+      else
+      {
+        tOwners.unSize = 0;
+      }
+      if (tokenize(tItem.pData, tItem.unSize, '=', tOwner, 2) > 0 && tOwner[0].unSize > 0)
+      {
+        unsigned long long ullCount;
+        if (parseNumber(tOwner[1], ullCount))
         {
-          stringstream ssError;
-          ssError << "notifyServerContact()->central->junction()->page() error [" << strServer << "," << getServerContactRow["userid"] << "]:  " << strError;
-          notify(ssError.str(), strError);
+          ownerList[string(tOwner[0].pData, tOwner[0].unSize)] = (unsigned int)ullCount;
+        }
+        else
+        {
+          bResult = false;
+          strError = "Malformed owner field.";
         }
       }
     }
   }
-  gpCentral->free(getServerContact);
-  if (!chat(strSubject + (string)":  " + strMessage, strError))
+  if (bResult)
+  {
+    ptProcess->strStartTime.assign(ptField[2].pData, ptField[2].unSize);
+    ptProcess->owner.swap(ownerList);
+    ptProcess->nProcesses = (int)ullValue[0];
+    ptProcess->ulImage = ullValue[1];
+    ptProcess->ulRealMinImage = ullValue[2];
+    ptProcess->ulRealMaxImage = ullValue[3];
+    ptProcess->ulResident = ullValue[4];
+    ptProcess->ulRealMinResident = ullValue[5];
+    ptProcess->ulRealMaxResident = ullValue[6];
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ decodeSystem()
+bool decodeSystem(overall *ptOverall, const field *ptField, string &strError)
+{
+  bool bResult = true;
+  const char *szName[9] = {"processors", "CPU speed", "processes", "CPU usage", "uptime", "main memory used", "main memory total", "swap memory used", "swap memory total"};
+  unsigned long long ullValue[9];
+  field tCpu[2];
+  map<string, unsigned int> partitionList;
+
+  tokenize(ptField[6].pData, ptField[6].unSize, '|', tCpu, 2);
+  for (size_t i = 0; bResult && i < 9; i++)
   {
-    stringstream ssError;
-    ssError << "notifyServerContact()->chat() error [" << strServer << "]:  " << strError;
-    notify(ssError.str(), strError);
+    const field &tValue = ((i < 3)?ptField[i + 3]:((i == 3)?tCpu[0]:ptField[i + 3]));
+    if (!parseNumber(tValue, ullValue[i]))
+    {
+      bResult = false;
+      strError = (string)"Malformed " + szName[i] + (string)" field.";
+    }
   }
-  if (!toList.empty())
+  if (bResult)
   {
-    if (!gpCentral->junction()->email((string)"root@" + (string)tServer.nodename, toList, ccList, bccList, gstrApplication + (string)":  " + strSubject, strMessage, "", fileList, strError))
+    field tPartition[2], tPartitions = ptField[12];
+    while (bResult && tPartitions.unSize > 0)
     {
-      stringstream ssError;
-      ssError << "notifyServerContact()->central->junction()->email() error [" << strServer;
-      for (list<string>::iterator i = toList.begin(); i != toList.end(); i++)
+      field tItem = tPartitions;
+      const char *pComma = (const char *)memchr(tPartitions.pData, ',', tPartitions.unSize);
+      if (pComma != NULL)
+      {
+        tItem.unSize = pComma - tPartitions.pData;
+        tPartitions.unSize -= tItem.unSize + 1;
+        tPartitions.pData = pComma + 1;
+      }
+      else
       {
-        ssError << "," << (*i);
+        tPartitions.unSize = 0;
+      }
+      if (tokenize(tItem.pData, tItem.unSize, '=', tPartition, 2) > 0 && tPartition[0].unSize > 0)
+      {
+        unsigned long long ullPercent;
+        if (parseNumber(tPartition[1], ullPercent))
+        {
+          partitionList[string(tPartition[0].pData, tPartition[0].unSize)] = (unsigned int)ullPercent;
+        }
+        else
+        {
+          bResult = false;
+          strError = "Malformed partition field.";
+        }
       }
-      ssError << "]:  " << strError;
-      notify(ssError.str(), strError);
     }
   }
+  if (bResult)
+  {
+    ptOverall->strOperatingSystem.assign(ptField[1].pData, ptField[1].unSize);
+    ptOverall->strSystemRelease.assign(ptField[2].pData, ptField[2].unSize);
+    ptOverall->nProcessors = (int)ullValue[0];
+    ptOverall->unCpuSpeed = (unsigned int)ullValue[1];
+    ptOverall->usProcesses = (unsigned short)ullValue[2];
+    ptOverall->unCpuUsage = (unsigned int)ullValue[3];
+    ptOverall->strCpuProcessUsage.assign(tCpu[1].pData, tCpu[1].unSize);
+    ptOverall->lUpTime = (long)ullValue[4];
+    ptOverall->ulMainUsed = ullValue[5];
+    ptOverall->ulMainTotal = ullValue[6];
+    ptOverall->ulSwapUsed = ullValue[7];
+    ptOverall->ulSwapTotal = ullValue[8];
+    ptOverall->strPartitions.assign(ptField[12].pData, ptField[12].unSize);
+    ptOverall->partition.swap(partitionList);
+  }
+
+  return bResult;
 }
 // }}}
-// {{{ sighandle()
-void sighandle(const int nSignal)
+// {{{ deliver()
+bool deliver(notification *ptNotification, string &strError)
 {
-  list<string> dir;
-  string strError, strSignal;
-  stringstream ssSignal, ssCore;
+  bool bResult = false;
+  string strHeader = ptNotification->strSubject;
+  lock_guard<recursive_mutex> lockDelivery(gDeliveryMutex);
 
-  sethandles(sigdummy);
-  gbShutdown = true;
-  if (nSignal != SIGINT && nSignal != SIGTERM)
+  if (ptNotification->unCount > 1)
   {
-    ssSignal << nSignal;
-    notify((string)"The program's signal handling caught a " + (string)sigstring(strSignal, nSignal) + (string)"(" + ssSignal.str() + (string)")!  Exiting...", strError);
+    stringstream ssHeader;
+    ssHeader << ptNotification->unCount << " alarms";
+    strHeader = ssHeader.str();
+  }
+  if (ptNotification->strType == "chat")
+  {
+    bResult = gpRadial->ircChat(ptNotification->strRecipient, ptNotification->strSubject + (string)":  " + ptNotification->strMessage, strError);
   }
-  close(gfdStatus);
-  exit(1);
+  else if (ptNotification->strType == "email")
+  {
+    list<string> toList, ccList, bccList, fileList;
+    utsname tServer;
+    uname(&tServer);
+    toList.push_back(ptNotification->strRecipient);
+    bResult = gpCentral->junction()->email((string)"root@" + (string)tServer.nodename, toList, ccList, bccList, gstrApplication + (string)":  " + strHeader, ptNotification->strMessage, "", fileList, strError);
+  }
+  else if (ptNotification->strType == "page")
+  {
+    bResult = gpCentral->junction()->page(ptNotification->strRecipient, gstrApplication + (string)":  " + strHeader + (string)"\n\n" + ptNotification->strMessage, strError);
+  }
+  else
+  {
+    strError = (string)"Invalid notification type [" + ptNotification->strType + (string)"].";
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ enqueue()
+bool enqueue(notification *ptNotification)
+{
+  bool bResult = true;
+  map<string, notification *>::iterator iter;
+  string strKey;
+  lock_guard<mutex> lockNotification(gNotificationMutex);
+
+  // Chat lines stay one per alarm while emails and pages are coalesced per recipient.
+  if (ptNotification->strType == "email" || ptNotification->strType == "page")
+  {
+    strKey = ptNotification->strType + (string)"\n" + ptNotification->strRecipient;
+  }
+  if (!strKey.empty() && (iter = gNotificationPending.find(strKey)) != gNotificationPending.end())
+  {
+    notification *ptPending = iter->second;
+    if (ptPending->unCount++ == 1)
+    {
+      ptPending->strMessage = ptPending->strSubject + (string)":  " + ptPending->strMessage;
+    }
+    ptPending->strMessage += (string)"\n\n" + ptNotification->strSubject + (string)":  " + ptNotification->strMessage;
+    gNotificationStats.ullCoalesced++;
+    delete ptNotification;
+  }
+  else if (gNotificationQueue.size() < NOTIFY_QUEUE)
+  {
+    gNotificationQueue.push_back(ptNotification);
+    if (!strKey.empty())
+    {
+      gNotificationPending[strKey] = ptNotification;
+    }
+    gNotificationStats.ullQueued++;
+    if (gNotificationQueue.size() > gNotificationStats.unMaxDepth)
+    {
+      gNotificationStats.unMaxDepth = gNotificationQueue.size();
+    }
+    gNotificationCondition.notify_one();
+  }
+  else
+  {
+    bResult = false;
+    gNotificationStats.ullDropped++;
+    delete ptNotification;
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ handoff()
+void handoff(shard *ptShard, connection *ptConnection)
+{
+  char cWake = 'w';
+  lock_guard<mutex> lockQueue(ptShard->mutexQueue);
+
+  ptShard->queue.push_back(ptConnection);
+  write(ptShard->fdWake[1], &cWake, 1);
+}
+// }}}
+// {{{ handshake()
+int handshake(SSL_CTX *ctx, connection *ptConnection)
+{
+  int nState = 0;
+
+  if (ptConnection->eSocketType == COMMON_SOCKET_UNKNOWN)
+  {
+    ssize_t nPeek;
+    unsigned char ucType;
+    if ((nPeek = recv(ptConnection->fdData, &ucType, 1, MSG_PEEK)) == 1)
+    {
+      // A TLS connection opens with a handshake record.
+      if (ucType == 0x16)
+      {
+        ptConnection->eSocketType = COMMON_SOCKET_ENCRYPTED;
+        if ((ptConnection->ssl = SSL_new(ctx)) != NULL && SSL_set_fd(ptConnection->ssl, ptConnection->fdData) == 1)
+        {
+          SSL_set_accept_state(ptConnection->ssl);
+          SSL_set_mode(ptConnection->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        }
+        else
+        {
+          nState = -1;
+        }
+      }
+      else
+      {
+        ptConnection->eSocketType = COMMON_SOCKET_UNENCRYPTED;
+        nState = 1;
+      }
+    }
+    else if (nPeek == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+      nState = -1;
+    }
+  }
+  if (nState == 0 && ptConnection->eSocketType == COMMON_SOCKET_ENCRYPTED)
+  {
+    int nReturn;
+    if ((nReturn = SSL_do_handshake(ptConnection->ssl)) == 1)
+    {
+      nState = 1;
+      gullHandshakes++;
+      if (SSL_session_reused(ptConnection->ssl))
+      {
+        gullResumed++;
+      }
+    }
+    else
+    {
+      int nError = SSL_get_error(ptConnection->ssl, nReturn);
+      if (nError == SSL_ERROR_WANT_READ)
+      {
+        ptConnection->sWait = POLLIN;
+      }
+      else if (nError == SSL_ERROR_WANT_WRITE)
+      {
+        ptConnection->sWait = POLLOUT;
+      }
+      else
+      {
+        nState = -1;
+      }
+    }
+  }
+
+  return nState;
+}
+// }}}
+// {{{ handshaker()
+void handshaker(shard *ptStage, SSL_CTX *ctx)
+{
+  size_t unNext = ptStage->unIndex;
+  string strError;
+  list<connection *> adoptList, pendingList;
+  vector<connection *> fdConnection;
+  vector<pollfd> fds;
+
+  while (!gbShutdown)
+  {
+    int nReturn;
+    size_t unIndex = 0;
+    time_t CTime;
+    // {{{ adopt queued connections
+    ptStage->mutexQueue.lock();
+    adoptList.splice(adoptList.end(), ptStage->queue);
+    ptStage->mutexQueue.unlock();
+    while (!adoptList.empty())
+    {
+      adoptList.front()->iterBridge = pendingList.insert(pendingList.end(), adoptList.front());
+      adoptList.pop_front();
+    }
+    // }}}
+    // {{{ wait for events
+    fds.resize(pendingList.size() + 1);
+    fdConnection.resize(pendingList.size() + 1);
+    fds[unIndex].fd = ptStage->fdWake[0];
+    fds[unIndex].events = POLLIN;
+    fdConnection[unIndex] = NULL;
+    unIndex++;
+    for (list<connection *>::iterator i = pendingList.begin(); i != pendingList.end(); i++)
+    {
+      fds[unIndex].fd = (*i)->fdData;
+      fds[unIndex].events = (*i)->sWait;
+      fdConnection[unIndex] = *i;
+      unIndex++;
+    }
+    if ((nReturn = poll(&fds[0], unIndex, 250)) > 0)
+    {
+      if (fds[0].revents & POLLIN)
+      {
+        char szBuffer[64];
+        while (read(ptStage->fdWake[0], szBuffer, sizeof(szBuffer)) > 0);
+      }
+    }
+    else if (nReturn < 0 && errno != EINTR)
+    {
+      gbShutdown = true;
+      notify((string)"Poll error: " + strerror(errno), strError);
+    }
+    // }}}
+    // {{{ advance handshakes
+    time(&CTime);
+    for (size_t i = 1; i < unIndex; i++)
+    {
+      connection *ptConnection = fdConnection[i];
+      int nState = 0;
+      if (nReturn > 0 && fds[i].revents)
+      {
+        nState = handshake(ctx, ptConnection);
+      }
+      if (nState == 0 && (CTime - ptConnection->CStartTime) > HANDSHAKE_TIMEOUT)
+      {
+        nState = -1;
+      }
+      if (nState != 0)
+      {
+        map<string, size_t>::iterator sourceIter;
+        pendingList.erase(ptConnection->iterBridge);
+        gHandshakeMutex.lock();
+        if ((sourceIter = gHandshakeSourceList.find(ptConnection->strSource)) != gHandshakeSourceList.end() && --(sourceIter->second) == 0)
+        {
+          gHandshakeSourceList.erase(sourceIter);
+        }
+        gHandshakeMutex.unlock();
+        if (nState > 0)
+        {
+          handoff(gShardList[unNext++ % gShardList.size()], ptConnection);
+        }
+        else
+        {
+          gullHandshakeFailed++;
+          if (ptConnection->ssl != NULL)
+          {
+            SSL_free(ptConnection->ssl);
+          }
+          close(ptConnection->fdData);
+          delete ptConnection;
+        }
+      }
+    }
+    // }}}
+  }
+  for (list<connection *>::iterator i = pendingList.begin(); i != pendingList.end(); i++)
+  {
+    if ((*i)->ssl != NULL)
+    {
+      SSL_free((*i)->ssl);
+    }
+    close((*i)->fdData);
+    delete *i;
+  }
+  pendingList.clear();
+}
+// }}}
+// {{{ historian()
+void historian()
+{
+  bool bExit = false;
+  time_t CPruned = 0;
+
+  while (!bExit)
+  {
+    map<string, string> segmentList;
+    time_t CTime;
+    {
+      unique_lock<mutex> lockHistory(gHistoryMutex);
+      if (!gbShutdown)
+      {
+        gHistoryCondition.wait_for(lockHistory, chrono::seconds(60));
+      }
+    }
+    bExit = gbShutdown;
+    // Queries note the segment sizes and buffered samples under the segment lock so samples are never missing or doubled between memory and disk.
+    lock_guard<mutex> lockSegment(gHistorySegmentMutex);
+    gHistoryMutex.lock();
+    time(&CTime);
+    for (map<string, map<string, history> >::iterator i = gHistoryList.begin(); i != gHistoryList.end();)
+    {
+      for (map<string, history>::iterator j = i->second.begin(); j != i->second.end();)
+      {
+        history &tHistory = j->second;
+        if (bExit || tHistory.timeList.size() >= HISTORY_BLOCK || (!tHistory.timeList.empty() && (CTime - tHistory.timeList.front()) >= HISTORY_FLUSH))
+        {
+          size_t unBegin = 0;
+          // Blocks never span days so each lands in its own daily segment.
+          for (size_t k = 1; k <= tHistory.timeList.size(); k++)
+          {
+            if (k == tHistory.timeList.size() || (tHistory.timeList[k] / 86400) != (tHistory.timeList[unBegin] / 86400))
+            {
+              historyEncode(segmentList[historySegment(tHistory.timeList[unBegin], i->first)], i->first, j->first, tHistory, unBegin, k);
+              unBegin = k;
+            }
+          }
+          i->second.erase(j++);
+        }
+        else
+        {
+          j++;
+        }
+      }
+      if (i->second.empty())
+      {
+        gHistoryList.erase(i++);
+      }
+      else
+      {
+        i++;
+      }
+    }
+    // {{{ expire rollups
+    for (map<string, map<string, summary> >::iterator i = gSummaryList.begin(); i != gSummaryList.end();)
+    {
+      for (map<string, summary>::iterator j = i->second.begin(); j != i->second.end();)
+      {
+        if ((CTime - j->second.CLast) >= (time_t)(gCRollupWidth[ROLLUP_TIERS - 1] * gunRollupSlots[ROLLUP_TIERS - 1]))
+        {
+          i->second.erase(j++);
+        }
+        else
+        {
+          j++;
+        }
+      }
+      if (i->second.empty())
+      {
+        gSummaryList.erase(i++);
+      }
+      else
+      {
+        i++;
+      }
+    }
+    // }}}
+    gHistoryMutex.unlock();
+    for (map<string, string>::iterator i = segmentList.begin(); i != segmentList.end(); i++)
+    {
+      mkdir(i->first.substr(0, i->first.rfind('/')).c_str(), 0755);
+      ofstream outSegment(i->first.c_str(), ios::out|ios::app|ios::binary);
+      if (outSegment.good())
+      {
+        outSegment.write(i->second.data(), i->second.size());
+      }
+      outSegment.close();
+    }
+    segmentList.clear();
+    if ((CTime / 86400) != (CPruned / 86400))
+    {
+      CPruned = CTime;
+      historyPrune(CTime);
+    }
+  }
+}
+// }}}
+// {{{ historyAnswer()
+void historyAnswer(historyquery *ptQuery)
+{
+  map<time_t, rollup> bucketList;
+  time_t CTime;
+
+  // Nothing is recorded past the present, so a far future end only widens the range.
+  if (ptQuery->CTo > time(&CTime))
+  {
+    ptQuery->CTo = max(ptQuery->CFrom, CTime);
+  }
+  if (ptQuery->CStep <= 0)
+  {
+    ptQuery->CStep = max((time_t)1, (ptQuery->CTo - ptQuery->CFrom) / HISTORY_POINTS);
+  }
+  ptQuery->CStep = max(ptQuery->CStep, ((ptQuery->CTo - ptQuery->CFrom) / HISTORY_BUCKETS) + 1);
+  if (!historyRollup(ptQuery->strServer, ptQuery->strMetric, ptQuery->CFrom, ptQuery->CTo, ptQuery->CStep, bucketList))
+  {
+    list<pair<time_t, unsigned long long> > pointList;
+    historyQuery(ptQuery->strServer, ptQuery->strMetric, ptQuery->CFrom, ptQuery->CTo, pointList);
+    for (list<pair<time_t, unsigned long long> >::iterator i = pointList.begin(); i != pointList.end(); i++)
+    {
+      time_t CBucket = ptQuery->CFrom + ((i->first - ptQuery->CFrom) / ptQuery->CStep) * ptQuery->CStep;
+      map<time_t, rollup>::iterator bucketIter = bucketList.find(CBucket);
+      if (bucketIter == bucketList.end())
+      {
+        rollup tRollup = {0, 1, i->second, i->second, i->second};
+        bucketList[CBucket] = tRollup;
+      }
+      else
+      {
+        bucketIter->second.unCount++;
+        bucketIter->second.ullMaximum = max(bucketIter->second.ullMaximum, i->second);
+        bucketIter->second.ullMinimum = min(bucketIter->second.ullMinimum, i->second);
+        bucketIter->second.ullSum += i->second;
+      }
+    }
+    pointList.clear();
+  }
+  for (map<time_t, rollup>::iterator i = bucketList.begin(); i != bucketList.end(); i++)
+  {
+    stringstream ssDetails;
+    ssDetails << i->first << ';' << (i->second.ullSum / i->second.unCount) << ';' << i->second.ullMinimum << ';' << i->second.ullMaximum << endl;
+    ptQuery->strResponse.append(ssDetails.str());
+  }
+  bucketList.clear();
+}
+// }}}
+// {{{ historyCancel()
+void historyCancel(connection *ptConnection)
+{
+  lock_guard<mutex> lockQuery(gHistoryQueryMutex);
+
+  ptConnection->ptHistory->ptConnection = NULL;
+  ptConnection->ptHistory = NULL;
+}
+// }}}
+// {{{ historyDecode()
+void historyDecode(field tBlock, const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, list<pair<time_t, unsigned long long> > &pointList)
+{
+  field tMetric, tServer;
+  unsigned long long ullCount;
+
+  if (readString(tBlock, tServer) && tServer.unSize == strServer.size() && strServer.compare(0, string::npos, tServer.pData, tServer.unSize) == 0 && readString(tBlock, tMetric) && tMetric.unSize == strMetric.size() && strMetric.compare(0, string::npos, tMetric.pData, tMetric.unSize) == 0 && readVarint(tBlock, ullCount) && ullCount > 0 && ullCount <= tBlock.unSize)
+  {
+    bool bValid = true;
+    long long llDelta = 0;
+    unsigned long long ullValue = 0;
+    vector<time_t> timeList(ullCount);
+    for (size_t i = 0; bValid && i < ullCount; i++)
+    {
+      if (readVarint(tBlock, ullValue))
+      {
+        if (i == 0)
+        {
+          timeList[i] = (time_t)ullValue;
+        }
+        else
+        {
+          llDelta += (long long)(ullValue >> 1) ^ -(long long)(ullValue & 1);
+          timeList[i] = timeList[i - 1] + (time_t)llDelta;
+        }
+      }
+      else
+      {
+        bValid = false;
+      }
+    }
+    for (size_t i = 0; bValid && i < ullCount; i++)
+    {
+      unsigned long long ullXor;
+      if (readVarint(tBlock, ullXor))
+      {
+        ullValue = ((i == 0)?ullXor:(ullValue ^ ullXor));
+        if (timeList[i] >= CFrom && timeList[i] <= CTo)
+        {
+          pointList.push_back(make_pair(timeList[i], ullValue));
+        }
+      }
+      else
+      {
+        bValid = false;
+      }
+    }
+  }
+}
+// }}}
+// {{{ historyEncode()
+void historyEncode(string &strSegment, const string &strServer, const string &strMetric, const history &tHistory, const size_t unBegin, const size_t unEnd)
+{
+  long long llDelta = 0;
+  string strBlock;
+
+  appendString(strBlock, strServer);
+  appendString(strBlock, strMetric);
+  appendVarint(strBlock, unEnd - unBegin);
+  appendVarint(strBlock, tHistory.timeList[unBegin]);
+  for (size_t i = unBegin + 1; i < unEnd; i++)
+  {
+    long long llNext = (long long)(tHistory.timeList[i] - tHistory.timeList[i - 1]), llDelta2 = llNext - llDelta;
+    appendVarint(strBlock, ((unsigned long long)llDelta2 << 1) ^ (unsigned long long)(llDelta2 >> 63));
+    llDelta = llNext;
+  }
+  appendVarint(strBlock, tHistory.valueList[unBegin]);
+  for (size_t i = unBegin + 1; i < unEnd; i++)
+  {
+    appendVarint(strBlock, tHistory.valueList[i] ^ tHistory.valueList[i - 1]);
+  }
+  appendVarint(strSegment, strBlock.size());
+  strSegment += strBlock;
+}
+// }}}
+// {{{ historyPrune()
+void historyPrune(const time_t CTime)
+{
+  char szCutoff[9] = "\0";
+  time_t CCutoff = CTime - (time_t)(gunHistoryRetention * 86400);
+  struct tm tTime;
+  DIR *pDir;
+
+  gmtime_r(&CCutoff, &tTime);
+  strftime(szCutoff, sizeof(szCutoff), "%Y%m%d", &tTime);
+  if ((pDir = opendir(gstrHistory.c_str())) != NULL)
+  {
+    struct dirent *ptEntry;
+    list<string> expiredList;
+    while ((ptEntry = readdir(pDir)) != NULL)
+    {
+      string strEntry = ptEntry->d_name;
+      // Day directories are named by their date.
+      if (strEntry.size() == 8 && strEntry.find_first_not_of("0123456789") == string::npos && strEntry < szCutoff)
+      {
+        expiredList.push_back(gstrHistory + (string)"/" + strEntry);
+      }
+    }
+    closedir(pDir);
+    for (list<string>::iterator i = expiredList.begin(); i != expiredList.end(); i++)
+    {
+      DIR *pDay;
+      if ((pDay = opendir(i->c_str())) != NULL)
+      {
+        struct dirent *ptSegment;
+        while ((ptSegment = readdir(pDay)) != NULL)
+        {
+          if (strcmp(ptSegment->d_name, ".") != 0 && strcmp(ptSegment->d_name, "..") != 0)
+          {
+            unlink((*i + (string)"/" + ptSegment->d_name).c_str());
+          }
+        }
+        closedir(pDay);
+        rmdir(i->c_str());
+      }
+    }
+  }
+}
+// }}}
+// {{{ historyQuery()
+void historyQuery(const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, list<pair<time_t, unsigned long long> > &pointList)
+{
+  list<pair<string, off_t> > segmentList;
+  list<pair<time_t, unsigned long long> > bufferList;
+
+  // {{{ note segment sizes and buffered samples
+  // Segments are only appended to under the segment lock, so reading each up to its noted size afterwards sees every sample exactly once.
+  {
+    lock_guard<mutex> lockSegment(gHistorySegmentMutex);
+    for (time_t CDay = CFrom - (CFrom % 86400); CDay <= CTo; CDay += 86400)
+    {
+      string strSegment = historySegment(CDay, strServer);
+      struct stat tStat;
+      if (stat(strSegment.c_str(), &tStat) == 0 && tStat.st_size > 0)
+      {
+        segmentList.push_back(make_pair(strSegment, tStat.st_size));
+      }
+    }
+    lock_guard<mutex> lockHistory(gHistoryMutex);
+    map<string, map<string, history> >::iterator serverIter = gHistoryList.find(strServer);
+    if (serverIter != gHistoryList.end())
+    {
+      map<string, history>::iterator metricIter = serverIter->second.find(strMetric);
+      if (metricIter != serverIter->second.end())
+      {
+        for (size_t i = 0; i < metricIter->second.timeList.size(); i++)
+        {
+          if (metricIter->second.timeList[i] >= CFrom && metricIter->second.timeList[i] <= CTo)
+          {
+            bufferList.push_back(make_pair(metricIter->second.timeList[i], metricIter->second.valueList[i]));
+          }
+        }
+      }
+    }
+  }
+  // }}}
+  for (list<pair<string, off_t> >::iterator i = segmentList.begin(); i != segmentList.end(); i++)
+  {
+    ifstream inSegment(i->first.c_str(), ios::in|ios::binary);
+    if (inSegment.good())
+    {
+      field tData;
+      string strSegment((size_t)i->second, '\0');
+      inSegment.read(&strSegment[0], i->second);
+      strSegment.resize((size_t)inSegment.gcount());
+      tData.pData = strSegment.data();
+      tData.unSize = strSegment.size();
+      while (tData.unSize > 0)
+      {
+        field tBlock;
+        unsigned long long ullSize;
+        if (readVarint(tData, ullSize) && ullSize <= tData.unSize)
+        {
+          tBlock.pData = tData.pData;
+          tBlock.unSize = ullSize;
+          tData.pData += ullSize;
+          tData.unSize -= ullSize;
+          historyDecode(tBlock, strServer, strMetric, CFrom, CTo, pointList);
+        }
+        else
+        {
+          tData.unSize = 0;
+        }
+      }
+    }
+    inSegment.close();
+  }
+  pointList.splice(pointList.end(), bufferList);
+}
+// }}}
+// {{{ historyRecord()
+void historyRecord(const string &strServer, const list<pair<string, unsigned long long> > &metricList)
+{
+  if (!gstrHistory.empty())
+  {
+    time_t CTime;
+    lock_guard<mutex> lockHistory(gHistoryMutex);
+    map<string, history> &seriesList = gHistoryList[strServer];
+    map<string, summary> &summaryList = gSummaryList[strServer];
+    time(&CTime);
+    for (list<pair<string, unsigned long long> >::const_iterator i = metricList.begin(); i != metricList.end(); i++)
+    {
+      history &tHistory = seriesList[i->first];
+      summary &tSummary = summaryList[i->first];
+      size_t unOffset = 0;
+      tHistory.timeList.push_back(CTime);
+      tHistory.valueList.push_back(i->second);
+      if (tHistory.timeList.size() == HISTORY_BLOCK)
+      {
+        gHistoryCondition.notify_one();
+      }
+      // {{{ rollups
+      if (tSummary.rollupList.empty())
+      {
+        rollup tEmpty = {0, 0, 0, 0, 0};
+        tSummary.CSince = CTime;
+        for (size_t j = 0; j < ROLLUP_TIERS; j++)
+        {
+          tSummary.rollupList.resize(tSummary.rollupList.size() + gunRollupSlots[j], tEmpty);
+        }
+      }
+      tSummary.CLast = CTime;
+      for (size_t j = 0; j < ROLLUP_TIERS; j++)
+      {
+        unsigned int unBucket = (unsigned int)(CTime / gCRollupWidth[j]);
+        rollup &tRollup = tSummary.rollupList[unOffset + (unBucket % gunRollupSlots[j])];
+        if (tRollup.unBucket != unBucket || tRollup.unCount == 0)
+        {
+          tRollup.unBucket = unBucket;
+          tRollup.unCount = 0;
+          tRollup.ullMaximum = i->second;
+          tRollup.ullMinimum = i->second;
+          tRollup.ullSum = 0;
+        }
+        tRollup.unCount++;
+        tRollup.ullMaximum = max(tRollup.ullMaximum, i->second);
+        tRollup.ullMinimum = min(tRollup.ullMinimum, i->second);
+        tRollup.ullSum += i->second;
+        unOffset += gunRollupSlots[j];
+      }
+      // }}}
+    }
+  }
+}
+// }}}
+// {{{ historyResponder()
+void historyResponder()
+{
+  bool bExit = false;
+
+  while (!bExit)
+  {
+    historyquery *ptQuery = NULL;
+    {
+      unique_lock<mutex> lockQuery(gHistoryQueryMutex);
+      if (gHistoryQueryList.empty() && !gbShutdown)
+      {
+        gHistoryQueryCondition.wait_for(lockQuery, chrono::seconds(1));
+      }
+      if (gbShutdown)
+      {
+        bExit = true;
+      }
+      else if (!gHistoryQueryList.empty())
+      {
+        ptQuery = gHistoryQueryList.front();
+        gHistoryQueryList.pop_front();
+      }
+    }
+    if (ptQuery != NULL)
+    {
+      historyAnswer(ptQuery);
+      lock_guard<mutex> lockQuery(gHistoryQueryMutex);
+      if (ptQuery->ptConnection != NULL)
+      {
+        bool bWake = ptQuery->ptShard->historyList.empty();
+        ptQuery->ptShard->historyList.push_back(ptQuery);
+        if (bWake)
+        {
+          char cWake = 'h';
+          write(ptQuery->ptShard->fdWake[1], &cWake, 1);
+        }
+      }
+      else
+      {
+        delete ptQuery;
+      }
+    }
+  }
+}
+// }}}
+// {{{ historyRollup()
+bool historyRollup(const string &strServer, const string &strMetric, const time_t CFrom, const time_t CTo, const time_t CStep, map<time_t, rollup> &bucketList)
+{
+  bool bResult = false;
+  lock_guard<mutex> lockHistory(gHistoryMutex);
+  map<string, map<string, summary> >::iterator serverIter = gSummaryList.find(strServer);
+
+  if (serverIter != gSummaryList.end())
+  {
+    map<string, summary>::iterator metricIter = serverIter->second.find(strMetric);
+    if (metricIter != serverIter->second.end())
+    {
+      summary &tSummary = metricIter->second;
+      size_t unOffset = tSummary.rollupList.size();
+      for (size_t i = ROLLUP_TIERS; !bResult && i-- > 0;)
+      {
+        unsigned int unLast = (unsigned int)(tSummary.CLast / gCRollupWidth[i]);
+        unOffset -= gunRollupSlots[i];
+        // Rollups only start when this process first saw the series, so older ranges fall back to the segments.
+        if (gCRollupWidth[i] <= CStep && (CFrom / gCRollupWidth[i]) + gunRollupSlots[i] > unLast && (tSummary.CSince / gCRollupWidth[i]) <= (CFrom / gCRollupWidth[i]))
+        {
+          bResult = true;
+          for (size_t j = 0; j < gunRollupSlots[i]; j++)
+          {
+            rollup &tRollup = tSummary.rollupList[unOffset + j];
+            time_t CStart = (time_t)tRollup.unBucket * gCRollupWidth[i];
+            if (tRollup.unCount > 0 && tRollup.unBucket + gunRollupSlots[i] > unLast && CStart + gCRollupWidth[i] > CFrom && CStart <= CTo)
+            {
+              time_t CBucket = CFrom + ((max(CStart, CFrom) - CFrom) / CStep) * CStep;
+              map<time_t, rollup>::iterator bucketIter = bucketList.find(CBucket);
+              if (bucketIter == bucketList.end())
+              {
+                bucketList[CBucket] = tRollup;
+              }
+              else
+              {
+                bucketIter->second.unCount += tRollup.unCount;
+                bucketIter->second.ullMaximum = max(bucketIter->second.ullMaximum, tRollup.ullMaximum);
+                bucketIter->second.ullMinimum = min(bucketIter->second.ullMinimum, tRollup.ullMinimum);
+                bucketIter->second.ullSum += tRollup.ullSum;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ historySegment()
+string historySegment(const time_t CTime, const string &strServer)
+{
+  char szDay[9] = "\0";
+  stringstream ssFile;
+  struct tm tTime;
+
+  gmtime_r(&CTime, &tTime);
+  strftime(szDay, sizeof(szDay), "%Y%m%d", &tTime);
+  // Anything but the characters of a host name is escaped so that a server name can never leave the day directory.
+  for (size_t i = 0; i < strServer.size(); i++)
+  {
+    if (isalnum((unsigned char)strServer[i]) || strServer[i] == '-' || strServer[i] == '_' || (strServer[i] == '.' && i > 0))
+    {
+      ssFile << strServer[i];
+    }
+    else
+    {
+      ssFile << '%' << hex << uppercase << setw(2) << setfill('0') << (unsigned int)(unsigned char)strServer[i] << dec;
+    }
+  }
+
+  return gstrHistory + (string)"/" + (string)szDay + (string)"/" + ssFile.str() + (string)".seg";
+}
+// }}}
+// {{{ lines()
+void lines(shard *ptShard, connection *ptConnection, bool &bSync)
+{
+  bool bWaiting = false;
+  string strLine;
+
+  // Further requests wait behind a pending history query so that responses stay in order.
+  while (!bWaiting && !ptConnection->bClose && ptConnection->ptHistory == NULL && (!ptConnection->bClient || shardIndex(ptConnection->strServer) == ptShard->unIndex) && ptConnection->unBuffer < ptConnection->strBuffer.size())
+  {
+    const char *pStart = ptConnection->strBuffer.data() + ptConnection->unBuffer, *pEnd;
+    size_t unAvailable = ptConnection->strBuffer.size() - ptConnection->unBuffer;
+    // {{{ binary frame
+    if (((ptConnection->bClient && ptConnection->nProtocol >= 2) || ptConnection->bRelay || ptConnection->bReplica) && *pStart == FRAME_MARKER)
+    {
+      field tFrame;
+      unsigned long long ullSize;
+      tFrame.pData = pStart + 1;
+      tFrame.unSize = unAvailable - 1;
+      if (!readVarint(tFrame, ullSize))
+      {
+        if (tFrame.unSize >= 10)
+        {
+          ptConnection->bClose = true;
+          malformed(ptConnection, "frame", "Malformed frame length.");
+        }
+        else
+        {
+          bWaiting = true;
+        }
+      }
+      else if (ullSize > FRAME_MAX)
+      {
+        ptConnection->bClose = true;
+        malformed(ptConnection, "frame", "Frame exceeds the maximum size.");
+      }
+      else if (tFrame.unSize < ullSize)
+      {
+        bWaiting = true;
+      }
+      else if (ptConnection->bRelay)
+      {
+        tFrame.unSize = ullSize;
+        ptConnection->unBuffer += (tFrame.pData - pStart) + ullSize;
+        readRelay(ptConnection, tFrame);
+      }
+      else if (ptConnection->bReplica)
+      {
+        tFrame.unSize = ullSize;
+        ptConnection->unBuffer += (tFrame.pData - pStart) + ullSize;
+        readReplica(ptConnection, tFrame);
+      }
+      else
+      {
+        lock_guard<mutex> lockValues(ptConnection->ptOverall->mutexOverall);
+        tFrame.unSize = ullSize;
+        ptConnection->unBuffer += (tFrame.pData - pStart) + ullSize;
+        readFrame(ptConnection, tFrame);
+      }
+    }
+    // }}}
+    // {{{ text line
+    else if ((pEnd = (const char *)memchr(pStart, '\n', unAvailable)) != NULL)
+    {
+      strLine.assign(pStart, pEnd - pStart);
+      ptConnection->unBuffer += (pEnd - pStart) + 1;
+      if (ptConnection->bClient)
+      {
+        lock_guard<mutex> lockValues(ptConnection->ptOverall->mutexOverall);
+        readClient(ptConnection, strLine);
+      }
+      else
+      {
+        readQuery(ptShard, ptConnection, strLine, bSync);
+      }
+    }
+    // }}}
+    else
+    {
+      bWaiting = true;
+    }
+  }
+  // Consumed input is discarded in one step rather than once per line.
+  if (ptConnection->unBuffer == ptConnection->strBuffer.size())
+  {
+    ptConnection->strBuffer.clear();
+    ptConnection->unBuffer = 0;
+  }
+  else if (ptConnection->unBuffer > 0 && ptConnection->unBuffer >= ptConnection->strBuffer.size() / 2)
+  {
+    ptConnection->strBuffer.erase(0, ptConnection->unBuffer);
+    ptConnection->unBuffer = 0;
+  }
+}
+// }}}
+// {{{ loadContacts()
+void loadContacts()
+{
+  list<map<string, string> > *getApplicationContact, *getApplicationServerContact, *getServerContact;
+  map<string, list<contact> > serverContactList;
+  map<string, map<string, list<contact> > > applicationContactList;
+  map<string, map<string, bool> > restricted;
+  string strError;
+  bool bLoaded;
+
+  gCentralMutex.lock();
+  getServerContact = gpCentral->query("central", "select distinct b.name server, d.userid, d.email from server_contact a, server b, contact_type c, person d where a.server_id=b.id and a.type_id=c.id and a.contact_id=d.id and (c.type = 'Primary Admin' or c.type = 'Backup Admin' or c.type = 'Primary Contact') and a.notify = 1", strError);
+  getApplicationContact = gpCentral->query("central", "select distinct a.daemon, c.name server, c.id server_id, d.id application_contact_id, f.userid, f.email from application_server_detail a, application_server b, server c, application_contact d, contact_type e, person f where a.application_server_id=b.id and b.server_id=c.id and b.application_id=d.application_id and d.type_id=e.id and d.contact_id=f.id and a.daemon is not null and a.daemon != '' and (e.type = 'Primary Developer' or e.type = 'Backup Developer' or e.type = 'Primary Contact')", strError);
+  getApplicationServerContact = gpCentral->query("central", "select distinct b.application_contact_id, a.server_id from application_server a, application_server_contact b where a.id=b.application_server_id", strError);
+  gCentralMutex.unlock();
+  bLoaded = (getServerContact != NULL && getApplicationContact != NULL && getApplicationServerContact != NULL);
+  if (bLoaded)
+  {
+    for (list<map<string, string> >::iterator i = getServerContact->begin(); i != getServerContact->end(); i++)
+    {
+      contact tContact;
+      tContact.strEmail = (*i)["email"];
+      tContact.strUserID = (*i)["userid"];
+      serverContactList[(*i)["server"]].push_back(tContact);
+    }
+    // Contacts with server assignments only apply to the servers they are assigned to.
+    for (list<map<string, string> >::iterator i = getApplicationServerContact->begin(); i != getApplicationServerContact->end(); i++)
+    {
+      restricted[(*i)["application_contact_id"]][(*i)["server_id"]] = true;
+    }
+    for (list<map<string, string> >::iterator i = getApplicationContact->begin(); i != getApplicationContact->end(); i++)
+    {
+      map<string, map<string, bool> >::iterator restrictedIter = restricted.find((*i)["application_contact_id"]);
+      if (restrictedIter == restricted.end() || restrictedIter->second.find((*i)["server_id"]) != restrictedIter->second.end())
+      {
+        contact tContact;
+        tContact.strEmail = (*i)["email"];
+        tContact.strUserID = (*i)["userid"];
+        applicationContactList[(*i)["server"]][(*i)["daemon"]].push_back(tContact);
+      }
+    }
+  }
+  gpCentral->free(getServerContact);
+  gpCentral->free(getApplicationContact);
+  gpCentral->free(getApplicationServerContact);
+  // Keep the previous index when the database is unavailable.
+  if (bLoaded)
+  {
+    unique_lock<shared_timed_mutex> lockContact(gContactMutex);
+    gServerContactList.swap(serverContactList);
+    gApplicationContactList.swap(applicationContactList);
+  }
+}
+// }}}
+// {{{ lookupContacts()
+void lookupContacts(const string strServer, const string strProcess, const bool bApplication, list<string> &emailList, list<string> &pageList)
+{
+  shared_lock<shared_timed_mutex> lockContact(gContactMutex);
+
+  if (bApplication)
+  {
+    map<string, map<string, list<contact> > >::iterator serverIter = gApplicationContactList.find(strServer);
+    if (serverIter != gApplicationContactList.end())
+    {
+      map<string, list<contact> >::iterator processIter = serverIter->second.find(strProcess);
+      if (processIter != serverIter->second.end())
+      {
+        for (list<contact>::iterator i = processIter->second.begin(); i != processIter->second.end(); i++)
+        {
+          emailList.push_back(i->strEmail);
+          pageList.push_back(i->strUserID);
+        }
+      }
+    }
+  }
+  else
+  {
+    map<string, list<contact> >::iterator serverIter = gServerContactList.find(strServer);
+    if (serverIter != gServerContactList.end())
+    {
+      for (list<contact>::iterator i = serverIter->second.begin(); i != serverIter->second.end(); i++)
+      {
+        emailList.push_back(i->strEmail);
+        pageList.push_back(i->strUserID);
+      }
+    }
+  }
+}
+// }}}
+// {{{ malformed()
+void malformed(connection *ptConnection, const string &strAction, const string &strError)
+{
+  lock_guard<mutex> lockMalformed(gMalformedMutex);
+
+  gullMalformed++;
+  gstrMalformed = ptConnection->strServer + (string)" " + strAction + (string)":  " + strError;
+}
+// }}}
+// {{{ notifier()
+void notifier()
+{
+  unique_lock<mutex> lockNotification(gNotificationMutex);
+
+  while (!gbShutdown || !gNotificationQueue.empty())
+  {
+    list<notification *>::iterator iter = gNotificationQueue.end();
+    time_t CTime;
+    time(&CTime);
+    for (list<notification *>::iterator i = gNotificationQueue.begin(); iter == gNotificationQueue.end() && i != gNotificationQueue.end(); i++)
+    {
+      if (gbShutdown || (*i)->CNext <= CTime)
+      {
+        iter = i;
+      }
+    }
+    if (iter != gNotificationQueue.end())
+    {
+      notification *ptNotification = *iter;
+      map<string, notification *>::iterator pendingIter = gNotificationPending.find(ptNotification->strType + (string)"\n" + ptNotification->strRecipient);
+      gNotificationQueue.erase(iter);
+      if (pendingIter != gNotificationPending.end() && pendingIter->second == ptNotification)
+      {
+        gNotificationPending.erase(pendingIter);
+      }
+      lockNotification.unlock();
+      if (ptNotification->strType == "application" || ptNotification->strType == "server")
+      {
+        resolve(ptNotification);
+        delete ptNotification;
+        lockNotification.lock();
+      }
+      else
+      {
+        string strError;
+        bool bDelivered = deliver(ptNotification, strError);
+        time(&CTime);
+        lockNotification.lock();
+        if (bDelivered)
+        {
+          unsigned long long ullLatency = ((CTime > ptNotification->CQueued)?(CTime - ptNotification->CQueued):0);
+          gNotificationStats.ullDelivered++;
+          gNotificationStats.ullLatency += ullLatency;
+          if (ullLatency > gNotificationStats.ullMaxLatency)
+          {
+            gNotificationStats.ullMaxLatency = ullLatency;
+          }
+          delete ptNotification;
+        }
+        else if (!gbShutdown && ++ptNotification->unAttempts < NOTIFY_ATTEMPTS)
+        {
+          string strKey = ptNotification->strType + (string)"\n" + ptNotification->strRecipient;
+          gNotificationStats.ullRetried++;
+          ptNotification->CNext = CTime + (NOTIFY_BACKOFF << (ptNotification->unAttempts - 1));
+          gNotificationQueue.push_back(ptNotification);
+          if (ptNotification->strType != "chat" && gNotificationPending.find(strKey) == gNotificationPending.end())
+          {
+            gNotificationPending[strKey] = ptNotification;
+          }
+        }
+        else
+        {
+          stringstream ssError;
+          gNotificationStats.ullFailed++;
+          lockNotification.unlock();
+          ssError << "notifier()->deliver() error [" << ptNotification->strType << "," << ptNotification->strRecipient << "," << ptNotification->strSubject << "]:  " << strError;
+          notify(ssError.str(), strError);
+          delete ptNotification;
+          lockNotification.lock();
+        }
+      }
+    }
+    else
+    {
+      gNotificationCondition.wait_for(lockNotification, chrono::seconds(1));
+    }
+  }
+}
+// }}}
+// {{{ notify()
+bool notify(const string strMessage, string &strError)
+{
+  bool bResult = false;
+  list<string> toList, ccList, bccList, fileList;
+  utsname tServer;
+  lock_guard<recursive_mutex> lockDelivery(gDeliveryMutex);
+
+  uname(&tServer);
+  toList.push_back(gstrEmail);
+  if (gpCentral->junction()->email((string)"root@"+(string)tServer.nodename, toList, ccList, bccList, gstrApplication, strMessage, "", fileList, strError))
+  {
+    bResult = true;
+  }
+  toList.clear();
+
+  return bResult;
+}
+// }}}
+// {{{ notifyApplicationContact()
+void notifyApplicationContact(const string strServer, const string strProcess, process *ptProcess)
+{
+  if (ptProcess != NULL)
+  {
+    notification *ptNotification = new notification;
+    struct utsname tServer;
+    uname(&tServer);
+    ptNotification->bPage = ptProcess->bPage;
+    ptNotification->unAttempts = 0;
+    ptNotification->unCount = 1;
+    time(&(ptNotification->CQueued));
+    ptNotification->CNext = ptNotification->CQueued;
+    ptNotification->strMessage = ptProcess->ssAlarms.str();
+    ptNotification->strProcess = strProcess;
+    ptNotification->strServer = strServer;
+    ptNotification->strSubject = ((!strServer.empty())?strServer:(string)tServer.nodename);
+    ptNotification->strType = "application";
+    enqueue(ptNotification);
+  }
+}
+// }}}
+// {{{ notifyServerContact()
+void notifyServerContact(const string strServer, overall *ptOverall)
+{
+  notification *ptNotification = new notification;
+  struct utsname tServer;
+
+  uname(&tServer);
+  ptNotification->bPage = ptOverall->bPage;
+  ptNotification->unAttempts = 0;
+  ptNotification->unCount = 1;
+  time(&(ptNotification->CQueued));
+  ptNotification->CNext = ptNotification->CQueued;
+  ptNotification->strMessage = ptOverall->ssAlarms.str();
+  ptNotification->strServer = strServer;
+  ptNotification->strSubject = ((!strServer.empty())?strServer:(string)tServer.nodename);
+  ptNotification->strType = "server";
+  enqueue(ptNotification);
+}
+// }}}
+// {{{ parseNumber()
+bool parseNumber(const field &tField, unsigned long long &ullValue)
+{
+  bool bResult = true;
+
+  ullValue = 0;
+  for (size_t i = 0; bResult && i < tField.unSize; i++)
+  {
+    unsigned int unDigit = (unsigned char)tField.pData[i] - '0';
+    if (unDigit <= 9 && ullValue <= (ULLONG_MAX - unDigit) / 10)
+    {
+      ullValue = ullValue * 10 + unDigit;
+    }
+    else
+    {
+      bResult = false;
+    }
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ peerAuthenticated()
+bool peerAuthenticated(connection *ptConnection, const vector<string> &hostList)
+{
+  bool bResult = false;
+
+  if (!gstrPeerCa.empty() && ptConnection->eSocketType == COMMON_SOCKET_ENCRYPTED && SSL_get_verify_result(ptConnection->ssl) == X509_V_OK)
+  {
+    X509 *ptCertificate;
+    #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    ptCertificate = SSL_get1_peer_certificate(ptConnection->ssl);
+    #else
+    ptCertificate = SSL_get_peer_certificate(ptConnection->ssl);
+    #endif
+    if (ptCertificate != NULL)
+    {
+      for (vector<string>::const_iterator i = hostList.begin(); !bResult && i != hostList.end(); i++)
+      {
+        unsigned char ucAddress[sizeof(in6_addr)];
+        if (inet_pton(AF_INET, i->c_str(), ucAddress) == 1 || inet_pton(AF_INET6, i->c_str(), ucAddress) == 1)
+        {
+          bResult = (X509_check_ip_asc(ptCertificate, i->c_str(), 0) == 1);
+        }
+        else
+        {
+          bResult = (X509_check_host(ptCertificate, i->c_str(), i->size(), 0, NULL) == 1);
+        }
+      }
+      X509_free(ptCertificate);
+    }
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ peerConnect()
+int peerConnect(const string &strNode, SSL_CTX *ctx, SSL *&ssl)
+{
+  int fdSocket = -1;
+  size_t unBracket = strNode.rfind(']'), unPosition;
+  string strHost = peerHost(strNode), strPort = PORT;
+  struct addrinfo hints;
+  struct addrinfo *result;
+
+  ssl = NULL;
+  if ((unPosition = strNode.rfind(':')) != string::npos && (unBracket == string::npos || unPosition > unBracket))
+  {
+    strPort = strNode.substr(unPosition + 1, strNode.size() - (unPosition + 1));
+  }
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(strHost.c_str(), strPort.c_str(), &hints, &result) == 0)
+  {
+    struct addrinfo *rp;
+    for (rp = result; fdSocket == -1 && rp != NULL; rp = rp->ai_next)
+    {
+      if ((fdSocket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol)) >= 0 && connect(fdSocket, rp->ai_addr, rp->ai_addrlen) != 0)
+      {
+        close(fdSocket);
+        fdSocket = -1;
+      }
+    }
+    freeaddrinfo(result);
+  }
+  if (fdSocket != -1)
+  {
+    timeval tTimeout;
+    tTimeout.tv_sec = CLUSTER_TIMEOUT;
+    tTimeout.tv_usec = 0;
+    setsockopt(fdSocket, SOL_SOCKET, SO_RCVTIMEO, &tTimeout, sizeof(tTimeout));
+    setsockopt(fdSocket, SOL_SOCKET, SO_SNDTIMEO, &tTimeout, sizeof(tTimeout));
+    unsigned char ucAddress[sizeof(in6_addr)];
+    bool bAddress = (inet_pton(AF_INET, strHost.c_str(), ucAddress) == 1 || inet_pton(AF_INET6, strHost.c_str(), ucAddress) == 1);
+    // The peer certificate must name the host the peer was configured by.
+    if (ctx != NULL && ((ssl = SSL_new(ctx)) == NULL || (bAddress?X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), strHost.c_str()):SSL_set1_host(ssl, strHost.c_str())) != 1 || SSL_set_fd(ssl, fdSocket) != 1 || SSL_connect(ssl) != 1))
+    {
+      if (ssl != NULL)
+      {
+        SSL_free(ssl);
+        ssl = NULL;
+      }
+      close(fdSocket);
+      fdSocket = -1;
+    }
+  }
+
+  return fdSocket;
+}
+// }}}
+// {{{ peerHost()
+string peerHost(const string &strNode)
+{
+  size_t unPosition;
+  string strHost = strNode;
+
+  if (!strHost.empty() && strHost[0] == '[' && (unPosition = strHost.find(']')) != string::npos)
+  {
+    strHost = strHost.substr(1, unPosition - 1);
+  }
+  else if ((unPosition = strHost.rfind(':')) != string::npos)
+  {
+    strHost.erase(unPosition, strHost.size() - unPosition);
+  }
+
+  return strHost;
+}
+// }}}
+// {{{ peerVerify()
+int peerVerify(int, X509_STORE_CTX *)
+{
+  return 1;
+}
+// }}}
+// {{{ peerWrite()
+bool peerWrite(const int fdSocket, SSL *ssl, const string &strBuffer)
+{
+  int nReturn = 1;
+  size_t unSent = 0;
+
+  while (nReturn > 0 && unSent < strBuffer.size())
+  {
+    if ((nReturn = ((ssl != NULL)?SSL_write(ssl, strBuffer.c_str() + unSent, strBuffer.size() - unSent):write(fdSocket, strBuffer.c_str() + unSent, strBuffer.size() - unSent))) > 0)
+    {
+      unSent += nReturn;
+    }
+  }
+
+  return (unSent == strBuffer.size());
+}
+// }}}
+// {{{ processAlarms()
+void processAlarms(connection *ptConnection, const string &strProcess, process *ptProcess)
+{
+  if (ptProcess->nProcesses <= 0)
+  {
+    if (ptProcess->CTime <= 0)
+    {
+      time(&(ptProcess->CTime));
+    }
+  }
+  else
+  {
+    ptProcess->CTime = 0;
+  }
+  ptProcess->bHaveValues = true;
+  ptConnection->ptOverall->bReplicate = true;
+  ptConnection->ptOverall->bUpstream = true;
+  if (!gstrHistory.empty())
+  {
+    list<pair<string, unsigned long long> > metricList;
+    metricList.push_back(make_pair((string)"process:" + strProcess + (string)":image", ptProcess->ulImage));
+    metricList.push_back(make_pair((string)"process:" + strProcess + (string)":processes", ptProcess->nProcesses));
+    metricList.push_back(make_pair((string)"process:" + strProcess + (string)":resident", ptProcess->ulResident));
+    historyRecord(ptConnection->strServer, metricList);
+  }
+  // {{{ write out process alarm information
+  string strAlarms = ptProcess->ssAlarms.str();
+  ptProcess->bPage = false;
+  ptProcess->ssAlarms.str("");
+  if (ptProcess->nProcesses <= 0)
+  {
+    time_t CTime;
+    time(&CTime);
+    if (ptProcess->nDelay <= 0 || (ptProcess->CTime > 0 && CTime - ptProcess->CTime >= ptProcess->nDelay))
+    {
+      ptProcess->bPage = true;
+      ptProcess->ssAlarms << strProcess << " is not currently running";
+    }
+  }
+  else
+  {
+    if (!ptProcess->strOwner.empty())
+    {
+      bool bFoundOwner = false;
+      for (map<string, unsigned int>::iterator k = ptProcess->owner.begin(); !bFoundOwner && k != ptProcess->owner.end(); k++)
+      {
+        if (ptProcess->strOwner == k->first)
+        {
+          bFoundOwner = true;
+        }
+      }
+      if (!bFoundOwner)
+      {
+        ptProcess->bPage = true;
+        ptProcess->ssAlarms << strProcess << " is not running under the required " << ptProcess->strOwner << " account";
+      }
+    }
+    if (ptProcess->nMinProcesses > 0 && ptProcess->nProcesses < ptProcess->nMinProcesses)
+    {
+      if (!ptProcess->ssAlarms.str().empty())
+      {
+        ptProcess->ssAlarms << ",";
+      }
+      ptProcess->ssAlarms << strProcess << " is running " << ptProcess->nProcesses << " processes which is less than the minimum " << ptProcess->nMinProcesses << " processes";
+    }
+    else if (ptProcess->nMaxProcesses > 0 && ptProcess->nProcesses > ptProcess->nMaxProcesses)
+    {
+      if (!ptProcess->ssAlarms.str().empty())
+      {
+        ptProcess->ssAlarms << ",";
+      }
+      ptProcess->ssAlarms << strProcess << " is running " << ptProcess->nProcesses << " processes which is more than the maximum " << ptProcess->nMaxProcesses << " processes";
+    }
+    if (ptProcess->ulMinImage > 0 && ptProcess->ulRealMinImage < ptProcess->ulMinImage)
+    {
+      if (!ptProcess->ssAlarms.str().empty())
+      {
+        ptProcess->ssAlarms << ",";
+      }
+      ptProcess->ssAlarms << strProcess << " has an image size of " << ptProcess->ulRealMinImage << "KB which is less than the minimum " << ptProcess->ulMinImage << "KB";
+    }
+    if (ptProcess->ulMaxImage > 0 && ptProcess->ulRealMaxImage > ptProcess->ulMaxImage)
+    {
+      if (!ptProcess->ssAlarms.str().empty())
+      {
+        ptProcess->ssAlarms << ",";
+      }
+      ptProcess->ssAlarms << strProcess << " has an image size of " << ptProcess->ulRealMaxImage << "KB which is more than the maximum " << ptProcess->ulMaxImage << "KB";
+    }
+    if (ptProcess->ulMinResident > 0 && ptProcess->ulRealMinResident < ptProcess->ulMinResident)
+    {
+      if (!ptProcess->ssAlarms.str().empty())
+      {
+        ptProcess->ssAlarms << ",";
+      }
+      ptProcess->ssAlarms << strProcess << " has a resident size of " << ptProcess->ulRealMinResident << "KB which is less than the minimum " << ptProcess->ulMinResident << "KB";
+    }
+    if (ptProcess->ulMaxResident > 0 && ptProcess->ulRealMaxResident > ptProcess->ulMaxResident)
+    {
+      if (!ptProcess->ssAlarms.str().empty())
+      {
+        ptProcess->ssAlarms << ",";
+      }
+      ptProcess->ssAlarms << strProcess << " has a resident size of " << ptProcess->ulRealMaxResident << "KB which is more than the maximum " << ptProcess->ulMaxResident << "KB";
+    }
+  }
+  if (!ptProcess->ssAlarms.str().empty() && (ptProcess->ssPrevAlarms.str().empty() || (ptProcess->bPage && !ptProcess->bPrevPage)))
+  {
+    ptProcess->bPrevPage = ptProcess->bPage;
+    ptProcess->ssPrevAlarms << ptProcess->ssAlarms.str();
+    requestSnapshot();
+    if (ptProcess->strScript.empty())
+    {
+      notifyApplicationContact(ptConnection->strServer, strProcess, ptProcess);
+    }
+    else
+    {
+      list<string> contactList, pageList;
+      string strValue;
+      stringstream ssMessage;
+      Json *ptJson = new Json;
+      ptJson->insert("type", "process");
+      ptJson->insert("daemon", strProcess);
+      ptJson->insert("start", ptProcess->strStartTime);
+      ptJson->m["owner"] = new Json;
+      for (map<string, unsigned int>::iterator k = ptProcess->owner.begin(); k != ptProcess->owner.end(); k++)
+      {
+        ptJson->m["owner"]->insert(k->first, gpCentral->manip()->toString(k->second, strValue));
+      }
+      ptJson->insert("processes", gpCentral->manip()->toString(ptProcess->nProcesses, strValue));
+      ptJson->insert("min_processes", gpCentral->manip()->toString(ptProcess->nMinProcesses, strValue));
+      ptJson->insert("max_processes", gpCentral->manip()->toString(ptProcess->nMaxProcesses, strValue));
+      ptJson->insert("image", gpCentral->manip()->toString(ptProcess->ulImage, strValue));
+      ptJson->insert("min_image", gpCentral->manip()->toString(ptProcess->ulRealMinImage, strValue));
+      ptJson->insert("max_image", gpCentral->manip()->toString(ptProcess->ulRealMaxImage, strValue));
+      ptJson->insert("resident", gpCentral->manip()->toString(ptProcess->ulResident, strValue));
+      ptJson->insert("min_resident", gpCentral->manip()->toString(ptProcess->ulRealMinResident, strValue));
+      ptJson->insert("max_resident", gpCentral->manip()->toString(ptProcess->ulRealMaxResident, strValue));
+      lookupContacts(ptConnection->strServer, strProcess, true, contactList, pageList);
+      contactList.push_back("#nma.system");
+      contactList.sort();
+      contactList.unique();
+      ptJson->m["contacts"] = new Json;
+      for (list<string>::iterator k = contactList.begin(); k != contactList.end(); k++)
+      {
+        Json *ptSubJson = new Json;
+        ptSubJson->v= *k;
+        ptJson->m["contacts"]->l.push_back(ptSubJson);
+      }
+      contactList.clear();
+      ssMessage << "script " << ptProcess->strScript << endl << ptJson << endl;
+      delete ptJson;
+      append(ptConnection->outBuffer, ssMessage.str());
+      ssMessage.str("");
+    }
+  }
+  // }}}
+  if (gunSubscribers > 0)
+  {
+    publish(ptConnection->strServer, strProcess, (string)"process;" + ptConnection->strServer + (string)";" + strProcess + (string)";" + processLine(ptProcess), false);
+    if (ptProcess->ssAlarms.str() != strAlarms)
+    {
+      publish(ptConnection->strServer, strProcess, (string)"alarm;" + ptConnection->strServer + (string)";" + strProcess + (string)";" + ptProcess->ssAlarms.str(), true);
+    }
+  }
+  if (!gstrUpstream.empty() && ptProcess->ssAlarms.str() != strAlarms)
+  {
+    ptConnection->ptOverall->bUpstreamAlarm = true;
+    requestUpstream();
+  }
+}
+// }}}
+// {{{ processLine()
+string processLine(process *ptProcess)
+{
+  stringstream ssDetails;
+
+  ssDetails << ptProcess->strStartTime << ';';
+  for (map<string, unsigned int>::iterator k = ptProcess->owner.begin(); k != ptProcess->owner.end(); k++)
+  {
+    if (k != ptProcess->owner.begin())
+    {
+      ssDetails << ", ";
+    }
+    ssDetails << k->first << '(' << k->second << ')';
+  }
+  ssDetails << ';';
+  ssDetails << ptProcess->nProcesses << ';';
+  ssDetails << ptProcess->ulImage << ';';
+  ssDetails << ptProcess->ulRealMinImage << ';';
+  ssDetails << ptProcess->ulRealMaxImage << ';';
+  ssDetails << ptProcess->ulResident << ';';
+  ssDetails << ptProcess->ulRealMinResident << ';';
+  ssDetails << ptProcess->ulRealMaxResident << ';';
+  ssDetails << ptProcess->ssAlarms.str();
+
+  return ssDetails.str();
+}
+// }}}
+// {{{ publish()
+void publish(const string &strServer, const string &strProcess, const string &strLine, const bool bAlarm)
+{
+  shared_lock<shared_timed_mutex> lockSubscriber(gSubscriberMutex);
+
+  for (list<subscriber *>::iterator i = gSubscriberList.begin(); i != gSubscriberList.end(); i++)
+  {
+    bool bMatch = (*i)->filterList.empty();
+    if (bAlarm || !(*i)->bAlarms)
+    {
+      for (list<string>::iterator j = (*i)->filterList.begin(); !bMatch && j != (*i)->filterList.end(); j++)
+      {
+        if (*j == "*" || *j == strServer || (!strProcess.empty() && *j == strServer + (string)"/" + strProcess))
+        {
+          bMatch = true;
+        }
+      }
+    }
+    else
+    {
+      bMatch = false;
+    }
+    if (bMatch)
+    {
+      lock_guard<mutex> lockOutbox((*i)->mutexOutbox);
+      // A subscriber that cannot keep up loses events rather than growing without bound; the loss is reported once it catches up.
+      if ((*i)->unQueued + strLine.size() + 1 > SUBSCRIBE_QUEUE)
+      {
+        (*i)->ullDropped++;
+      }
+      else
+      {
+        bool bWake = (*i)->outbox.empty();
+        (*i)->outbox.push_back(strLine + (string)"\n");
+        (*i)->unQueued += strLine.size() + 1;
+        if (bWake)
+        {
+          char cWake = 's';
+          write((*i)->ptShard->fdWake[1], &cWake, 1);
+        }
+      }
+    }
+  }
+}
+// }}}
+// {{{ reactor()
+void reactor(shard *ptShard, SSL_CTX *ctx)
+{
+  list<connection *> bridge;
+  string strError;
+  time_t CInspect = 0;
+  list<connection *> adoptList;
+  vector<connection *> touched;
+  #ifdef USE_EPOLL
+  epoll_event events[MAX_EVENTS];
+  #else
+  vector<connection *> fdConnection;
+  vector<pollfd> fds;
+  #endif
+
+  while (!gbShutdown)
+  {
+    bool bSync = false;
+    int nReturn;
+    time_t CTime;
+    touched.clear();
+    // {{{ wait for events
+    #ifdef USE_EPOLL
+    if ((nReturn = epoll_wait(ptShard->fdEpoll, events, MAX_EVENTS, 250)) > 0)
+    {
+      for (int i = 0; i < nReturn; i++)
+      {
+        if (events[i].data.ptr == NULL)
+        {
+          char szBuffer[64];
+          while (read(ptShard->fdWake[0], szBuffer, sizeof(szBuffer)) > 0);
+        }
+        else
+        {
+          connection *ptConnection = (connection *)events[i].data.ptr;
+          service(ptShard, ptConnection, ctx, (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)), (events[i].events & EPOLLOUT), bSync);
+          touched.push_back(ptConnection);
+        }
+      }
+    }
+    #else
+    size_t unIndex = 0;
+    fds.resize(bridge.size() + 1);
+    fdConnection.resize(bridge.size() + 1);
+    fds[unIndex].fd = ptShard->fdWake[0];
+    fds[unIndex].events = POLLIN;
+    fdConnection[unIndex] = NULL;
+    unIndex++;
+    for (list<connection *>::iterator i = bridge.begin(); i != bridge.end(); i++)
+    {
+      fds[unIndex].fd = (*i)->fdData;
+      fds[unIndex].events = POLLIN;
+      if ((*i)->outBuffer.unSize > 0)
+      {
+        fds[unIndex].events |= POLLOUT;
+      }
+      fdConnection[unIndex] = *i;
+      unIndex++;
+    }
+    if ((nReturn = poll(&fds[0], unIndex, 250)) > 0)
+    {
+      if (fds[0].revents & POLLIN)
+      {
+        char szBuffer[64];
+        while (read(ptShard->fdWake[0], szBuffer, sizeof(szBuffer)) > 0);
+      }
+      for (size_t i = 1; i < unIndex; i++)
+      {
+        if (fds[i].revents)
+        {
+          service(ptShard, fdConnection[i], ctx, (fds[i].revents & (POLLIN | POLLHUP | POLLERR)), (fds[i].revents & POLLOUT), bSync);
+          touched.push_back(fdConnection[i]);
+        }
+      }
+    }
+    #endif
+    else if (nReturn < 0 && errno != EINTR)
+    {
+      gbShutdown = true;
+      notify((string)"Poll error: " + strerror(errno), strError);
+    }
+    // }}}
+    // {{{ adopt queued connections
+    ptShard->mutexQueue.lock();
+    adoptList.splice(adoptList.end(), ptShard->queue);
+    ptShard->mutexQueue.unlock();
+    while (!adoptList.empty())
+    {
+      connection *ptConnection = adoptList.front();
+      adoptList.pop_front();
+      ptConnection->iterBridge = bridge.insert(bridge.end(), ptConnection);
+      #ifdef USE_EPOLL
+      epoll_event event;
+      event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      event.data.ptr = ptConnection;
+      epoll_ctl(ptShard->fdEpoll, EPOLL_CTL_ADD, ptConnection->fdData, &event);
+      #endif
+      // Data that arrived with the handshake or before the move may already be waiting.
+      service(ptShard, ptConnection, ctx, true, false, bSync);
+      touched.push_back(ptConnection);
+    }
+    // }}}
+    // {{{ request client values
+    time(&CTime);
+    if (CTime != CInspect)
+    {
+      CInspect = CTime;
+      for (list<connection *>::iterator i = bridge.begin(); i != bridge.end(); i++)
+      {
+        // {{{ hand servers back to their owning node once it is replicating again
+        if (!(*i)->bClose && !(*i)->bDrain && (*i)->bClient && shardIndex((*i)->strServer) == ptShard->unIndex && gClusterList.size() > 1 && (CTime - gCPeerSince) >= CLUSTER_HANDBACK && !clusterAccepts((*i)->strServer))
+        {
+          (*i)->bDrain = true;
+          append((*i)->outBuffer, clusterRedirect((*i)->strServer));
+          service(ptShard, *i, ctx, false, true, bSync);
+          touched.push_back(*i);
+        }
+        // }}}
+        else if (!(*i)->bClose && (*i)->bClient && shardIndex((*i)->strServer) == ptShard->unIndex && (*i)->nProtocol >= 4)
+        {
+          // Scheduled clients collect on their own timer and only need the daemon list and process count bounds when they change.
+          (*i)->ptOverall->mutexOverall.lock();
+          if ((*i)->ullSchedule != (*i)->ptOverall->ullSchedule)
+          {
+            stringstream ssSchedule;
+            ssSchedule << "schedule " << SCHEDULE_INTERVAL;
+            for (map<string, process *>::iterator k = (*i)->ptOverall->processList.begin(); k != (*i)->ptOverall->processList.end(); k++)
+            {
+              ssSchedule << " " << k->first << "=" << k->second->nMinProcesses << "," << k->second->nMaxProcesses;
+            }
+            ssSchedule << endl;
+            (*i)->ullSchedule = (*i)->ptOverall->ullSchedule;
+            append((*i)->outBuffer, ssSchedule.str());
+            (*i)->ptOverall->mutexOverall.unlock();
+            service(ptShard, *i, ctx, false, true, bSync);
+            touched.push_back(*i);
+          }
+          else
+          {
+            (*i)->ptOverall->mutexOverall.unlock();
+          }
+        }
+        else if (!(*i)->bClose && (*i)->bClient && shardIndex((*i)->strServer) == ptShard->unIndex && (CTime - (*i)->CStartTime) > SCHEDULE_INTERVAL)
+        {
+          (*i)->ptOverall->mutexOverall.lock();
+          append((*i)->outBuffer, "system\n");
+          if ((*i)->nProtocol >= 2)
+          {
+            if (!(*i)->ptOverall->processList.empty())
+            {
+              string strRequest = "processes";
+              for (map<string, process *>::iterator k = (*i)->ptOverall->processList.begin(); k != (*i)->ptOverall->processList.end(); k++)
+              {
+                strRequest += (string)" " + k->first;
+              }
+              append((*i)->outBuffer, strRequest + (string)"\n");
+            }
+          }
+          else
+          {
+            for (map<string, process *>::iterator k = (*i)->ptOverall->processList.begin(); k != (*i)->ptOverall->processList.end(); k++)
+            {
+              append((*i)->outBuffer, (string)"process " + k->first + (string)"\n");
+            }
+          }
+          (*i)->ptOverall->mutexOverall.unlock();
+          (*i)->CStartTime = CTime;
+          service(ptShard, *i, ctx, false, true, bSync);
+          touched.push_back(*i);
+        }
+      }
+    }
+    // }}}
+    // {{{ deliver answered history queries
+    {
+      list<historyquery *> answerList;
+      gHistoryQueryMutex.lock();
+      answerList.swap(ptShard->historyList);
+      gHistoryQueryMutex.unlock();
+      for (list<historyquery *>::iterator i = answerList.begin(); i != answerList.end(); i++)
+      {
+        connection *ptConnection = (*i)->ptConnection;
+        // A connection that closed after its query was answered has already detached from it.
+        if (ptConnection != NULL)
+        {
+          ptConnection->ptHistory = NULL;
+          if (!(*i)->strResponse.empty())
+          {
+            append(ptConnection->outBuffer, (*i)->strResponse);
+          }
+          else if (ptConnection->ptSubscriber == NULL)
+          {
+            ptConnection->bClose = true;
+          }
+          lines(ptShard, ptConnection, bSync);
+          service(ptShard, ptConnection, ctx, false, true, bSync);
+          touched.push_back(ptConnection);
+        }
+        delete *i;
+      }
+    }
+    // }}}
+    // {{{ drain subscriber outboxes
+    if (gunSubscribers > 0)
+    {
+      vector<connection *> drainList;
+      gSubscriberMutex.lock_shared();
+      for (list<subscriber *>::iterator i = gSubscriberList.begin(); i != gSubscriberList.end(); i++)
+      {
+        if ((*i)->ptShard == ptShard && !(*i)->ptConnection->bClose && (*i)->ptConnection->outBuffer.unSize < SUBSCRIBE_BACKLOG)
+        {
+          bool bDrained = false;
+          lock_guard<mutex> lockOutbox((*i)->mutexOutbox);
+          while (!(*i)->outbox.empty() && (*i)->ptConnection->outBuffer.unSize < SUBSCRIBE_BACKLOG)
+          {
+            bDrained = true;
+            (*i)->unQueued -= (*i)->outbox.front().size();
+            append((*i)->ptConnection->outBuffer, (*i)->outbox.front());
+            (*i)->outbox.pop_front();
+          }
+          if ((*i)->ullDropped > 0 && (*i)->outbox.empty())
+          {
+            stringstream ssDropped;
+            bDrained = true;
+            ssDropped << "dropped;" << (*i)->ullDropped << endl;
+            append((*i)->ptConnection->outBuffer, ssDropped.str());
+            (*i)->ullDropped = 0;
+          }
+          if (bDrained)
+          {
+            drainList.push_back((*i)->ptConnection);
+          }
+        }
+      }
+      gSubscriberMutex.unlock_shared();
+      for (size_t i = 0; i < drainList.size(); i++)
+      {
+        service(ptShard, drainList[i], ctx, false, true, bSync);
+        touched.push_back(drainList[i]);
+      }
+    }
+    // }}}
+    // {{{ remove or move touched connections
+    sort(touched.begin(), touched.end());
+    touched.erase(unique(touched.begin(), touched.end()), touched.end());
+    for (size_t i = 0; i < touched.size(); i++)
+    {
+      connection *ptConnection = touched[i];
+      if (ptConnection->bClose || (ptConnection->bClient && shardIndex(ptConnection->strServer) != ptShard->unIndex))
+      {
+        #ifdef USE_EPOLL
+        epoll_ctl(ptShard->fdEpoll, EPOLL_CTL_DEL, ptConnection->fdData, NULL);
+        #endif
+        bridge.erase(ptConnection->iterBridge);
+        if (ptConnection->bClose)
+        {
+          if (ptConnection->bClient)
+          {
+            unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+            overall *ptOverall = ptConnection->ptOverall;
+            ptOverall->partition.clear();
+            for (map<string, process *>::iterator k = ptOverall->processList.begin(); k != ptOverall->processList.end(); k++)
+            {
+              k->second->owner.clear();
+              delete k->second;
+            }
+            ptOverall->processList.clear();
+            gOverallList.erase(ptConnection->strServer);
+            delete ptOverall;
+            gullFleetChanges++;
+            //notify((string)"Lost client connection to " + ptConnection->strServer, strError);
+          }
+          if (ptConnection->ptHistory != NULL)
+          {
+            historyCancel(ptConnection);
+          }
+          // {{{ withdraw the servers of a regional relay
+          if (!ptConnection->relayList.empty())
+          {
+            unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+            for (set<string>::iterator k = ptConnection->relayList.begin(); k != ptConnection->relayList.end(); k++)
+            {
+              map<string, overall *>::iterator overallIter = gOverallList.find(*k);
+              if (overallIter != gOverallList.end())
+              {
+                for (map<string, process *>::iterator l = overallIter->second->processList.begin(); l != overallIter->second->processList.end(); l++)
+                {
+                  delete l->second;
+                }
+                delete overallIter->second;
+                gOverallList.erase(overallIter);
+              }
+            }
+            ptConnection->relayList.clear();
+            gullFleetChanges++;
+          }
+          // }}}
+          if (ptConnection->ptSubscriber != NULL)
+          {
+            unique_lock<shared_timed_mutex> lockSubscriber(gSubscriberMutex);
+            gSubscriberList.remove(ptConnection->ptSubscriber);
+            gunSubscribers--;
+            delete ptConnection->ptSubscriber;
+          }
+          if (ptConnection->eSocketType == COMMON_SOCKET_ENCRYPTED)
+          {
+            // Disabled SSL_shutdown() due it appearing to hang on an underlying read().
+            //SSL_shutdown(ptConnection->ssl);
+            SSL_free(ptConnection->ssl);
+          }
+          close(ptConnection->fdData);
+          delete ptConnection;
+        }
+        else
+        {
+          handoff(gShardList[shardIndex(ptConnection->strServer)], ptConnection);
+        }
+      }
+    }
+    // }}}
+    if (bSync)
+    {
+      requestSync();
+    }
+  }
+  for (list<connection *>::iterator i = bridge.begin(); i != bridge.end(); i++)
+  {
+    if ((*i)->ptHistory != NULL)
+    {
+      historyCancel(*i);
+    }
+    if ((*i)->ptSubscriber != NULL)
+    {
+      unique_lock<shared_timed_mutex> lockSubscriber(gSubscriberMutex);
+      gSubscriberList.remove((*i)->ptSubscriber);
+      gunSubscribers--;
+      delete (*i)->ptSubscriber;
+    }
+    if ((*i)->eSocketType == COMMON_SOCKET_ENCRYPTED)
+    {
+      SSL_free((*i)->ssl);
+    }
+    close((*i)->fdData);
+    delete *i;
+  }
+  bridge.clear();
+}
+// }}}
+// {{{ readClient()
+void readClient(connection *ptConnection, const string &strLine)
+{
+  overall *ptOverall = ptConnection->ptOverall;
+  field tField[13];
+  string strAction, strError;
+
+  tokenize(strLine.data(), strLine.size(), ';', tField, 13);
+  strAction.assign(tField[0].pData, tField[0].unSize);
+  // {{{ process
+  if (strAction == "process")
+  {
+    string strProcess(tField[1].pData, tField[1].unSize);
+    if (!strProcess.empty())
+    {
+      if (ptOverall != NULL && ptOverall->processList.find(strProcess) != ptOverall->processList.end() && decodeProcess(ptOverall->processList[strProcess], tField, strError))
+      {
+        processAlarms(ptConnection, strProcess, ptOverall->processList[strProcess]);
+      }
+    }
+  }
+  // }}}
+  // {{{ protocol
+  else if (strAction == "protocol")
+  {
+    unsigned long long ullProtocol;
+    if (parseNumber(tField[1], ullProtocol) && ullProtocol >= 2)
+    {
+      stringstream ssProtocol;
+      ptConnection->nProtocol = (int)min(ullProtocol, (unsigned long long)PROTOCOL);
+      ssProtocol << "protocol " << ptConnection->nProtocol << endl;
+      append(ptConnection->outBuffer, ssProtocol.str());
+    }
+  }
+  // }}}
+  // {{{ system
+  else if (strAction == "system" && decodeSystem(ptOverall, tField, strError))
+  {
+    systemAlarms(ptConnection);
+  }
+  // }}}
+  if (!strError.empty())
+  {
+    malformed(ptConnection, strAction, strError);
+  }
+}
+// }}}
+// {{{ readFrame()
+void readFrame(connection *ptConnection, field tPayload)
+{
+  overall *ptOverall = ptConnection->ptOverall;
+  string strAction = "frame", strError;
+  unsigned long long ullType;
+
+  if (!readVarint(tPayload, ullType))
+  {
+    strError = "Malformed frame type.";
+  }
+  // {{{ process
+  else if (ullType == FRAME_PROCESS)
+  {
+    unsigned long long ullCount;
+    strAction = "process";
+    if (readVarint(tPayload, ullCount))
+    {
+      for (unsigned long long i = 0; strError.empty() && i < ullCount; i++)
+      {
+        field tName, tStartTime;
+        unsigned long long ullID, ullMask = FRAME_PROCESS_FIELDS, ullValue[7];
+        map<string, unsigned int> ownerList;
+        if (!readVarint(tPayload, ullID) || ullID > ptConnection->nameList.size() || (ullID == ptConnection->nameList.size() && !readString(tPayload, tName)))
+        {
+          strError = "Malformed process name.";
+        }
+        else
+        {
+          if (ullID == ptConnection->nameList.size())
+          {
+            ptConnection->nameList.push_back(string(tName.pData, tName.unSize));
+          }
+          if (ptConnection->nProtocol >= 3 && !readVarint(tPayload, ullMask))
+          {
+            strError = "Malformed process field mask.";
+          }
+          if (strError.empty() && (ullMask & 0x01) && !readString(tPayload, tStartTime))
+          {
+            strError = "Malformed start time.";
+          }
+          if (strError.empty() && (ullMask & 0x02))
+          {
+            unsigned long long ullOwners;
+            if (readVarint(tPayload, ullOwners))
+            {
+              for (unsigned long long j = 0; strError.empty() && j < ullOwners; j++)
+              {
+                field tOwner;
+                unsigned long long ullOwnerCount;
+                if (readString(tPayload, tOwner) && readVarint(tPayload, ullOwnerCount))
+                {
+                  ownerList[string(tOwner.pData, tOwner.unSize)] = (unsigned int)ullOwnerCount;
+                }
+                else
+                {
+                  strError = "Malformed owner.";
+                }
+              }
+            }
+            else
+            {
+              strError = "Malformed owner count.";
+            }
+          }
+          for (size_t j = 0; strError.empty() && j < 7; j++)
+          {
+            if ((ullMask & (0x04ULL << j)) && !readVarint(tPayload, ullValue[j]))
+            {
+              strError = "Malformed process value.";
+            }
+          }
+          if (strError.empty())
+          {
+            const string &strProcess = ptConnection->nameList[ullID];
+            map<string, process *>::iterator processIter = ptOverall->processList.find(strProcess);
+            if (processIter != ptOverall->processList.end())
+            {
+              process *ptProcess = processIter->second;
+              size_t *pulValue[6] = {&(ptProcess->ulImage), &(ptProcess->ulRealMinImage), &(ptProcess->ulRealMaxImage), &(ptProcess->ulResident), &(ptProcess->ulRealMinResident), &(ptProcess->ulRealMaxResident)};
+              if (ullMask & 0x01)
+              {
+                ptProcess->strStartTime.assign(tStartTime.pData, tStartTime.unSize);
+              }
+              if (ullMask & 0x02)
+              {
+                ptProcess->owner.swap(ownerList);
+              }
+              if (ullMask & 0x04)
+              {
+                ptProcess->nProcesses = (int)ullValue[0];
+              }
+              for (size_t j = 0; j < 6; j++)
+              {
+                if (ullMask & (0x08ULL << j))
+                {
+                  *(pulValue[j]) = ullValue[j + 1];
+                }
+              }
+              processAlarms(ptConnection, strProcess, ptProcess);
+            }
+          }
+        }
+      }
+    }
+    else
+    {
+      strError = "Malformed process count.";
+    }
+  }
+  // }}}
+  // {{{ system
+  else if (ullType == FRAME_SYSTEM)
+  {
+    field tOperatingSystem, tSystemRelease, tCpuProcessUsage;
+    unsigned long long ullMask = FRAME_SYSTEM_FIELDS, ullValue[13];
+    map<string, unsigned int> partitionList;
+    stringstream ssPartitions;
+    strAction = "system";
+    if (ptConnection->nProtocol >= 3 && !readVarint(tPayload, ullMask))
+    {
+      strError = "Malformed system field mask.";
+    }
+    for (size_t i = 0; strError.empty() && i < 12; i++)
+    {
+      if (ullMask & (1ULL << i))
+      {
+        if (i == 0 || i == 1 || i == 6)
+        {
+          if (!readString(tPayload, ((i == 0)?tOperatingSystem:((i == 1)?tSystemRelease:tCpuProcessUsage))))
+          {
+            strError = "Malformed system string.";
+          }
+        }
+        else if (!readVarint(tPayload, ullValue[i]))
+        {
+          strError = "Malformed system value.";
+        }
+      }
+    }
+    if (strError.empty() && (ullMask & (1ULL << 12)))
+    {
+      unsigned long long ullPartitions;
+      if (readVarint(tPayload, ullPartitions))
+      {
+        for (unsigned long long i = 0; strError.empty() && i < ullPartitions; i++)
+        {
+          field tMount;
+          unsigned long long ullPercent;
+          if (readString(tPayload, tMount) && readVarint(tPayload, ullPercent))
+          {
+            string strMount(tMount.pData, tMount.unSize);
+            partitionList[strMount] = (unsigned int)ullPercent;
+            if (i > 0)
+            {
+              ssPartitions << ',';
+            }
+            ssPartitions << strMount << '=' << ullPercent;
+          }
+          else
+          {
+            strError = "Malformed partition.";
+          }
+        }
+      }
+      else
+      {
+        strError = "Malformed partition count.";
+      }
+    }
+    if (strError.empty())
+    {
+      if (ullMask & (1ULL << 0))
+      {
+        ptOverall->strOperatingSystem.assign(tOperatingSystem.pData, tOperatingSystem.unSize);
+      }
+      if (ullMask & (1ULL << 1))
+      {
+        ptOverall->strSystemRelease.assign(tSystemRelease.pData, tSystemRelease.unSize);
+      }
+      if (ullMask & (1ULL << 2))
+      {
+        ptOverall->nProcessors = (int)ullValue[2];
+      }
+      if (ullMask & (1ULL << 3))
+      {
+        ptOverall->unCpuSpeed = (unsigned int)ullValue[3];
+      }
+      if (ullMask & (1ULL << 4))
+      {
+        ptOverall->usProcesses = (unsigned short)ullValue[4];
+      }
+      if (ullMask & (1ULL << 5))
+      {
+        ptOverall->unCpuUsage = (unsigned int)ullValue[5];
+      }
+      if (ullMask & (1ULL << 6))
+      {
+        ptOverall->strCpuProcessUsage.assign(tCpuProcessUsage.pData, tCpuProcessUsage.unSize);
+      }
+      if (ullMask & (1ULL << 7))
+      {
+        ptOverall->lUpTime = (long)ullValue[7];
+      }
+      if (ullMask & (1ULL << 8))
+      {
+        ptOverall->ulMainUsed = ullValue[8];
+      }
+      if (ullMask & (1ULL << 9))
+      {
+        ptOverall->ulMainTotal = ullValue[9];
+      }
+      if (ullMask & (1ULL << 10))
+      {
+        ptOverall->ulSwapUsed = ullValue[10];
+      }
+      if (ullMask & (1ULL << 11))
+      {
+        ptOverall->ulSwapTotal = ullValue[11];
+      }
+      if (ullMask & (1ULL << 12))
+      {
+        ptOverall->strPartitions = ssPartitions.str();
+        ptOverall->partition.swap(partitionList);
+      }
+      systemAlarms(ptConnection);
+    }
+  }
+  // }}}
+  else
+  {
+    strError = "Unknown frame type.";
+  }
+  if (!strError.empty())
+  {
+    malformed(ptConnection, strAction, strError);
+  }
+}
+// }}}
+// {{{ readQuery()
+void readQuery(shard *ptShard, connection *ptConnection, const string &strLine, bool &bSync)
+{
+  string strAction, strError;
+  stringstream ssLine;
+
+  ssLine.str(strLine);
+  ssLine >> strAction;
+  // {{{ history
+  if (strAction == "history")
+  {
+    string strMetric, strServer;
+    time_t CFrom = 0, CTo = 0, CStep = 0;
+    ssLine >> strServer >> strMetric >> CFrom >> CTo >> CStep;
+    if (gstrHistory.empty())
+    {
+      strError = "History is not enabled.";
+    }
+    else if (strServer.empty() || strMetric.empty())
+    {
+      strError = "Please provide the server and metric.";
+    }
+    else if (CFrom <= 0 || CTo < CFrom)
+    {
+      strError = "Please provide a valid time range.";
+    }
+    else
+    {
+      historyquery *ptQuery = new historyquery;
+      ptQuery->CFrom = CFrom;
+      ptQuery->CStep = CStep;
+      ptQuery->CTo = CTo;
+      ptQuery->strMetric = strMetric;
+      ptQuery->strServer = strServer;
+      ptQuery->ptConnection = ptConnection;
+      ptQuery->ptShard = ptShard;
+      ptConnection->ptHistory = ptQuery;
+      lock_guard<mutex> lockQuery(gHistoryQueryMutex);
+      gHistoryQueryList.push_back(ptQuery);
+      gHistoryQueryCondition.notify_one();
+    }
+    if (!strError.empty())
+    {
+      append(ptConnection->outBuffer, (string)";;;;" + strError + (string)"\n");
+    }
+  }
+  // }}}
+  // {{{ message
+  else if (strAction == "message")
+  {
+    string strSubLine, strToken;
+    time_t CTime;
+    message *ptMessage = new message;
+    append(ptConnection->outBuffer, "okay\n");
+    gpCentral->manip()->trim(strSubLine, ssLine.str());
+    gpCentral->manip()->getToken(ptMessage->strType, strSubLine, 1, ";");
+    if (ptMessage->strType.size() >= 8 && ptMessage->strType.substr(0, 8) == "message ")
+    {
+      ptMessage->strType.erase(0, 8);
+    }
+    gpCentral->manip()->getToken(ptMessage->strApplication, strSubLine, 2, ";");
+    ptMessage->CStartTime = atoi(gpCentral->manip()->getToken(strToken, strSubLine, 3, ";").c_str());
+    ptMessage->CEndTime = atoi(gpCentral->manip()->getToken(strToken, strSubLine, 4, ";").c_str());
+    gpCentral->manip()->getToken(ptMessage->strMessage, strSubLine, 5, ";");
+    time(&CTime);
+    if (ptMessage->CEndTime > CTime)
+    {
+      lock_guard<mutex> lockMessage(gMessageMutex);
+      gMessageList.push_back(ptMessage);
+    }
+    else
+    {
+      delete ptMessage;
+    }
+  }
+  // }}}
+  // {{{ messages
+  else if (strAction == "messages")
+  {
+    bool bFound = false;
+    time_t CTime;
+    list<list<message *>::iterator> removeSubList;
+    lock_guard<mutex> lockMessage(gMessageMutex);
+    time(&CTime);
+    for (list<message *>::iterator k = gMessageList.begin(); k != gMessageList.end(); k++)
+    {
+      if ((*k)->CStartTime <= CTime)
+      {
+        if ((*k)->CEndTime > CTime)
+        {
+          stringstream ssMessage;
+          bFound = true;
+          ssMessage << (*k)->strType << ";" << (*k)->strApplication << ";" << (*k)->strMessage;
+          append(ptConnection->outBuffer, ssMessage.str() + "\n");
+        }
+        else
+        {
+          delete *k;
+          removeSubList.push_back(k);
+        }
+      }
+    }
+    for (list<list<message *>::iterator>::iterator k = removeSubList.begin(); k != removeSubList.end(); k++)
+    {
+      gMessageList.erase(*k);
+    }
+    removeSubList.clear();
+    if (!bFound && ptConnection->ptSubscriber == NULL)
+    {
+      ptConnection->bClose = true;
+    }
+  }
+  // }}}
+  // {{{ process
+  else if (strAction == "process")
+  {
+    string strServer, strProcess;
+    shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+    ssLine >> strServer >> strProcess;
+    if (!strServer.empty() && gOverallList.find(strServer) != gOverallList.end() && !strProcess.empty())
+    {
+      overall *ptOverall = gOverallList[strServer];
+      lock_guard<mutex> lockValues(ptOverall->mutexOverall);
+      if (ptOverall->processList.find(strProcess) != ptOverall->processList.end() && ptOverall->processList[strProcess]->bHaveValues)
+      {
+        append(ptConnection->outBuffer, processLine(ptOverall->processList[strProcess]) + "\n");
+      }
+      else if (ptOverall->processList.find(strProcess) == ptOverall->processList.end())
+      {
+        strError = "Please provide a valid process.";
+      }
+      else
+      {
+        strError = "Process has no values.";
+      }
+    }
+    else if (strServer.empty())
+    {
+      strError = "Please provide the server.";
+    }
+    else if (gOverallList.find(strServer) == gOverallList.end())
+    {
+      strError = "Please provide a valid server.";
+    }
+    else
+    {
+      strError = "Please provide the process.";
+    }
+    if (!strError.empty())
+    {
+      append(ptConnection->outBuffer, (string)";;;;;;;;;" + strError + (string)"\n");
+    }
+  }
+  // }}}
+  // {{{ relay
+  else if (strAction == "relay")
+  {
+    if (peerAuthenticated(ptConnection, gRelayList))
+    {
+      ptConnection->bRelay = true;
+    }
+    else
+    {
+      ptConnection->bClose = true;
+    }
+  }
+  // }}}
+  // {{{ replicate
+  else if (strAction == "replicate")
+  {
+    string strNode;
+    ssLine >> strNode;
+    if (gClusterList.size() > 1 && strNode == gClusterList[(gunNode + gClusterList.size() - 1) % gClusterList.size()] && peerAuthenticated(ptConnection, vector<string>(1, peerHost(strNode))))
+    {
+      size_t unPeer = (gunNode + gClusterList.size() - 1) % gClusterList.size();
+      time_t CTime;
+      shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+      ptConnection->bReplica = true;
+      // Servers taken over while the node was away are handed back with their state before their clients are redirected.
+      for (map<string, overall *>::iterator i = gOverallList.begin(); i != gOverallList.end(); i++)
+      {
+        if (clusterOwner(i->first) == unPeer)
+        {
+          string strFrame, strPayload;
+          appendVarint(strPayload, FRAME_RECORD);
+          i->second->mutexOverall.lock();
+          snapshotEncode(strPayload, i->first, i->second);
+          i->second->mutexOverall.unlock();
+          strFrame = FRAME_MARKER;
+          appendVarint(strFrame, strPayload.size());
+          strFrame.append(strPayload);
+          append(ptConnection->outBuffer, strFrame);
+        }
+      }
+      time(&CTime);
+      if ((CTime - gCPeerSeen) > CLUSTER_TIMEOUT)
+      {
+        gCPeerSince = CTime;
+      }
+      gCPeerSeen = CTime;
+    }
+    else
+    {
+      ptConnection->bClose = true;
+    }
+  }
+  // }}}
+  // {{{ server
+  else if (strAction == "server")
+  {
+    string strServer;
+    ssLine >> strServer;
+    if (!strServer.empty() && !clusterAccepts(strServer))
+    {
+      append(ptConnection->outBuffer, clusterRedirect(strServer));
+    }
+    else if (!strServer.empty())
+    {
+      unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+      if (gOverallList.find(strServer) == gOverallList.end())
+      {
+        overall *ptOverall;
+        map<string, overall *>::iterator restoreIter = gRestoreList.find(strServer), standbyIter = gStandbyList.find(strServer);
+        // A server restored from the snapshot, or replicated from the node this node stands by for, keeps its thresholds and alarm state.
+        if (restoreIter != gRestoreList.end())
+        {
+          ptOverall = restoreIter->second;
+          gRestoreList.erase(restoreIter);
+          gullFleetChanges++;
+        }
+        else if (standbyIter != gStandbyList.end())
+        {
+          ptOverall = standbyIter->second;
+          gStandbyList.erase(standbyIter);
+          gullFleetChanges++;
+        }
+        else
+        {
+          ptOverall = new overall;
+          ptOverall->bDirty = true;
+          ptOverall->bHaveThresholds = false;
+          ptOverall->bHaveValues = false;
+          ptOverall->bPage = false;
+        }
+        ptOverall->bReplicate = true;
+        ptOverall->bUpstream = true;
+        ptOverall->bUpstreamAlarm = false;
+        ptOverall->ullSchedule = 1;
+        gOverallList[strServer] = ptOverall;
+        ptConnection->bClient = true;
+        ptConnection->strServer = strServer;
+        ptConnection->CStartTime = 0;
+        ptConnection->ptOverall = ptOverall;
+        bSync = true;
+      }
+      else
+      {
+        ptConnection->bClose = true;
+      }
+    }
+    else
+    {
+      ptConnection->bClose = true;
+    }
+  }
+  // }}}
+  // {{{ stats
+  else if (strAction == "stats")
+  {
+    stringstream ssDetails;
+    lock_guard<mutex> lockNotification(gNotificationMutex);
+    ssDetails << "notification;";
+    ssDetails << gNotificationQueue.size() << ';';
+    ssDetails << gNotificationStats.unMaxDepth << ';';
+    ssDetails << gNotificationStats.ullQueued << ';';
+    ssDetails << gNotificationStats.ullCoalesced << ';';
+    ssDetails << gNotificationStats.ullDropped << ';';
+    ssDetails << gNotificationStats.ullDelivered << ';';
+    ssDetails << gNotificationStats.ullRetried << ';';
+    ssDetails << gNotificationStats.ullFailed << ';';
+    ssDetails << ((gNotificationStats.ullDelivered > 0)?(gNotificationStats.ullLatency / gNotificationStats.ullDelivered):0) << ';';
+    ssDetails << gNotificationStats.ullMaxLatency << endl;
+    gMalformedMutex.lock();
+    ssDetails << "parse;" << gullMalformed << ';' << gstrMalformed << endl;
+    gMalformedMutex.unlock();
+    ssDetails << "tls;" << gullHandshakes << ';' << gullResumed << ';' << ((gullHandshakes > 0)?(gullResumed * 100 / gullHandshakes):0) << ';' << gullHandshakeFailed << ';' << gullHandshakeLimited;
+    append(ptConnection->outBuffer, ssDetails.str() + "\n");
+  }
+  // }}}
+  // {{{ subscribe
+  else if (strAction == "subscribe")
+  {
+    bool bAlarms = false;
+    list<string> filterList;
+    string strTarget;
+    while (ssLine >> strTarget)
+    {
+      if (strTarget == "--alarms")
+      {
+        bAlarms = true;
+      }
+      else
+      {
+        filterList.push_back(strTarget);
+      }
+    }
+    unique_lock<shared_timed_mutex> lockSubscriber(gSubscriberMutex);
+    if (ptConnection->ptSubscriber == NULL)
+    {
+      ptConnection->ptSubscriber = new subscriber;
+      ptConnection->ptSubscriber->unQueued = 0;
+      ptConnection->ptSubscriber->ullDropped = 0;
+      ptConnection->ptSubscriber->ptConnection = ptConnection;
+      ptConnection->ptSubscriber->ptShard = ptShard;
+      gSubscriberList.push_back(ptConnection->ptSubscriber);
+      gunSubscribers++;
+    }
+    ptConnection->ptSubscriber->bAlarms = bAlarms;
+    ptConnection->ptSubscriber->filterList = filterList;
+    filterList.clear();
+    append(ptConnection->outBuffer, "okay\n");
+  }
+  // }}}
+  // {{{ system
+  else if (strAction == "system")
+  {
+    string strServer;
+    shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+    ssLine >> strServer;
+    if (strServer.empty() || (strServer.size() > 8 && strServer.substr(0, 8) == "--since="))
+    {
+      bool bSince = !strServer.empty();
+      unsigned long long ullSince = ((bSince)?strtoull(strServer.substr(8).c_str(), NULL, 10):0);
+      lock_guard<mutex> lockFleet(gFleetMutex);
+      // {{{ rebuild the fleet response when any server changed
+      if (gullFleetVersion != gullFleetChanges)
+      {
+        unsigned long long ullChanges = gullFleetChanges;
+        gstrFleet.clear();
+        for (map<string, overall *>::iterator k = gOverallList.begin(); k != gOverallList.end(); k++)
+        {
+          lock_guard<mutex> lockValues(k->second->mutexOverall);
+          if (k->second->bHaveValues)
+          {
+            gstrFleet.append(systemLine(k->first, k->second));
+            gstrFleet.append("\n");
+          }
+        }
+        gullFleetVersion = ullChanges;
+      }
+      // }}}
+      if (bSince)
+      {
+        stringstream ssVersion;
+        ssVersion << "version;" << gullFleetVersion << endl;
+        append(ptConnection->outBuffer, ssVersion.str());
+        if (ullSince != gullFleetVersion)
+        {
+          append(ptConnection->outBuffer, gstrFleet);
+        }
+      }
+      else if (!gstrFleet.empty())
+      {
+        append(ptConnection->outBuffer, gstrFleet);
+      }
+      else
+      {
+        append(ptConnection->outBuffer, ";;;;;;;;;;;;;No servers with values exist.\n");
+      }
+    }
+    else if (gOverallList.find(strServer) != gOverallList.end())
+    {
+      overall *ptOverall = gOverallList[strServer];
+      lock_guard<mutex> lockValues(ptOverall->mutexOverall);
+      if (ptOverall->bHaveValues)
+      {
+        append(ptConnection->outBuffer, systemLine(strServer, ptOverall) + "\n");
+      }
+      else
+      {
+        append(ptConnection->outBuffer, ";;;;;;;;;;;;;Server has no values.\n");
+      }
+    }
+    else
+    {
+      append(ptConnection->outBuffer, ";;;;;;;;;;;;;Please provide a valid server.\n");
+    }
+  }
+  // }}}
+  // {{{ update
+  else if (strAction == "update")
+  {
+    append(ptConnection->outBuffer, "okay\n");
+    bSync = true;
+  }
+  // }}}
+}
+// }}}
+// {{{ readRelay()
+void readRelay(connection *ptConnection, field tPayload)
+{
+  unsigned long long ullType;
+
+  if (readVarint(tPayload, ullType))
+  {
+    // {{{ record
+    if (ullType == FRAME_RECORD)
+    {
+      overall *ptOverall;
+      string strServer;
+      if (relayDecode(tPayload, strServer, ptOverall))
+      {
+        bool bAccepted = true;
+        string strAlarms;
+        unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+        map<string, overall *>::iterator overallIter = gOverallList.find(strServer);
+        if (overallIter != gOverallList.end())
+        {
+          // A server connected directly or through another relay takes precedence.
+          if (ptConnection->relayList.find(strServer) != ptConnection->relayList.end())
+          {
+            strAlarms = overallIter->second->ssAlarms.str();
+            for (map<string, process *>::iterator i = overallIter->second->processList.begin(); i != overallIter->second->processList.end(); i++)
+            {
+              delete i->second;
+            }
+            delete overallIter->second;
+            overallIter->second = ptOverall;
+          }
+          else
+          {
+            bAccepted = false;
+          }
+        }
+        else
+        {
+          map<string, overall *>::iterator restoreIter = gRestoreList.find(strServer);
+          if (restoreIter != gRestoreList.end())
+          {
+            for (map<string, process *>::iterator i = restoreIter->second->processList.begin(); i != restoreIter->second->processList.end(); i++)
+            {
+              delete i->second;
+            }
+            delete restoreIter->second;
+            gRestoreList.erase(restoreIter);
+          }
+          ptConnection->relayList.insert(strServer);
+          gOverallList[strServer] = ptOverall;
+          gullFleetChanges++;
+        }
+        if (bAccepted)
+        {
+          if (gunSubscribers > 0)
+          {
+            lock_guard<mutex> lockValues(ptOverall->mutexOverall);
+            publish(strServer, "", (string)"system;" + systemLine(strServer, ptOverall), false);
+            if (ptOverall->ssAlarms.str() != strAlarms)
+            {
+              publish(strServer, "", (string)"alarm;" + strServer + (string)";;" + ptOverall->ssAlarms.str(), true);
+            }
+          }
+        }
+        else
+        {
+          for (map<string, process *>::iterator i = ptOverall->processList.begin(); i != ptOverall->processList.end(); i++)
+          {
+            delete i->second;
+          }
+          delete ptOverall;
+        }
+      }
+      else
+      {
+        malformed(ptConnection, "relay", "Malformed server record.");
+      }
+    }
+    // }}}
+    // {{{ remove
+    else if (ullType == FRAME_REMOVE)
+    {
+      field tServer;
+      if (readString(tPayload, tServer))
+      {
+        string strServer(tServer.pData, tServer.unSize);
+        if (ptConnection->relayList.find(strServer) != ptConnection->relayList.end())
+        {
+          unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+          map<string, overall *>::iterator overallIter = gOverallList.find(strServer);
+          if (overallIter != gOverallList.end())
+          {
+            for (map<string, process *>::iterator i = overallIter->second->processList.begin(); i != overallIter->second->processList.end(); i++)
+            {
+              delete i->second;
+            }
+            delete overallIter->second;
+            gOverallList.erase(overallIter);
+          }
+          ptConnection->relayList.erase(strServer);
+          gullFleetChanges++;
+        }
+      }
+      else
+      {
+        malformed(ptConnection, "relay", "Malformed server removal.");
+      }
+    }
+    // }}}
+    // {{{ heartbeat
+    else if (ullType == FRAME_HEARTBEAT)
+    {
+      string strFrame(1, FRAME_MARKER);
+      appendVarint(strFrame, 1);
+      appendVarint(strFrame, FRAME_HEARTBEAT);
+      append(ptConnection->outBuffer, strFrame);
+    }
+    // }}}
+  }
+}
+// }}}
+// {{{ readReplica()
+void readReplica(connection *ptConnection, field tPayload)
+{
+  unsigned long long ullType;
+  time_t CTime;
+
+  if (readVarint(tPayload, ullType))
+  {
+    if (ullType == FRAME_RECORD)
+    {
+      overall *ptOverall;
+      string strServer;
+      if (snapshotDecode(tPayload, strServer, ptOverall))
+      {
+        unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+        map<string, overall *>::iterator standbyIter = gStandbyList.find(strServer);
+        if (standbyIter != gStandbyList.end())
+        {
+          for (map<string, process *>::iterator i = standbyIter->second->processList.begin(); i != standbyIter->second->processList.end(); i++)
+          {
+            delete i->second;
+          }
+          delete standbyIter->second;
+        }
+        time(&(ptOverall->CReplicated));
+        gStandbyList[strServer] = ptOverall;
+      }
+      else
+      {
+        malformed(ptConnection, "replica", "Malformed server record.");
+      }
+    }
+    time(&CTime);
+    if ((CTime - gCPeerSeen) > CLUSTER_TIMEOUT)
+    {
+      gCPeerSince = CTime;
+    }
+    gCPeerSeen = CTime;
+  }
+}
+// }}}
+// {{{ readSocket()
+bool readSocket(connection *ptConnection)
+{
+  bool bDone = false, bResult = true;
+  char szBuffer[65536];
+
+  while (!bDone)
+  {
+    int nReturn;
+    if (ptConnection->eSocketType == COMMON_SOCKET_ENCRYPTED)
+    {
+      if ((nReturn = SSL_read(ptConnection->ssl, szBuffer, sizeof(szBuffer))) > 0)
+      {
+        ptConnection->strBuffer.append(szBuffer, nReturn);
+      }
+      else
+      {
+        int nError = SSL_get_error(ptConnection->ssl, nReturn);
+        bDone = true;
+        if (nError != SSL_ERROR_WANT_READ && nError != SSL_ERROR_WANT_WRITE)
+        {
+          bResult = false;
+        }
+      }
+    }
+    else if ((nReturn = read(ptConnection->fdData, szBuffer, sizeof(szBuffer))) > 0)
+    {
+      ptConnection->strBuffer.append(szBuffer, nReturn);
+    }
+    else if (nReturn == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+      bDone = true;
+      bResult = false;
+    }
+    else if (errno != EINTR)
+    {
+      bDone = true;
+    }
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ readString()
+bool readString(field &tData, field &tString)
+{
+  bool bResult = false;
+  field tCopy = tData;
+  unsigned long long ullSize;
+
+  if (readVarint(tCopy, ullSize) && ullSize <= tCopy.unSize)
+  {
+    bResult = true;
+    tString.pData = tCopy.pData;
+    tString.unSize = ullSize;
+    tData.pData = tCopy.pData + ullSize;
+    tData.unSize = tCopy.unSize - ullSize;
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ readVarint()
+bool readVarint(field &tData, unsigned long long &ullValue)
+{
+  bool bResult = false;
+  size_t unIndex = 0;
+
+  ullValue = 0;
+  while (!bResult && unIndex < tData.unSize && unIndex < 10)
+  {
+    unsigned char ucByte = (unsigned char)tData.pData[unIndex];
+    ullValue |= (unsigned long long)(ucByte & 0x7f) << (7 * unIndex);
+    unIndex++;
+    if (!(ucByte & 0x80))
+    {
+      bResult = true;
+    }
+  }
+  if (bResult)
+  {
+    tData.pData += unIndex;
+    tData.unSize -= unIndex;
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ relayDecode()
+bool relayDecode(field &tData, string &strServer, overall *&ptOverall)
+{
+  bool bResult;
+  field tServer, tString[4];
+  unsigned long long ullValue[9], ullProcesses;
+
+  ptOverall = NULL;
+  bResult = readString(tData, tServer);
+  for (size_t j = 0; bResult && j < 9; j++)
+  {
+    bResult = readVarint(tData, ullValue[j]);
+  }
+  for (size_t j = 0; bResult && j < 4; j++)
+  {
+    bResult = readString(tData, tString[j]);
+  }
+  if (bResult && (bResult = readVarint(tData, ullProcesses)))
+  {
+    ptOverall = new overall;
+    strServer.assign(tServer.pData, tServer.unSize);
+    ptOverall->bDirty = true;
+    ptOverall->bHaveThresholds = false;
+    ptOverall->bHaveValues = true;
+    ptOverall->bPage = false;
+    ptOverall->bPrevPage = false;
+    ptOverall->bReplicate = true;
+    ptOverall->bUpstream = true;
+    ptOverall->bUpstreamAlarm = false;
+    ptOverall->unMaxCpuUsage = 0;
+    ptOverall->unMaxDiskUsage = 0;
+    ptOverall->unMaxMainUsage = 0;
+    ptOverall->unMaxSwapUsage = 0;
+    ptOverall->usMaxProcesses = 0;
+    ptOverall->ullSchedule = 0;
+    ptOverall->CReplicated = 0;
+    ptOverall->nProcessors = (int)ullValue[0];
+    ptOverall->unCpuSpeed = (unsigned int)ullValue[1];
+    ptOverall->usProcesses = (unsigned short)ullValue[2];
+    ptOverall->unCpuUsage = (unsigned int)ullValue[3];
+    ptOverall->lUpTime = (long)ullValue[4];
+    ptOverall->ulMainUsed = (unsigned long)ullValue[5];
+    ptOverall->ulMainTotal = (unsigned long)ullValue[6];
+    ptOverall->ulSwapUsed = (unsigned long)ullValue[7];
+    ptOverall->ulSwapTotal = (unsigned long)ullValue[8];
+    ptOverall->strOperatingSystem.assign(tString[0].pData, tString[0].unSize);
+    ptOverall->strSystemRelease.assign(tString[1].pData, tString[1].unSize);
+    ptOverall->strPartitions.assign(tString[2].pData, tString[2].unSize);
+    ptOverall->ssAlarms.str(string(tString[3].pData, tString[3].unSize));
+    // {{{ processes
+    for (unsigned long long j = 0; bResult && j < ullProcesses; j++)
+    {
+      field tProcess, tStartTime, tAlarms;
+      unsigned long long ullProcessValue[7], ullOwners = 0;
+      bResult = (readString(tData, tProcess) && readString(tData, tStartTime));
+      for (size_t k = 0; bResult && k < 7; k++)
+      {
+        bResult = readVarint(tData, ullProcessValue[k]);
+      }
+      if (bResult && (bResult = (readString(tData, tAlarms) && readVarint(tData, ullOwners))))
+      {
+        process *ptProcess = new process;
+        ptOverall->processList[string(tProcess.pData, tProcess.unSize)] = ptProcess;
+        ptProcess->bChecking = false;
+        ptProcess->bHaveValues = true;
+        ptProcess->bPage = false;
+        ptProcess->bPrevPage = false;
+        ptProcess->nDelay = 0;
+        ptProcess->nMinProcesses = 0;
+        ptProcess->nMaxProcesses = 0;
+        ptProcess->ulMinImage = 0;
+        ptProcess->ulMaxImage = 0;
+        ptProcess->ulMinResident = 0;
+        ptProcess->ulMaxResident = 0;
+        ptProcess->CTime = 0;
+        ptProcess->nProcesses = (int)ullProcessValue[0];
+        ptProcess->ulImage = (size_t)ullProcessValue[1];
+        ptProcess->ulRealMinImage = (size_t)ullProcessValue[2];
+        ptProcess->ulRealMaxImage = (size_t)ullProcessValue[3];
+        ptProcess->ulResident = (size_t)ullProcessValue[4];
+        ptProcess->ulRealMinResident = (size_t)ullProcessValue[5];
+        ptProcess->ulRealMaxResident = (size_t)ullProcessValue[6];
+        ptProcess->strStartTime.assign(tStartTime.pData, tStartTime.unSize);
+        ptProcess->ssAlarms.str(string(tAlarms.pData, tAlarms.unSize));
+        for (unsigned long long k = 0; bResult && k < ullOwners; k++)
+        {
+          field tOwner;
+          unsigned long long ullOwnerCount;
+          if ((bResult = (readString(tData, tOwner) && readVarint(tData, ullOwnerCount))))
+          {
+            ptProcess->owner[string(tOwner.pData, tOwner.unSize)] = (unsigned int)ullOwnerCount;
+          }
+        }
+      }
+    }
+    // }}}
+  }
+  if (!bResult && ptOverall != NULL)
+  {
+    for (map<string, process *>::iterator i = ptOverall->processList.begin(); i != ptOverall->processList.end(); i++)
+    {
+      delete i->second;
+    }
+    delete ptOverall;
+    ptOverall = NULL;
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ relayEncode()
+void relayEncode(string &strBuffer, const string &strServer, overall *ptOverall)
+{
+  unsigned long long ullValue[9] = {(unsigned long long)ptOverall->nProcessors, ptOverall->unCpuSpeed, ptOverall->usProcesses, ptOverall->unCpuUsage, (unsigned long long)ptOverall->lUpTime, ptOverall->ulMainUsed, ptOverall->ulMainTotal, ptOverall->ulSwapUsed, ptOverall->ulSwapTotal};
+
+  appendString(strBuffer, strServer);
+  for (size_t j = 0; j < 9; j++)
+  {
+    appendVarint(strBuffer, ullValue[j]);
+  }
+  appendString(strBuffer, ptOverall->strOperatingSystem);
+  appendString(strBuffer, ptOverall->strSystemRelease);
+  appendString(strBuffer, ptOverall->strPartitions);
+  appendString(strBuffer, ptOverall->ssAlarms.str());
+  appendVarint(strBuffer, ptOverall->processList.size());
+  // {{{ processes
+  for (map<string, process *>::iterator j = ptOverall->processList.begin(); j != ptOverall->processList.end(); j++)
+  {
+    process *ptProcess = j->second;
+    unsigned long long ullProcessValue[7] = {(unsigned long long)ptProcess->nProcesses, ptProcess->ulImage, ptProcess->ulRealMinImage, ptProcess->ulRealMaxImage, ptProcess->ulResident, ptProcess->ulRealMinResident, ptProcess->ulRealMaxResident};
+    appendString(strBuffer, j->first);
+    appendString(strBuffer, ptProcess->strStartTime);
+    for (size_t k = 0; k < 7; k++)
+    {
+      appendVarint(strBuffer, ullProcessValue[k]);
+    }
+    appendString(strBuffer, ptProcess->ssAlarms.str());
+    appendVarint(strBuffer, ptProcess->owner.size());
+    for (map<string, unsigned int>::iterator k = ptProcess->owner.begin(); k != ptProcess->owner.end(); k++)
+    {
+      appendString(strBuffer, k->first);
+      appendVarint(strBuffer, k->second);
+    }
+  }
+  // }}}
+}
+// }}}
+// {{{ replicator()
+void replicator(SSL_CTX *ctx)
+{
+  while (!gbShutdown)
+  {
+    int fdSocket, nReturn;
+    SSL *ssl;
+    if ((fdSocket = peerConnect(gClusterList[(gunNode + 1) % gClusterList.size()], ctx, ssl)) != -1)
+    {
+      bool bExit = false;
+      char szBuffer[65536];
+      string strBuffer, strOutput = (string)"replicate " + gClusterList[gunNode] + (string)"\n";
+      time_t CFull = 0, CTime;
+      while (!gbShutdown && !bExit)
+      {
+        bool bFull = ((time(&CTime) - CFull) >= CLUSTER_FULL);
+        pollfd fds[1];
+        if (bFull)
+        {
+          CFull = CTime;
+        }
+        // {{{ send changed servers followed by a heartbeat
+        {
+          shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+          for (map<string, overall *>::iterator i = gOverallList.begin(); i != gOverallList.end(); i++)
+          {
+            lock_guard<mutex> lockValues(i->second->mutexOverall);
+            if ((bFull || i->second->bReplicate) && clusterOwner(i->first) == gunNode)
+            {
+              string strPayload;
+              appendVarint(strPayload, FRAME_RECORD);
+              snapshotEncode(strPayload, i->first, i->second);
+              strOutput.append(1, FRAME_MARKER);
+              appendVarint(strOutput, strPayload.size());
+              strOutput.append(strPayload);
+              i->second->bReplicate = false;
+            }
+          }
+        }
+        strOutput.append(1, FRAME_MARKER);
+        appendVarint(strOutput, 1);
+        appendVarint(strOutput, FRAME_HEARTBEAT);
+        bExit = !peerWrite(fdSocket, ssl, strOutput);
+        strOutput.clear();
+        // }}}
+        // {{{ receive servers handed back by the standby
+        fds[0].fd = fdSocket;
+        fds[0].events = POLLIN;
+        while (!bExit && ((ssl != NULL && SSL_pending(ssl) > 0) || poll(fds, 1, 1000) > 0))
+        {
+          if ((nReturn = ((ssl != NULL)?SSL_read(ssl, szBuffer, 65536):read(fdSocket, szBuffer, 65536))) > 0)
+          {
+            bool bWaiting = false;
+            strBuffer.append(szBuffer, nReturn);
+            while (!bExit && !bWaiting && !strBuffer.empty())
+            {
+              field tFrame;
+              unsigned long long ullSize, ullType;
+              tFrame.pData = strBuffer.data() + 1;
+              tFrame.unSize = strBuffer.size() - 1;
+              if (strBuffer[0] != FRAME_MARKER)
+              {
+                bExit = true;
+              }
+              else if (!readVarint(tFrame, ullSize))
+              {
+                if (tFrame.unSize >= 10)
+                {
+                  bExit = true;
+                }
+                else
+                {
+                  bWaiting = true;
+                }
+              }
+              else if (ullSize > FRAME_MAX)
+              {
+                bExit = true;
+              }
+              else if (tFrame.unSize < ullSize)
+              {
+                bWaiting = true;
+              }
+              else
+              {
+                overall *ptOverall;
+                size_t unFrame = (tFrame.pData - strBuffer.data()) + ullSize;
+                string strServer;
+                tFrame.unSize = ullSize;
+                if (readVarint(tFrame, ullType) && ullType == FRAME_RECORD && snapshotDecode(tFrame, strServer, ptOverall))
+                {
+                  unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+                  map<string, overall *>::iterator restoreIter = gRestoreList.find(strServer);
+                  if (restoreIter != gRestoreList.end())
+                  {
+                    for (map<string, process *>::iterator i = restoreIter->second->processList.begin(); i != restoreIter->second->processList.end(); i++)
+                    {
+                      delete i->second;
+                    }
+                    delete restoreIter->second;
+                  }
+                  gRestoreList[strServer] = ptOverall;
+                  gCRestore = time(NULL);
+                }
+                strBuffer.erase(0, unFrame);
+              }
+            }
+          }
+          else
+          {
+            bExit = true;
+          }
+        }
+        // }}}
+        restoreExpire();
+        // {{{ expire standby servers no longer replicated by a live node
+        time(&CTime);
+        if ((CTime - gCPeerSeen) <= CLUSTER_TIMEOUT)
+        {
+          unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+          map<string, overall *>::iterator standbyIter = gStandbyList.begin();
+          while (standbyIter != gStandbyList.end())
+          {
+            if ((CTime - standbyIter->second->CReplicated) > (CLUSTER_FULL * 3))
+            {
+              for (map<string, process *>::iterator i = standbyIter->second->processList.begin(); i != standbyIter->second->processList.end(); i++)
+              {
+                delete i->second;
+              }
+              delete standbyIter->second;
+              gStandbyList.erase(standbyIter++);
+            }
+            else
+            {
+              standbyIter++;
+            }
+          }
+        }
+        // }}}
+      }
+      if (ssl != NULL)
+      {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+      }
+      close(fdSocket);
+    }
+    restoreExpire();
+    for (size_t i = 0; !gbShutdown && i < CLUSTER_INTERVAL; i++)
+    {
+      sleep(1);
+    }
+  }
+}
+// }}}
+// {{{ requestSnapshot()
+void requestSnapshot()
+{
+  if (!gstrSnapshot.empty())
+  {
+    lock_guard<mutex> lockSnapshot(gSnapshotMutex);
+    gbSnapshot = true;
+    gSnapshotCondition.notify_one();
+  }
+}
+// }}}
+// {{{ requestSync()
+void requestSync()
+{
+  lock_guard<mutex> lockSync(gSyncMutex);
+
+  time(&gCSyncLast);
+  if (gCSyncFirst == 0)
+  {
+    gCSyncFirst = gCSyncLast;
+  }
+  gSyncCondition.notify_one();
+}
+// }}}
+// {{{ requestUpstream()
+void requestUpstream()
+{
+  lock_guard<mutex> lockUpstream(gUpstreamMutex);
+  gbUpstream = true;
+  gUpstreamCondition.notify_one();
+}
+// }}}
+// {{{ restoreExpire()
+void restoreExpire()
+{
+  if (gCRestore != 0 && (time(NULL) - gCRestore) >= SNAPSHOT_ADOPT)
+  {
+    unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+    // A hand back may have arrived while the lock was awaited.
+    if (gCRestore != 0 && (time(NULL) - gCRestore) >= SNAPSHOT_ADOPT)
+    {
+      for (map<string, overall *>::iterator i = gRestoreList.begin(); i != gRestoreList.end(); i++)
+      {
+        for (map<string, process *>::iterator j = i->second->processList.begin(); j != i->second->processList.end(); j++)
+        {
+          delete j->second;
+        }
+        delete i->second;
+      }
+      gRestoreList.clear();
+      gCRestore = 0;
+    }
+  }
+}
+// }}}
+// {{{ resolve()
+void resolve(notification *ptNotification)
+{
+  list<string> emailList, pageList;
+
+  lookupContacts(ptNotification->strServer, ptNotification->strProcess, (ptNotification->strType == "application"), emailList, pageList);
+  if (!ptNotification->bPage)
+  {
+    pageList.clear();
+  }
+  emailList.remove("");
+  emailList.sort();
+  emailList.unique();
+  pageList.remove("");
+  pageList.sort();
+  pageList.unique();
+  for (list<string>::iterator i = pageList.begin(); i != pageList.end(); i++)
+  {
+    notification *ptPage = new notification(*ptNotification);
+    ptPage->strRecipient = *i;
+    ptPage->strType = "page";
+    enqueue(ptPage);
+  }
+  if (!gstrRoom.empty())
+  {
+    notification *ptChat = new notification(*ptNotification);
+    ptChat->strRecipient = gstrRoom;
+    ptChat->strType = "chat";
+    enqueue(ptChat);
+  }
+  for (list<string>::iterator i = emailList.begin(); i != emailList.end(); i++)
+  {
+    notification *ptEmail = new notification(*ptNotification);
+    ptEmail->strRecipient = *i;
+    ptEmail->strType = "email";
+    enqueue(ptEmail);
+  }
+}
+// }}}
+// {{{ sighandle()
+void sighandle(const int nSignal)
+{
+  list<string> dir;
+  string strError, strSignal;
+  stringstream ssSignal, ssCore;
+
+  gbShutdown = true;
+  // The accept loop in main() notices within a poll interval and shuts everything down in order.
+  if (nSignal != SIGINT && nSignal != SIGTERM)
+  {
+    sethandles(sigdummy);
+    ssSignal << nSignal;
+    notify((string)"The program's signal handling caught a " + (string)sigstring(strSignal, nSignal) + (string)"(" + ssSignal.str() + (string)")!  Exiting...", strError);
+    close(gfdStatus);
+    exit(1);
+  }
+}
+// }}}
+// {{{ shardIndex()
+size_t shardIndex(const string strServer)
+{
+  return hash<string>()(strServer) % gShardList.size();
+}
+// }}}
+// {{{ snapshotDecode()
+bool snapshotDecode(field &tData, string &strServer, overall *&ptOverall)
+{
+  bool bResult;
+  field tServer, tString[6];
+  unsigned long long ullValue[15], ullPartitions, ullProcesses;
+
+  ptOverall = NULL;
+  bResult = readString(tData, tServer);
+  for (size_t j = 0; bResult && j < 15; j++)
+  {
+    bResult = readVarint(tData, ullValue[j]);
+  }
+  for (size_t j = 0; bResult && j < 6; j++)
+  {
+    bResult = readString(tData, tString[j]);
+  }
+  if (bResult && (bResult = readVarint(tData, ullPartitions)))
+  {
+    ptOverall = new overall;
+    strServer.assign(tServer.pData, tServer.unSize);
+    ptOverall->bDirty = true;
+    ptOverall->bReplicate = true;
+    ptOverall->bUpstream = true;
+    ptOverall->bUpstreamAlarm = false;
+    ptOverall->CReplicated = 0;
+    ptOverall->bHaveThresholds = (ullValue[0] & 0x01);
+    ptOverall->bHaveValues = (ullValue[0] & 0x02);
+    ptOverall->bPage = (ullValue[0] & 0x04);
+    ptOverall->bPrevPage = (ullValue[0] & 0x08);
+    ptOverall->nProcessors = (int)ullValue[1];
+    ptOverall->unCpuSpeed = (unsigned int)ullValue[2];
+    ptOverall->unCpuUsage = (unsigned int)ullValue[3];
+    ptOverall->unMaxCpuUsage = (unsigned int)ullValue[4];
+    ptOverall->unMaxDiskUsage = (unsigned int)ullValue[5];
+    ptOverall->unMaxMainUsage = (unsigned int)ullValue[6];
+    ptOverall->unMaxSwapUsage = (unsigned int)ullValue[7];
+    ptOverall->usProcesses = (unsigned short)ullValue[8];
+    ptOverall->usMaxProcesses = (unsigned short)ullValue[9];
+    ptOverall->lUpTime = (long)ullValue[10];
+    ptOverall->ulMainTotal = (unsigned long)ullValue[11];
+    ptOverall->ulMainUsed = (unsigned long)ullValue[12];
+    ptOverall->ulSwapTotal = (unsigned long)ullValue[13];
+    ptOverall->ulSwapUsed = (unsigned long)ullValue[14];
+    ptOverall->strCpuProcessUsage.assign(tString[0].pData, tString[0].unSize);
+    ptOverall->strOperatingSystem.assign(tString[1].pData, tString[1].unSize);
+    ptOverall->strPartitions.assign(tString[2].pData, tString[2].unSize);
+    ptOverall->strSystemRelease.assign(tString[3].pData, tString[3].unSize);
+    ptOverall->ssAlarms.str(string(tString[4].pData, tString[4].unSize));
+    ptOverall->ssPrevAlarms.str(string(tString[5].pData, tString[5].unSize));
+    ptOverall->ssPrevAlarms.seekp(0, ios::end);
+    for (unsigned long long j = 0; bResult && j < ullPartitions; j++)
+    {
+      field tPartition;
+      unsigned long long ullPercent;
+      if ((bResult = (readString(tData, tPartition) && readVarint(tData, ullPercent))))
+      {
+        ptOverall->partition[string(tPartition.pData, tPartition.unSize)] = (unsigned int)ullPercent;
+      }
+    }
+    bResult = bResult && readVarint(tData, ullProcesses);
+    // {{{ processes
+    for (unsigned long long j = 0; bResult && j < ullProcesses; j++)
+    {
+      field tProcess, tProcessString[6];
+      unsigned long long ullProcessValue[16], ullOwners = 0;
+      bResult = readString(tData, tProcess);
+      for (size_t k = 0; bResult && k < 16; k++)
+      {
+        bResult = readVarint(tData, ullProcessValue[k]);
+      }
+      for (size_t k = 0; bResult && k < 6; k++)
+      {
+        bResult = readString(tData, tProcessString[k]);
+      }
+      if (bResult && (bResult = readVarint(tData, ullOwners)))
+      {
+        process *ptProcess = new process;
+        ptOverall->processList[string(tProcess.pData, tProcess.unSize)] = ptProcess;
+        ptProcess->bChecking = false;
+        ptProcess->bHaveValues = (ullProcessValue[0] & 0x01);
+        ptProcess->bPage = (ullProcessValue[0] & 0x02);
+        ptProcess->bPrevPage = (ullProcessValue[0] & 0x04);
+        ptProcess->nDelay = (int)ullProcessValue[1];
+        ptProcess->nProcesses = (int)ullProcessValue[2];
+        ptProcess->nMinProcesses = (int)ullProcessValue[3];
+        ptProcess->nMaxProcesses = (int)ullProcessValue[4];
+        ptProcess->ulImage = (size_t)ullProcessValue[5];
+        ptProcess->ulMinImage = (size_t)ullProcessValue[6];
+        ptProcess->ulMaxImage = (size_t)ullProcessValue[7];
+        ptProcess->ulRealMinImage = (size_t)ullProcessValue[8];
+        ptProcess->ulRealMaxImage = (size_t)ullProcessValue[9];
+        ptProcess->ulResident = (size_t)ullProcessValue[10];
+        ptProcess->ulMinResident = (size_t)ullProcessValue[11];
+        ptProcess->ulMaxResident = (size_t)ullProcessValue[12];
+        ptProcess->ulRealMinResident = (size_t)ullProcessValue[13];
+        ptProcess->ulRealMaxResident = (size_t)ullProcessValue[14];
+        ptProcess->CTime = (time_t)ullProcessValue[15];
+        ptProcess->strApplicationServerID.assign(tProcessString[0].pData, tProcessString[0].unSize);
+        ptProcess->strStartTime.assign(tProcessString[1].pData, tProcessString[1].unSize);
+        ptProcess->strOwner.assign(tProcessString[2].pData, tProcessString[2].unSize);
+        ptProcess->strScript.assign(tProcessString[3].pData, tProcessString[3].unSize);
+        ptProcess->ssAlarms.str(string(tProcessString[4].pData, tProcessString[4].unSize));
+        ptProcess->ssPrevAlarms.str(string(tProcessString[5].pData, tProcessString[5].unSize));
+        ptProcess->ssPrevAlarms.seekp(0, ios::end);
+        for (unsigned long long k = 0; bResult && k < ullOwners; k++)
+        {
+          field tOwner;
+          unsigned long long ullOwnerCount;
+          if ((bResult = (readString(tData, tOwner) && readVarint(tData, ullOwnerCount))))
+          {
+            ptProcess->owner[string(tOwner.pData, tOwner.unSize)] = (unsigned int)ullOwnerCount;
+          }
+        }
+      }
+    }
+    // }}}
+  }
+  if (!bResult && ptOverall != NULL)
+  {
+    for (map<string, process *>::iterator i = ptOverall->processList.begin(); i != ptOverall->processList.end(); i++)
+    {
+      delete i->second;
+    }
+    delete ptOverall;
+    ptOverall = NULL;
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ snapshotEncode()
+void snapshotEncode(string &strBuffer, const string &strServer, overall *ptOverall)
+{
+  unsigned long long ullValue[15] = {(unsigned long long)((ptOverall->bHaveThresholds?0x01:0) | (ptOverall->bHaveValues?0x02:0) | (ptOverall->bPage?0x04:0) | (ptOverall->bPrevPage?0x08:0)), (unsigned long long)ptOverall->nProcessors, ptOverall->unCpuSpeed, ptOverall->unCpuUsage, ptOverall->unMaxCpuUsage, ptOverall->unMaxDiskUsage, ptOverall->unMaxMainUsage, ptOverall->unMaxSwapUsage, ptOverall->usProcesses, ptOverall->usMaxProcesses, (unsigned long long)ptOverall->lUpTime, ptOverall->ulMainTotal, ptOverall->ulMainUsed, ptOverall->ulSwapTotal, ptOverall->ulSwapUsed};
+
+  appendString(strBuffer, strServer);
+  for (size_t j = 0; j < 15; j++)
+  {
+    appendVarint(strBuffer, ullValue[j]);
+  }
+  appendString(strBuffer, ptOverall->strCpuProcessUsage);
+  appendString(strBuffer, ptOverall->strOperatingSystem);
+  appendString(strBuffer, ptOverall->strPartitions);
+  appendString(strBuffer, ptOverall->strSystemRelease);
+  appendString(strBuffer, ptOverall->ssAlarms.str());
+  appendString(strBuffer, ptOverall->ssPrevAlarms.str());
+  appendVarint(strBuffer, ptOverall->partition.size());
+  for (map<string, unsigned int>::iterator j = ptOverall->partition.begin(); j != ptOverall->partition.end(); j++)
+  {
+    appendString(strBuffer, j->first);
+    appendVarint(strBuffer, j->second);
+  }
+  appendVarint(strBuffer, ptOverall->processList.size());
+  // {{{ processes
+  for (map<string, process *>::iterator j = ptOverall->processList.begin(); j != ptOverall->processList.end(); j++)
+  {
+    process *ptProcess = j->second;
+    unsigned long long ullProcessValue[16] = {(unsigned long long)((ptProcess->bHaveValues?0x01:0) | (ptProcess->bPage?0x02:0) | (ptProcess->bPrevPage?0x04:0)), (unsigned long long)ptProcess->nDelay, (unsigned long long)ptProcess->nProcesses, (unsigned long long)ptProcess->nMinProcesses, (unsigned long long)ptProcess->nMaxProcesses, ptProcess->ulImage, ptProcess->ulMinImage, ptProcess->ulMaxImage, ptProcess->ulRealMinImage, ptProcess->ulRealMaxImage, ptProcess->ulResident, ptProcess->ulMinResident, ptProcess->ulMaxResident, ptProcess->ulRealMinResident, ptProcess->ulRealMaxResident, (unsigned long long)ptProcess->CTime};
+    appendString(strBuffer, j->first);
+    for (size_t k = 0; k < 16; k++)
+    {
+      appendVarint(strBuffer, ullProcessValue[k]);
+    }
+    appendString(strBuffer, ptProcess->strApplicationServerID);
+    appendString(strBuffer, ptProcess->strStartTime);
+    appendString(strBuffer, ptProcess->strOwner);
+    appendString(strBuffer, ptProcess->strScript);
+    appendString(strBuffer, ptProcess->ssAlarms.str());
+    appendString(strBuffer, ptProcess->ssPrevAlarms.str());
+    appendVarint(strBuffer, ptProcess->owner.size());
+    for (map<string, unsigned int>::iterator k = ptProcess->owner.begin(); k != ptProcess->owner.end(); k++)
+    {
+      appendString(strBuffer, k->first);
+      appendVarint(strBuffer, k->second);
+    }
+  }
+  // }}}
+}
+// }}}
+// {{{ snapshotRead()
+bool snapshotRead(string &strError)
+{
+  bool bResult = false;
+  int fdSnapshot;
+
+  if ((fdSnapshot = open(gstrSnapshot.c_str(), O_RDONLY)) != -1)
+  {
+    struct stat tStat;
+    if (fstat(fdSnapshot, &tStat) == 0 && tStat.st_size > 0)
+    {
+      void *pMap = mmap(NULL, tStat.st_size, PROT_READ, MAP_PRIVATE, fdSnapshot, 0);
+      if (pMap != MAP_FAILED)
+      {
+        field tData = {(const char *)pMap, (size_t)tStat.st_size}, tMagic = {(const char *)pMap, strlen(SNAPSHOT_MAGIC)};
+        unsigned long long ullCount, ullTime;
+        map<string, overall *> restoreList;
+        list<message *> messageList;
+        if (tData.unSize >= tMagic.unSize && memcmp(tMagic.pData, SNAPSHOT_MAGIC, tMagic.unSize) == 0)
+        {
+          tData.pData += tMagic.unSize;
+          tData.unSize -= tMagic.unSize;
+          bResult = readVarint(tData, ullTime) && readVarint(tData, ullCount);
+          // {{{ servers
+          for (unsigned long long i = 0; bResult && i < ullCount; i++)
+          {
+            string strServer;
+            overall *ptOverall;
+            if ((bResult = snapshotDecode(tData, strServer, ptOverall)))
+            {
+              restoreList[strServer] = ptOverall;
+            }
+          }
+          // }}}
+          // {{{ messages
+          bResult = bResult && readVarint(tData, ullCount);
+          for (unsigned long long i = 0; bResult && i < ullCount; i++)
+          {
+            field tString[3];
+            unsigned long long ullValue[3];
+            for (size_t j = 0; bResult && j < 3; j++)
+            {
+              bResult = readVarint(tData, ullValue[j]);
+            }
+            for (size_t j = 0; bResult && j < 3; j++)
+            {
+              bResult = readString(tData, tString[j]);
+            }
+            if (bResult)
+            {
+              message *ptMessage = new message;
+              ptMessage->bEnabled = (ullValue[0] & 0x01);
+              ptMessage->CStartTime = (time_t)ullValue[1];
+              ptMessage->CEndTime = (time_t)ullValue[2];
+              ptMessage->strApplication.assign(tString[0].pData, tString[0].unSize);
+              ptMessage->strMessage.assign(tString[1].pData, tString[1].unSize);
+              ptMessage->strType.assign(tString[2].pData, tString[2].unSize);
+              messageList.push_back(ptMessage);
+            }
+          }
+          // }}}
+        }
+        if (bResult)
+        {
+          unique_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+          lock_guard<mutex> lockMessage(gMessageMutex);
+          gRestoreList.swap(restoreList);
+          gMessageList.splice(gMessageList.end(), messageList);
+          gCRestore = time(NULL);
+        }
+        else
+        {
+          strError = "Snapshot is truncated or corrupt.";
+        }
+        for (map<string, overall *>::iterator i = restoreList.begin(); i != restoreList.end(); i++)
+        {
+          for (map<string, process *>::iterator j = i->second->processList.begin(); j != i->second->processList.end(); j++)
+          {
+            delete j->second;
+          }
+          delete i->second;
+        }
+        restoreList.clear();
+        for (list<message *>::iterator i = messageList.begin(); i != messageList.end(); i++)
+        {
+          delete *i;
+        }
+        messageList.clear();
+        munmap(pMap, tStat.st_size);
+      }
+      else
+      {
+        strError = (string)"mmap() " + strerror(errno);
+      }
+    }
+    else
+    {
+      strError = "Snapshot is empty.";
+    }
+    close(fdSnapshot);
+  }
+  else if (errno == ENOENT)
+  {
+    bResult = true;
+  }
+  else
+  {
+    strError = (string)"open() " + strerror(errno);
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ snapshotWrite()
+bool snapshotWrite(string &strError)
+{
+  bool bResult = false;
+  int fdSnapshot;
+  string strBuffer = SNAPSHOT_MAGIC, strTemp = gstrSnapshot + (string)".tmp";
+  time_t CTime;
+
+  appendVarint(strBuffer, time(&CTime));
+  // {{{ servers
+  {
+    shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+    appendVarint(strBuffer, gOverallList.size() + gRestoreList.size());
+    for (size_t unList = 0; unList < 2; unList++)
+    {
+      map<string, overall *> &overallList = ((unList == 0)?gOverallList:gRestoreList);
+      for (map<string, overall *>::iterator i = overallList.begin(); i != overallList.end(); i++)
+      {
+        lock_guard<mutex> lockValues(i->second->mutexOverall);
+        snapshotEncode(strBuffer, i->first, i->second);
+      }
+    }
+  }
+  // }}}
+  // {{{ messages
+  {
+    lock_guard<mutex> lockMessage(gMessageMutex);
+    appendVarint(strBuffer, gMessageList.size());
+    for (list<message *>::iterator i = gMessageList.begin(); i != gMessageList.end(); i++)
+    {
+      appendVarint(strBuffer, ((*i)->bEnabled?0x01:0));
+      appendVarint(strBuffer, (unsigned long long)(*i)->CStartTime);
+      appendVarint(strBuffer, (unsigned long long)(*i)->CEndTime);
+      appendString(strBuffer, (*i)->strApplication);
+      appendString(strBuffer, (*i)->strMessage);
+      appendString(strBuffer, (*i)->strType);
+    }
+  }
+  // }}}
+  if ((fdSnapshot = open(strTemp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600)) != -1)
+  {
+    if (ftruncate(fdSnapshot, strBuffer.size()) == 0)
+    {
+      void *pMap = mmap(NULL, strBuffer.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fdSnapshot, 0);
+      if (pMap != MAP_FAILED)
+      {
+        memcpy(pMap, strBuffer.data(), strBuffer.size());
+        if (msync(pMap, strBuffer.size(), MS_SYNC) == 0 && rename(strTemp.c_str(), gstrSnapshot.c_str()) == 0)
+        {
+          bResult = true;
+        }
+        else
+        {
+          strError = (string)"msync()/rename() " + strerror(errno);
+        }
+        munmap(pMap, strBuffer.size());
+      }
+      else
+      {
+        strError = (string)"mmap() " + strerror(errno);
+      }
+    }
+    else
+    {
+      strError = (string)"ftruncate() " + strerror(errno);
+    }
+    close(fdSnapshot);
+  }
+  else
+  {
+    strError = (string)"open() " + strerror(errno);
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ snapshotter()
+void snapshotter()
+{
+  bool bExit = false, bFailed = false;
+
+  while (!bExit)
+  {
+    string strError;
+    {
+      unique_lock<mutex> lockSnapshot(gSnapshotMutex);
+      if (!gbSnapshot && !gbShutdown)
+      {
+        gSnapshotCondition.wait_for(lockSnapshot, chrono::seconds(SNAPSHOT_INTERVAL));
+      }
+      gbSnapshot = false;
+    }
+    bExit = gbShutdown;
+    restoreExpire();
+    // Only the first of a run of failures is reported.
+    if (snapshotWrite(strError))
+    {
+      bFailed = false;
+    }
+    else if (!bFailed)
+    {
+      bFailed = true;
+      notify((string)"Could not write the state snapshot.  " + strError, strError);
+    }
+  }
+}
+// }}}
+// {{{ sync()
+void sync()
+{
+  list<map<string, string> > *getApplicationServer, *getServer;
+  map<string, map<string, string> > serverList;
+  map<string, map<string, map<string, string> > > applicationServerList;
+  string strError;
+
+  loadContacts();
+  gCentralMutex.lock();
+  getServer = gpCentral->query("central", "select distinct * from server", strError);
+  getApplicationServer = gpCentral->query("central", "select distinct c.name server_name, a.* from application_server_detail a, application_server b, server c where a.application_server_id=b.id and b.server_id=c.id and a.daemon is not null and a.daemon != \'\'", strError);
+  gCentralMutex.unlock();
+  if (getServer != NULL && getApplicationServer != NULL)
+  {
+    for (list<map<string, string> >::iterator i = getServer->begin(); i != getServer->end(); i++)
+    {
+      serverList[(*i)["name"]].swap(*i);
+    }
+    for (list<map<string, string> >::iterator i = getApplicationServer->begin(); i != getApplicationServer->end(); i++)
+    {
+      string strServer = (*i)["server_name"], strProcess = (*i)["daemon"];
+      applicationServerList[strServer][strProcess].swap(*i);
+    }
+    shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+    for (map<string, overall *>::iterator i = gOverallList.begin(); i != gOverallList.end(); i++)
+    {
+      map<string, map<string, string> >::iterator serverIter = serverList.find(i->first);
+      map<string, map<string, map<string, string> > >::iterator applicationServerIter = applicationServerList.find(i->first);
+      lock_guard<mutex> lockValues(i->second->mutexOverall);
+      // {{{ system
+      if (serverIter != serverList.end())
+      {
+        unsigned int unMaxCpuUsage = atoi(serverIter->second["cpu_usage"].c_str());
+        unsigned int unMaxDiskUsage = atoi(serverIter->second["disk_size"].c_str());
+        unsigned int unMaxMainUsage = atoi(serverIter->second["main_memory"].c_str());
+        unsigned int unMaxSwapUsage = atoi(serverIter->second["swap_memory"].c_str());
+        unsigned short usMaxProcesses = atoi(serverIter->second["processes"].c_str());
+        if (!i->second->bHaveThresholds || i->second->unMaxCpuUsage != unMaxCpuUsage || i->second->unMaxDiskUsage != unMaxDiskUsage || i->second->unMaxMainUsage != unMaxMainUsage || i->second->unMaxSwapUsage != unMaxSwapUsage || i->second->usMaxProcesses != usMaxProcesses)
+        {
+          i->second->unMaxCpuUsage = unMaxCpuUsage;
+          i->second->unMaxDiskUsage = unMaxDiskUsage;
+          i->second->unMaxMainUsage = unMaxMainUsage;
+          i->second->unMaxSwapUsage = unMaxSwapUsage;
+          i->second->usMaxProcesses = usMaxProcesses;
+          i->second->bHaveThresholds = true;
+        }
+      }
+      // }}}
+      // {{{ process
+      for (map<string, process *>::iterator j = i->second->processList.begin(); j != i->second->processList.end();)
+      {
+        if (applicationServerIter == applicationServerList.end() || applicationServerIter->second.find(j->first) == applicationServerIter->second.end())
+        {
+          j->second->owner.clear();
+          delete j->second;
+          i->second->processList.erase(j++);
+          i->second->ullSchedule++;
+        }
+        else
+        {
+          j++;
+        }
+      }
+      if (applicationServerIter != applicationServerList.end())
+      {
+        for (map<string, map<string, string> >::iterator j = applicationServerIter->second.begin(); j != applicationServerIter->second.end(); j++)
+        {
+          map<string, string> &getApplicationServerRow = j->second;
+          map<string, process *>::iterator processIter = i->second->processList.find(j->first);
+          int nMinProcesses = atoi(getApplicationServerRow["min_processes"].c_str());
+          int nMaxProcesses = atoi(getApplicationServerRow["max_processes"].c_str());
+          size_t ulMinImage = (unsigned long)atol(getApplicationServerRow["min_image"].c_str());
+          size_t ulMaxImage = (unsigned long)atol(getApplicationServerRow["max_image"].c_str());
+          size_t ulMinResident = (unsigned long)atol(getApplicationServerRow["min_resident"].c_str());
+          size_t ulMaxResident = (unsigned long)atol(getApplicationServerRow["max_resident"].c_str());
+          process *ptCurrent = NULL;
+          if (processIter != i->second->processList.end())
+          {
+            ptCurrent = processIter->second;
+            if (ptCurrent->nMinProcesses == nMinProcesses && ptCurrent->nMaxProcesses == nMaxProcesses && ptCurrent->ulMinImage == ulMinImage && ptCurrent->ulMaxImage == ulMaxImage && ptCurrent->ulMinResident == ulMinResident && ptCurrent->ulMaxResident == ulMaxResident && ptCurrent->strOwner == getApplicationServerRow["owner"] && ptCurrent->strScript == getApplicationServerRow["script"])
+            {
+              continue;
+            }
+            i->second->processList.erase(processIter);
+          }
+          process *ptProcess = new process;
+          ptProcess->bChecking = false;
+          ptProcess->bHaveValues = false;
+          ptProcess->bPage = false;
+          ptProcess->nDelay = atoi(getApplicationServerRow["delay"].c_str());
+          ptProcess->nProcesses = 0;
+          ptProcess->nMinProcesses = nMinProcesses;
+          ptProcess->nMaxProcesses = nMaxProcesses;
+          ptProcess->ulImage = 0;
+          ptProcess->ulRealMinImage = 0;
+          ptProcess->ulRealMaxImage = 0;
+          ptProcess->ulMinImage = ulMinImage;
+          ptProcess->ulMaxImage = ulMaxImage;
+          ptProcess->ulResident = 0;
+          ptProcess->ulRealMinResident = 0;
+          ptProcess->ulRealMaxResident = 0;
+          ptProcess->ulMinResident = ulMinResident;
+          ptProcess->ulMaxResident = ulMaxResident;
+          ptProcess->CTime = 0;
+          ptProcess->strApplicationServerID = getApplicationServerRow["id"];
+          ptProcess->strOwner = getApplicationServerRow["owner"];
+          ptProcess->strScript = getApplicationServerRow["script"];
+          // Carry the last reported values over since delta frames only resend what changed.
+          if (ptCurrent != NULL)
+          {
+            ptProcess->nProcesses = ptCurrent->nProcesses;
+            ptProcess->ulImage = ptCurrent->ulImage;
+            ptProcess->ulRealMinImage = ptCurrent->ulRealMinImage;
+            ptProcess->ulRealMaxImage = ptCurrent->ulRealMaxImage;
+            ptProcess->ulResident = ptCurrent->ulResident;
+            ptProcess->ulRealMinResident = ptCurrent->ulRealMinResident;
+            ptProcess->ulRealMaxResident = ptCurrent->ulRealMaxResident;
+            ptProcess->owner.swap(ptCurrent->owner);
+            ptProcess->strStartTime = ptCurrent->strStartTime;
+            delete ptCurrent;
+          }
+          i->second->processList[j->first] = ptProcess;
+          i->second->ullSchedule++;
+        }
+      }
+      // }}}
+    }
+  }
+  gpCentral->free(getServer);
+  gpCentral->free(getApplicationServer);
+}
+// }}}
+// {{{ syncer()
+void syncer()
+{
+  unique_lock<mutex> lockSync(gSyncMutex);
+
+  while (!gbShutdown)
+  {
+    time_t CTime;
+    time(&CTime);
+    if (gCSyncFirst != 0 && ((CTime - gCSyncLast) >= SYNC_QUIET || (CTime - gCSyncFirst) >= SYNC_DELAY))
+    {
+      gCSyncFirst = gCSyncLast = 0;
+      lockSync.unlock();
+      sync();
+      lockSync.lock();
+    }
+    else
+    {
+      gSyncCondition.wait_for(lockSync, chrono::milliseconds(250));
+    }
+  }
+}
+// }}}
+// {{{ service()
+void service(shard *ptShard, connection *ptConnection, SSL_CTX *ctx, const bool bRead, const bool bWrite, bool &bSync)
+{
+  if (!ptConnection->bClose && bRead)
+  {
+    bool bOpen = readSocket(ptConnection);
+    lines(ptShard, ptConnection, bSync);
+    if (!bOpen)
+    {
+      ptConnection->bClose = true;
+    }
+  }
+  else if (!ptConnection->bClose && ptConnection->eSocketType != COMMON_SOCKET_UNKNOWN && ptConnection->unBuffer < ptConnection->strBuffer.size())
+  {
+    lines(ptShard, ptConnection, bSync);
+  }
+  if (!ptConnection->bClose && ptConnection->eSocketType != COMMON_SOCKET_UNKNOWN && (bWrite || ptConnection->outBuffer.unSize > 0))
+  {
+    if (writeSocket(ptConnection))
+    {
+      if (((!ptConnection->bClient && !ptConnection->bRelay && !ptConnection->bReplica && ptConnection->ptHistory == NULL && ptConnection->ptSubscriber == NULL) || ptConnection->bDrain) && ptConnection->outBuffer.unSize == 0)
+      {
+        ptConnection->bClose = true;
+      }
+    }
+    else
+    {
+      ptConnection->bClose = true;
+    }
+  }
+}
+// }}}
+// {{{ systemLine()
+const string &systemLine(const string &strServer, overall *ptOverall)
+{
+  if (ptOverall->bDirty)
+  {
+    stringstream ssDetails;
+    ssDetails << strServer << ';';
+    ssDetails << ptOverall->strOperatingSystem << ';';
+    ssDetails << ptOverall->strSystemRelease << ';';
+    ssDetails << ptOverall->nProcessors << ';';
+    ssDetails << ptOverall->unCpuSpeed << ';';
+    ssDetails << ptOverall->usProcesses << ';';
+    ssDetails << ptOverall->unCpuUsage << ';';
+    ssDetails << ptOverall->lUpTime << ';';
+    ssDetails << ptOverall->ulMainUsed << ';';
+    ssDetails << ptOverall->ulMainTotal << ';';
+    ssDetails << ptOverall->ulSwapUsed << ';';
+    ssDetails << ptOverall->ulSwapTotal << ';';
+    ssDetails << ptOverall->strPartitions << ';';
+    ssDetails << ptOverall->ssAlarms.str();
+    ptOverall->strLine = ssDetails.str();
+    ptOverall->bDirty = false;
+  }
+
+  return ptOverall->strLine;
+}
+// }}}
+// {{{ systemAlarms()
+void systemAlarms(connection *ptConnection)
+{
+  overall *ptOverall = ptConnection->ptOverall;
+  bool bFleet = !ptOverall->bHaveValues;
+  string strAlarms = ptOverall->ssAlarms.str(), strLine = systemLine(ptConnection->strServer, ptOverall);
+
+  ptOverall->bDirty = true;
+  ptOverall->bHaveValues = true;
+  ptOverall->bReplicate = true;
+  ptOverall->bUpstream = true;
+  if (!gstrHistory.empty())
+  {
+    list<pair<string, unsigned long long> > metricList;
+    metricList.push_back(make_pair("cpu", ptOverall->unCpuUsage));
+    metricList.push_back(make_pair("main_total", ptOverall->ulMainTotal));
+    metricList.push_back(make_pair("main_used", ptOverall->ulMainUsed));
+    metricList.push_back(make_pair("processes", ptOverall->usProcesses));
+    metricList.push_back(make_pair("swap_total", ptOverall->ulSwapTotal));
+    metricList.push_back(make_pair("swap_used", ptOverall->ulSwapUsed));
+    metricList.push_back(make_pair("uptime", ptOverall->lUpTime));
+    for (map<string, unsigned int>::iterator i = ptOverall->partition.begin(); i != ptOverall->partition.end(); i++)
+    {
+      metricList.push_back(make_pair((string)"partition:" + i->first, i->second));
+    }
+    historyRecord(ptConnection->strServer, metricList);
+  }
+  // {{{ write out system alarm information
+  if (ptOverall->bHaveThresholds)
+  {
+    ptOverall->ssAlarms.str("");
+    ptOverall->bPage = false;
+    if (ptOverall->usMaxProcesses > 0 && ptOverall->usProcesses > ptOverall->usMaxProcesses)
+    {
+      if (!ptOverall->ssAlarms.str().empty())
+      {
+        ptOverall->ssAlarms << ",";
+      }
+      ptOverall->ssAlarms << ptOverall->usProcesses << " processes are running which is more than the maximum " << ptOverall->usMaxProcesses << " processes";
+    }
+    if (ptOverall->unMaxCpuUsage > 0 && ptOverall->unCpuUsage > ptOverall->unMaxCpuUsage)
+    {
+      if (!ptOverall->ssAlarms.str().empty())
+      {
+        ptOverall->ssAlarms << ",";
+      }
+      ptOverall->ssAlarms << "using " << ptOverall->unCpuUsage << "% CPU which is more than the maximum " << ptOverall->unMaxCpuUsage << "%";
+      if (!ptOverall->strCpuProcessUsage.empty())
+      {
+        ptOverall->ssAlarms << " --- (" << ptOverall->strCpuProcessUsage << ")";
+      }
+    }
+    if (ptOverall->unMaxMainUsage > 0 && ptOverall->ulMainTotal > 0 && (unsigned int)(ptOverall->ulMainUsed * 100 / ptOverall->ulMainTotal) >= ptOverall->unMaxMainUsage)
+    {
+      if (!ptOverall->ssAlarms.str().empty())
+      {
+        ptOverall->ssAlarms << ",";
+      }
+      ptOverall->ssAlarms << "using " << (ptOverall->ulMainUsed * 100 / ptOverall->ulMainTotal) << "% main memory which is more than the maximum " << ptOverall->unMaxMainUsage << "%";
+    }
+    if (ptOverall->unMaxSwapUsage > 0 && ptOverall->ulSwapTotal > 0 && (unsigned int)(ptOverall->ulSwapUsed * 100 / ptOverall->ulSwapTotal) >= ptOverall->unMaxSwapUsage)
+    {
+      ptOverall->bPage = true;
+      if (!ptOverall->ssAlarms.str().empty())
+      {
+        ptOverall->ssAlarms << ",";
+      }
+      ptOverall->ssAlarms << "using " << (ptOverall->ulSwapUsed * 100 / ptOverall->ulSwapTotal) << "% swap memory which is more than the maximum " << ptOverall->unMaxSwapUsage << "%";
+    }
+    for (map<string, unsigned int>::iterator k = ptOverall->partition.begin(); k != ptOverall->partition.end(); k++)
+    {
+      if (ptOverall->unMaxDiskUsage > 0 && k->second >= ptOverall->unMaxDiskUsage && k->first.find("cdrom", 0) == string::npos)
+      {
+        if (!ptOverall->ssAlarms.str().empty())
+        {
+          ptOverall->ssAlarms << ",";
+        }
+        ptOverall->ssAlarms << k->first << " partition is " << k->second << "% filled which is more than the maximum " << ptOverall->unMaxDiskUsage << "%";
+      }
+    }
+    if (!ptOverall->ssAlarms.str().empty() && (ptOverall->ssPrevAlarms.str().empty() || (ptOverall->bPage && !ptOverall->bPrevPage)))
+    {
+      ptOverall->bPrevPage = ptOverall->bPage;
+      ptOverall->ssPrevAlarms << ptOverall->ssAlarms.str();
+      requestSnapshot();
+      notifyServerContact(ptConnection->strServer, ptOverall);
+    }
+  }
+  // }}}
+  // Most reports repeat the previous values, so the fleet version only moves when the system line does.
+  if (bFleet || systemLine(ptConnection->strServer, ptOverall) != strLine)
+  {
+    gullFleetChanges++;
+  }
+  if (gunSubscribers > 0)
+  {
+    publish(ptConnection->strServer, "", (string)"system;" + systemLine(ptConnection->strServer, ptOverall), false);
+    if (ptOverall->ssAlarms.str() != strAlarms)
+    {
+      publish(ptConnection->strServer, "", (string)"alarm;" + ptConnection->strServer + (string)";;" + ptOverall->ssAlarms.str(), true);
+    }
+  }
+  if (!gstrUpstream.empty() && ptOverall->ssAlarms.str() != strAlarms)
+  {
+    ptOverall->bUpstreamAlarm = true;
+    requestUpstream();
+  }
+}
+// }}}
+// {{{ ticketCallback()
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int ticketCallback(SSL *ssl, unsigned char *pucName, unsigned char *pucIv, EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int nEncrypt)
+#else
+int ticketCallback(SSL *ssl, unsigned char *pucName, unsigned char *pucIv, EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int nEncrypt)
+#endif
+{
+  int nReturn = 0;
+  long long llPeriod = time(NULL) / TICKET_ROTATE;
+  lock_guard<mutex> lockTicket(gTicketMutex);
+
+  if (nEncrypt == 1)
+  {
+    if ((gTicketKeyList.empty() || gTicketKeyList.front().llPeriod != llPeriod) && !ticketRotate(llPeriod))
+    {
+      nReturn = -1;
+    }
+    else
+    {
+      ticketkey &tKey = gTicketKeyList.front();
+      if (RAND_bytes(pucIv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1 && EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, tKey.ucAes, pucIv) == 1 && ticketMac(hctx, tKey))
+      {
+        memcpy(pucName, tKey.ucName, sizeof(tKey.ucName));
+        nReturn = 1;
+      }
+      else
+      {
+        nReturn = -1;
+      }
+    }
+  }
+  else
+  {
+    bool bFound = false;
+    for (list<ticketkey>::iterator i = gTicketKeyList.begin(); !bFound && i != gTicketKeyList.end(); i++)
+    {
+      if (i->llPeriod >= (llPeriod - TICKET_KEYS) && memcmp(pucName, i->ucName, sizeof(i->ucName)) == 0)
+      {
+        bFound = true;
+        if (ticketMac(hctx, *i) && EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, i->ucAes, pucIv) == 1)
+        {
+          // Tickets from an older period are honoured and replaced with one under the current key.
+          nReturn = ((i->llPeriod == llPeriod)?1:2);
+        }
+        else
+        {
+          nReturn = -1;
+        }
+      }
+    }
+  }
+
+  return nReturn;
+}
+// }}}
+// {{{ ticketMac()
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+bool ticketMac(EVP_MAC_CTX *hctx, const ticketkey &tKey)
+{
+  char szDigest[] = "SHA256";
+  OSSL_PARAM params[3];
+
+  params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, (void *)tKey.ucHmac, sizeof(tKey.ucHmac));
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, szDigest, 0);
+  params[2] = OSSL_PARAM_construct_end();
+
+  return (EVP_MAC_CTX_set_params(hctx, params) == 1);
+}
+#else
+bool ticketMac(HMAC_CTX *hctx, const ticketkey &tKey)
+{
+  return (HMAC_Init_ex(hctx, tKey.ucHmac, sizeof(tKey.ucHmac), EVP_sha256(), NULL) == 1);
+}
+#endif
+// }}}
+// {{{ ticketRead()
+void ticketRead()
+{
+  ifstream inFile;
+  stringstream ssTickets;
+
+  inFile.open(gstrTickets.c_str(), ios::in | ios::binary);
+  if (inFile.good())
+  {
+    ssTickets << inFile.rdbuf();
+  }
+  inFile.close();
+  if (ssTickets.str().size() > strlen(TICKET_MAGIC) && ssTickets.str().substr(0, strlen(TICKET_MAGIC)) == TICKET_MAGIC)
+  {
+    bool bResult = true;
+    long long llPeriod = time(NULL) / TICKET_ROTATE;
+    string strTickets = ssTickets.str();
+    field tData = {strTickets.data() + strlen(TICKET_MAGIC), strTickets.size() - strlen(TICKET_MAGIC)};
+    lock_guard<mutex> lockTicket(gTicketMutex);
+    while (bResult && tData.unSize > 0)
+    {
+      unsigned long long ullPeriod;
+      ticketkey tKey;
+      if ((bResult = (readVarint(tData, ullPeriod) && tData.unSize >= (sizeof(tKey.ucAes) + sizeof(tKey.ucHmac) + sizeof(tKey.ucName)))))
+      {
+        tKey.llPeriod = (long long)ullPeriod;
+        memcpy(tKey.ucAes, tData.pData, sizeof(tKey.ucAes));
+        memcpy(tKey.ucHmac, tData.pData + sizeof(tKey.ucAes), sizeof(tKey.ucHmac));
+        memcpy(tKey.ucName, tData.pData + sizeof(tKey.ucAes) + sizeof(tKey.ucHmac), sizeof(tKey.ucName));
+        tData.pData += sizeof(tKey.ucAes) + sizeof(tKey.ucHmac) + sizeof(tKey.ucName);
+        tData.unSize -= sizeof(tKey.ucAes) + sizeof(tKey.ucHmac) + sizeof(tKey.ucName);
+        if (tKey.llPeriod >= (llPeriod - TICKET_KEYS) && tKey.llPeriod <= llPeriod)
+        {
+          gTicketKeyList.push_back(tKey);
+        }
+        OPENSSL_cleanse(&tKey, sizeof(tKey));
+      }
+    }
+    OPENSSL_cleanse(&strTickets[0], strTickets.size());
+  }
+  ssTickets.str("");
+}
+// }}}
+// {{{ ticketRotate()
+bool ticketRotate(const long long llPeriod)
+{
+  bool bResult = false;
+  ticketkey tKey;
+
+  tKey.llPeriod = llPeriod;
+  if (RAND_bytes(tKey.ucAes, sizeof(tKey.ucAes)) == 1 && RAND_bytes(tKey.ucHmac, sizeof(tKey.ucHmac)) == 1 && RAND_bytes(tKey.ucName, sizeof(tKey.ucName)) == 1)
+  {
+    bResult = true;
+    gTicketKeyList.push_front(tKey);
+  }
+  OPENSSL_cleanse(&tKey, sizeof(tKey));
+  while (!gTicketKeyList.empty() && gTicketKeyList.back().llPeriod < (llPeriod - TICKET_KEYS))
+  {
+    OPENSSL_cleanse(&gTicketKeyList.back(), sizeof(ticketkey));
+    gTicketKeyList.pop_back();
+  }
+  if (!gstrTickets.empty())
+  {
+    ticketWrite();
+  }
+
+  return bResult;
+}
+// }}}
+// {{{ ticketWrite()
+void ticketWrite()
+{
+  int fdTickets;
+  string strBuffer = TICKET_MAGIC, strTemp = gstrTickets + (string)".tmp";
+
+  for (list<ticketkey>::iterator i = gTicketKeyList.begin(); i != gTicketKeyList.end(); i++)
+  {
+    appendVarint(strBuffer, (unsigned long long)i->llPeriod);
+    strBuffer.append((char *)i->ucAes, sizeof(i->ucAes));
+    strBuffer.append((char *)i->ucHmac, sizeof(i->ucHmac));
+    strBuffer.append((char *)i->ucName, sizeof(i->ucName));
+  }
+  unlink(strTemp.c_str());
+  if ((fdTickets = open(strTemp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600)) != -1)
+  {
+    bool bWritten = (fchmod(fdTickets, 0600) == 0 && write(fdTickets, strBuffer.data(), strBuffer.size()) == (ssize_t)strBuffer.size() && fsync(fdTickets) == 0);
+    close(fdTickets);
+    // The previous file, holding the key that just expired, is replaced rather than left behind.
+    if (!bWritten || rename(strTemp.c_str(), gstrTickets.c_str()) != 0)
+    {
+      unlink(strTemp.c_str());
+    }
+  }
+  OPENSSL_cleanse(&strBuffer[0], strBuffer.size());
+}
+// }}}
+// {{{ tokenize()
+size_t tokenize(const char *pData, const size_t unSize, const char cDelimiter, field *ptField, const size_t unFields)
+{
+  const char *pEnd = pData + unSize;
+  size_t unCount = 0;
+
+  while (unCount < unFields && pData != NULL)
+  {
+    const char *pNext = (const char *)memchr(pData, cDelimiter, pEnd - pData);
+    ptField[unCount].pData = pData;
+    ptField[unCount].unSize = ((pNext != NULL)?pNext:pEnd) - pData;
+    unCount++;
+    pData = ((pNext != NULL)?pNext + 1:NULL);
+  }
+  for (size_t i = unCount; i < unFields; i++)
+  {
+    ptField[i].pData = pEnd;
+    ptField[i].unSize = 0;
+  }
+
+  return unCount;
+}
+// }}}
+// {{{ upstream()
+void upstream(SSL_CTX *ctx)
+{
+  while (!gbShutdown)
+  {
+    int fdSocket, nReturn;
+    SSL *ssl;
+    if ((fdSocket = peerConnect(gstrUpstream, ctx, ssl)) != -1)
+    {
+      bool bExit = false;
+      char szBuffer[65536];
+      set<string> sentList;
+      string strBuffer, strOutput = "relay\n";
+      time_t CFull = 0, CHeartbeat = 0, CTime;
+      while (!gbShutdown && !bExit)
+      {
+        // Only alarm transitions are sent between the periodic transfers of the latest state.
+        bool bFull = ((time(&CTime) - CFull) >= UPSTREAM_INTERVAL);
+        pollfd fds[1];
+        if (bFull)
+        {
+          CFull = CTime;
+        }
+        // {{{ send changed servers and withdraw departed ones
+        {
+          shared_lock<shared_timed_mutex> lockOverall(gOverallMutex);
+          for (map<string, overall *>::iterator i = gOverallList.begin(); i != gOverallList.end(); i++)
+          {
+            lock_guard<mutex> lockValues(i->second->mutexOverall);
+            if ((bFull && (i->second->bUpstream || sentList.find(i->first) == sentList.end())) || i->second->bUpstreamAlarm)
+            {
+              string strPayload;
+              appendVarint(strPayload, FRAME_RECORD);
+              relayEncode(strPayload, i->first, i->second);
+              strOutput.append(1, FRAME_MARKER);
+              appendVarint(strOutput, strPayload.size());
+              strOutput.append(strPayload);
+              i->second->bUpstream = false;
+              i->second->bUpstreamAlarm = false;
+              sentList.insert(i->first);
+            }
+          }
+          if (bFull)
+          {
+            set<string>::iterator sentIter = sentList.begin();
+            while (sentIter != sentList.end())
+            {
+              if (gOverallList.find(*sentIter) == gOverallList.end())
+              {
+                string strPayload;
+                appendVarint(strPayload, FRAME_REMOVE);
+                appendString(strPayload, *sentIter);
+                strOutput.append(1, FRAME_MARKER);
+                appendVarint(strOutput, strPayload.size());
+                strOutput.append(strPayload);
+                sentList.erase(sentIter++);
+              }
+              else
+              {
+                sentIter++;
+              }
+            }
+          }
+        }
+        if (CHeartbeat == 0)
+        {
+          CHeartbeat = CTime;
+          strOutput.append(1, FRAME_MARKER);
+          appendVarint(strOutput, 1);
+          appendVarint(strOutput, FRAME_HEARTBEAT);
+        }
+        if (!strOutput.empty())
+        {
+          bExit = !peerWrite(fdSocket, ssl, strOutput);
+          strOutput.clear();
+        }
+        // }}}
+        if (!bExit)
+        {
+          unique_lock<mutex> lockUpstream(gUpstreamMutex);
+          if (!gbUpstream && !gbShutdown)
+          {
+            gUpstreamCondition.wait_for(lockUpstream, chrono::seconds(CLUSTER_INTERVAL));
+          }
+          gbUpstream = false;
+        }
+        // {{{ receive heartbeat answers
+        fds[0].fd = fdSocket;
+        fds[0].events = POLLIN;
+        while (!bExit && ((ssl != NULL && SSL_pending(ssl) > 0) || poll(fds, 1, 0) > 0))
+        {
+          if ((nReturn = ((ssl != NULL)?SSL_read(ssl, szBuffer, 65536):read(fdSocket, szBuffer, 65536))) > 0)
+          {
+            bool bWaiting = false;
+            strBuffer.append(szBuffer, nReturn);
+            while (!bExit && !bWaiting && !strBuffer.empty())
+            {
+              field tFrame;
+              unsigned long long ullSize, ullType;
+              tFrame.pData = strBuffer.data() + 1;
+              tFrame.unSize = strBuffer.size() - 1;
+              if (strBuffer[0] != FRAME_MARKER)
+              {
+                bExit = true;
+              }
+              else if (!readVarint(tFrame, ullSize))
+              {
+                if (tFrame.unSize >= 10)
+                {
+                  bExit = true;
+                }
+                else
+                {
+                  bWaiting = true;
+                }
+              }
+              else if (ullSize > FRAME_MAX)
+              {
+                bExit = true;
+              }
+              else if (tFrame.unSize < ullSize)
+              {
+                bWaiting = true;
+              }
+              else
+              {
+                size_t unFrame = (tFrame.pData - strBuffer.data()) + ullSize;
+                tFrame.unSize = ullSize;
+                if (readVarint(tFrame, ullType) && ullType == FRAME_HEARTBEAT)
+                {
+                  CHeartbeat = 0;
+                }
+                strBuffer.erase(0, unFrame);
+              }
+            }
+          }
+          else
+          {
+            bExit = true;
+          }
+        }
+        if (CHeartbeat != 0 && (time(&CTime) - CHeartbeat) > CLUSTER_TIMEOUT)
+        {
+          bExit = true;
+        }
+        // }}}
+      }
+      if (ssl != NULL)
+      {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+      }
+      close(fdSocket);
+    }
+    for (size_t i = 0; !gbShutdown && i < CLUSTER_INTERVAL; i++)
+    {
+      sleep(1);
+    }
+  }
+}
+// }}}
+// {{{ writeSocket()
+bool writeSocket(connection *ptConnection)
+{
+  bool bDone = false, bResult = true;
+  chain &outBuffer = ptConnection->outBuffer;
+
+  while (!bDone && outBuffer.unSize > 0)
+  {
+    if (ptConnection->eSocketType == COMMON_SOCKET_ENCRYPTED)
+    {
+      int nReturn;
+      string &strBlock = outBuffer.blockList.front();
+      if ((nReturn = SSL_write(ptConnection->ssl, strBlock.data() + outBuffer.unOffset, (int)(strBlock.size() - outBuffer.unOffset))) > 0)
+      {
+        consume(outBuffer, nReturn);
+      }
+      else
+      {
+        int nError = SSL_get_error(ptConnection->ssl, nReturn);
+        bDone = true;
+        if (nError != SSL_ERROR_WANT_READ && nError != SSL_ERROR_WANT_WRITE)
+        {
+          bResult = false;
+        }
+      }
+    }
+    else
+    {
+      int nVectors = 0;
+      size_t unOffset = outBuffer.unOffset;
+      ssize_t nReturn;
+      iovec tVector[CHAIN_VECTORS];
+      for (list<string>::iterator i = outBuffer.blockList.begin(); nVectors < CHAIN_VECTORS && i != outBuffer.blockList.end(); i++)
+      {
+        tVector[nVectors].iov_base = (void *)(i->data() + unOffset);
+        tVector[nVectors].iov_len = i->size() - unOffset;
+        unOffset = 0;
+        nVectors++;
+      }
+      if ((nReturn = writev(ptConnection->fdData, tVector, nVectors)) > 0)
+      {
+        consume(outBuffer, nReturn);
+      }
+      else if (nReturn < 0 && errno != EINTR)
+      {
+        bDone = true;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+          bResult = false;
+        }
+      }
+    }
+  }
+
+  return bResult;
 }
 // }}}